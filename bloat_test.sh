@@ -4,21 +4,33 @@
 # tinyformat, vs alternatives.  Call as
 #
 # C99 printf            :  bloat_test.sh $CXX [-O3]
-# tinyformat            :  bloat_test.sh $CXX [-O3] -DUSE_TINYFORMAT
-# tinyformat, no inlines:  bloat_test.sh $CXX [-O3] -DUSE_TINYFORMAT -DUSE_TINYFORMAT_NOINLINE
+# tinyformat            :  bloat_test.sh $CXX [-O3] -DUSE_TINYFORMAT [-std=c++98 -DTINYFORMAT_NO_VARIADIC_TEMPLATES]
+# tinyformat, no inlines:  bloat_test.sh $CXX [-O3] -DUSE_TINYFORMAT -DTINYFORMAT_SEPARATE_COMPILATION
 # boost::format         :  bloat_test.sh $CXX [-O3] -DUSE_BOOST
 # std::iostream         :  bloat_test.sh $CXX [-O3] -DUSE_IOSTREAMS
 #
-# Note: to test the NOINLINE version of tinyformat, you need to remove the few
-# inline functions in the tinyformat::detail namespace, and put them into a
-# file tinyformat.cpp.  Then rename that version of tinyformat.h into
-# tinyformat_noinline.h
+# Each translation unit is compiled separately, as in a real project, and the
+# script reports
+#
+#   * Wall time to compile all the translation units, and to link
+#   * Total size of the object files, and of the linked and stripped binary
+#   * The number of FormatArgActionsFor<T> and FormatListN<N> instantiations
+#     emitted out of line.  "per TU" sums the distinct instantiations over all
+#     object files, which is the work repeated in every translation unit;
+#     "linked" counts those remaining in the binary after duplicates have been
+#     merged.  Instantiations which were entirely inlined aren't counted.
+#
+# Set BLOAT_TEST_OUT to also append the results as a line of JSON to that file,
+# for comparison between releases.
+#
+# With TINYFORMAT_SEPARATE_COMPILATION, tinyformat.cpp is compiled once as part
+# of the main translation unit.
 
 
 prefix=_bloat_test_tmp_
 numTranslationUnits=100
 
-rm -f $prefix??.cpp ${prefix}main.cpp ${prefix}all.h
+rm -f ${prefix}???.cpp ${prefix}???.o ${prefix}main.cpp ${prefix}main.o ${prefix}all.h
 
 template='
 #ifdef USE_BOOST
@@ -52,11 +64,7 @@ void doFormat_a()
 
 #else
 #ifdef USE_TINYFORMAT
-#   ifdef USE_TINYFORMAT_NOINLINE
-#       include "tinyformat_noinline.h"
-#   else
-#       include "tinyformat.h"
-#   endif
+#   include "tinyformat.h"
 #   define PRINTF tfm::printf
 #else
 #   include <stdio.h>
@@ -79,7 +87,7 @@ void doFormat_a()
 # Generate all the files
 echo "#include \"${prefix}all.h\"" >> ${prefix}main.cpp
 echo '
-#ifdef USE_TINYFORMAT_NOINLINE
+#if defined(USE_TINYFORMAT) && defined(TINYFORMAT_SEPARATE_COMPILATION)
 #include "tinyformat.cpp"
 #endif
 
@@ -98,8 +106,56 @@ echo "return 0; }" >> ${prefix}main.cpp
 
 
 # Compile
-time "$@" ${prefix}???.cpp ${prefix}main.cpp -o ${prefix}.out
-ls -sh ${prefix}.out
+now() { date +%s.%N; }
+elapsed() { awk "BEGIN { printf \"%.2f\", $2 - $1 }"; }
+
+srcdir=$(cd "$(dirname "$0")" && pwd)
+startTime=$(now)
+for f in ${prefix}???.cpp ${prefix}main.cpp ; do
+    "$@" -I"$srcdir" -c $f -o ${f%.cpp}.o || exit 1
+done
+compileTime=$(elapsed $startTime $(now))
+startTime=$(now)
+"$@" ${prefix}???.o ${prefix}main.o -o ${prefix}.out || exit 1
+linkTime=$(elapsed $startTime $(now))
 cp ${prefix}.out ${prefix}stripped.out
 strip ${prefix}stripped.out
-ls -sh ${prefix}stripped.out
+
+# Distinct specializations of the class template $1 with members defined in
+# each of the following files, summed over files
+countInstantiations() {
+    local pattern=$1
+    shift
+    for f in "$@" ; do
+        nm -C --defined-only $f |
+            perl -ne 'print "$1\n" while /('$pattern'(<(?:[^<>]++|(?2))*>))::/g' |
+            sort -u
+    done | wc -l
+}
+
+fileSize() { stat -c %s "$@" | awk '{ total += $1 } END { print total }'; }
+
+objectSize=$(fileSize ${prefix}???.o ${prefix}main.o)
+binarySize=$(fileSize ${prefix}.out)
+strippedSize=$(fileSize ${prefix}stripped.out)
+argActionsPerTU=$(countInstantiations FormatArgActionsFor ${prefix}???.o)
+argActionsLinked=$(countInstantiations FormatArgActionsFor ${prefix}.out)
+formatListPerTU=$(countInstantiations FormatListN ${prefix}???.o)
+formatListLinked=$(countInstantiations FormatListN ${prefix}.out)
+
+echo "compile time:         ${compileTime}s ($numTranslationUnits translation units)"
+echo "link time:            ${linkTime}s"
+echo "object size:          $objectSize bytes"
+echo "binary size:          $binarySize bytes"
+echo "stripped binary size: $strippedSize bytes"
+echo "FormatArgActionsFor:  $argActionsPerTU per TU, $argActionsLinked linked"
+echo "FormatListN:          $formatListPerTU per TU, $formatListLinked linked"
+
+if [ -n "$BLOAT_TEST_OUT" ] ; then
+    echo "{\"command\": \"$*\", \"compile_time\": $compileTime, \"link_time\": $linkTime," \
+         "\"object_size\": $objectSize, \"binary_size\": $binarySize," \
+         "\"stripped_size\": $strippedSize," \
+         "\"arg_actions_per_tu\": $argActionsPerTU, \"arg_actions_linked\": $argActionsLinked," \
+         "\"format_list_per_tu\": $formatListPerTU, \"format_list_linked\": $formatListLinked}" \
+         >> "$BLOAT_TEST_OUT"
+fi
@@ -0,0 +1,14 @@
+// tinyformat.cpp
+// Copyright (C) 2011, Chris Foster [chris42f (at) gmail (d0t) com]
+// Distributed under the Boost Software License, Version 1.0; see tinyformat.h
+//
+// The parts of tinyformat which aren't templates, for programs built with
+// TINYFORMAT_SEPARATE_COMPILATION.  Compile this file into the program (or
+// the tinyformat library target of the CMake build) using the same
+// configuration macros as the code which includes tinyformat.h.
+
+#ifndef TINYFORMAT_SEPARATE_COMPILATION
+#   define TINYFORMAT_SEPARATE_COMPILATION
+#endif
+#define TINYFORMAT_IMPLEMENTATION
+#include "tinyformat.h"
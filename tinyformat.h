@@ -109,6 +109,20 @@
 //
 //   tfm::vformat(std::cout, "%s, %s %d, %.2d:%.2d\n", formatList);
 //
+// Format strings which are used repeatedly may be parsed once ahead of time
+// into a CompiledFormat, which can be used anywhere a format string is
+// accepted by format() and vformat():
+//
+//   tfm::CompiledFormat dateFmt("%s, %s %d, %.2d:%.2d\n");
+//   tfm::format(std::cout, dateFmt, weekday, month, day, hour, min);
+//
+// With C++14, string literal format strings may instead be parsed at compile
+// time by wrapping them in TINYFORMAT_FMT, which also checks the number of
+// arguments during compilation:
+//
+//   tfm::printf(TINYFORMAT_FMT("%s, %s %d, %.2d:%.2d\n"),
+//               weekday, month, day, hour, min);
+//
 //
 // Additional API information
 // --------------------------
@@ -138,12 +152,29 @@ namespace tfm = tinyformat;
 // general.  If you don't define this, C++11 support is autodetected below.
 // #define TINYFORMAT_USE_VARIADIC_TEMPLATES
 
+// Define TINYFORMAT_VARIADIC_ONLY to leave out the macros which emulate
+// variadic templates in C++98 - TINYFORMAT_ARGTYPES(n), TINYFORMAT_VARARGS(n),
+// TINYFORMAT_PASSARGS(n) and TINYFORMAT_FOREACH_ARGNUM - so that code using
+// them fails to compile rather than being limited to 16 arguments.  This
+// implies TINYFORMAT_USE_VARIADIC_TEMPLATES and requires C++11.
+// #define TINYFORMAT_VARIADIC_ONLY
+
+// Define TINYFORMAT_SEPARATE_COMPILATION to compile the parts of tinyformat
+// which aren't templates once, in tinyformat.cpp, rather than inline in every
+// translation unit.  tinyformat.cpp must then be built into the program with
+// the same configuration macros as the code which uses it.
+// #define TINYFORMAT_SEPARATE_COMPILATION
+
 
 //------------------------------------------------------------------------------
 // Implementation details.
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <new>
 #include <sstream>
+#include <vector>
 
 #ifndef TINYFORMAT_ASSERT
 #   include <cassert>
@@ -155,18 +186,226 @@ namespace tfm = tinyformat;
 #   define TINYFORMAT_ERROR(reason) assert(0 && reason)
 #endif
 
+// Errors are raised via TINYFORMAT_RAISE_ERROR, which also counts them when
+// collecting statistics.
+#ifdef TINYFORMAT_STATS
+#   define TINYFORMAT_RAISE_ERROR(reason)                                  \
+        do { ::tinyformat::detail::statsCountError(); TINYFORMAT_ERROR(reason); } while (false)
+#else
+#   define TINYFORMAT_RAISE_ERROR(reason) TINYFORMAT_ERROR(reason)
+#endif
+
 #if !defined(TINYFORMAT_USE_VARIADIC_TEMPLATES) && !defined(TINYFORMAT_NO_VARIADIC_TEMPLATES)
 #   ifdef __GXX_EXPERIMENTAL_CXX0X__
 #       define TINYFORMAT_USE_VARIADIC_TEMPLATES
 #   endif
 #endif
 
+#ifdef TINYFORMAT_VARIADIC_ONLY
+#   if !defined(TINYFORMAT_USE_VARIADIC_TEMPLATES) && !defined(TINYFORMAT_NO_VARIADIC_TEMPLATES) && \
+        (__cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1800))
+#       define TINYFORMAT_USE_VARIADIC_TEMPLATES
+#   endif
+#   ifndef TINYFORMAT_USE_VARIADIC_TEMPLATES
+#       error "tinyformat: TINYFORMAT_VARIADIC_ONLY requires variadic templates"
+#   endif
+#endif
+
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+#   include <tuple>
+#endif
+
 #if defined(__GLIBCXX__) && __GLIBCXX__ < 20080201
 //  std::showpos is broken on old libstdc++ as provided with macOS.  See
 //  http://gcc.gnu.org/ml/libstdc++/2007-11/msg00075.html
 #   define TINYFORMAT_OLD_LIBSTDCPLUSPLUS_WORKAROUND
 #endif
 
+#if defined(TINYFORMAT_USE_VARIADIC_TEMPLATES) && \
+    (__cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L))
+// C++14 relaxed constexpr allows the format string parser to run at compile
+// time; see TINYFORMAT_FMT.
+#   define TINYFORMAT_USE_CONSTEXPR_PARSER
+#   define TINYFORMAT_CONSTEXPR14 constexpr
+#else
+#   define TINYFORMAT_CONSTEXPR14
+#endif
+
+#if defined(TINYFORMAT_USE_VARIADIC_TEMPLATES) || defined(_MSC_VER) || \
+    !defined(__STRICT_ANSI__)
+// long long is available (C++11, or as a C++98 extension)
+#   define TINYFORMAT_HAS_LONG_LONG
+#endif
+
+#if defined(TINYFORMAT_HAS_LONG_LONG) && !defined(TINYFORMAT_NO_FLOAT_ENGINE)
+// Format float and double with the built in engine rather than num_put
+// when the stream has the classic locale.
+#   define TINYFORMAT_USE_FLOAT_ENGINE
+#endif
+
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+// char16_t and char32_t strings may be formatted as UTF-8
+#   define TINYFORMAT_HAS_UNICODE_CHARS
+#endif
+
+#if defined(TINYFORMAT_USE_VARIADIC_TEMPLATES) || __cplusplus >= 201103L || \
+    (defined(_MSC_VER) && _MSC_VER >= 1900)
+// Temporary arguments may be moved into a FormatArgStore
+#   define TINYFORMAT_HAS_RVALUE_REFS
+#   include <type_traits>
+#   include <utility>
+#endif
+
+#if !defined(TINYFORMAT_NO_THREAD_LOCAL) && \
+    (__cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900))
+#   define TINYFORMAT_HAS_THREAD_LOCAL
+#endif
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#   define TINYFORMAT_HAS_STRING_VIEW
+#   include <string_view>
+#endif
+
+#if defined(TINYFORMAT_HAS_STRING_VIEW) && defined(__has_include)
+#   if __has_include(<memory_resource>)
+// std::pmr::string is available for format() with a memory_resource.
+#       define TINYFORMAT_HAS_PMR
+#       include <memory_resource>
+#   endif
+#endif
+
+// Define TINYFORMAT_STREAMING_TRUNCATION to stop formatting types with
+// operator<< after the first N characters for "%.Ns", rather than
+// formatting them completely into a temporary string.
+// #define TINYFORMAT_STREAMING_TRUNCATION
+
+// Define TINYFORMAT_UTF8_TRUNCATION to never split a UTF-8 multibyte sequence
+// in "%.Ns" truncation of strings, writing fewer than N bytes instead.
+// #define TINYFORMAT_UTF8_TRUNCATION
+
+// Wide strings (wchar_t, and char16_t and char32_t with C++11) are written as
+// UTF-8.  Define TINYFORMAT_ALLOW_WCHAR_STRINGS to format them with
+// operator<< instead, for example with your own operator for wchar_t*.
+// #define TINYFORMAT_ALLOW_WCHAR_STRINGS
+
+// Define TINYFORMAT_USE_ASYNC_SINK to make tinyformat::AsyncSink available,
+// which formats on a background thread.  This requires C++11 and threads.
+// #define TINYFORMAT_USE_ASYNC_SINK
+
+// Define TINYFORMAT_USE_PARALLEL_BATCH to make format_batch_parallel()
+// available, which splits a batch of rows across threads.  This requires
+// C++11 and threads.
+// #define TINYFORMAT_USE_PARALLEL_BATCH
+
+// Define TINYFORMAT_USE_FD_SINK to make tinyformat::FdSink available, which
+// writes to a POSIX file descriptor.
+// #define TINYFORMAT_USE_FD_SINK
+
+// Define TINYFORMAT_USE_MMAP_SINK to make tinyformat::MmapSink available,
+// which formats into a memory mapped file.  This requires POSIX mmap().
+// #define TINYFORMAT_USE_MMAP_SINK
+
+// Define TINYFORMAT_ATOMIC_PRINTF to make printf() and printfln() format the
+// whole output in memory and pass it to std::cout with a single write, so
+// that the lines of threads printing at the same time aren't interleaved.
+// #define TINYFORMAT_ATOMIC_PRINTF
+
+// Define TINYFORMAT_USE_SHARDED_SINK to make tinyformat::ShardedSink
+// available, which collects the lines formatted by many threads and writes
+// them to a stream in batches.  This requires C++11 and threads.
+// #define TINYFORMAT_USE_SHARDED_SINK
+
+// printf() and fprintf() format into a stream kept by each thread, rather
+// than constructing a std::ostream for every call.  Define
+// TINYFORMAT_NO_THREAD_LOCAL for compilers without thread_local.
+// #define TINYFORMAT_NO_THREAD_LOCAL
+
+#if defined(TINYFORMAT_USE_ASYNC_SINK) || defined(TINYFORMAT_USE_PARALLEL_BATCH) || \
+    defined(TINYFORMAT_USE_SHARDED_SINK)
+#   include <atomic>
+#   include <chrono>
+#   include <condition_variable>
+#   include <exception>
+#   include <memory>
+#   include <mutex>
+#   include <thread>
+#endif
+
+#ifdef TINYFORMAT_USE_FD_SINK
+#   include <cerrno>
+#   include <sys/uio.h>
+#   include <unistd.h>
+#endif
+
+#ifdef TINYFORMAT_USE_MMAP_SINK
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+// Define TINYFORMAT_C_LOCALE to always format numbers, bools and pointers as
+// printf does in the "C" locale, ignoring the stream locale.  The stream's
+// locale and num_put facet are then never consulted, which saves copying the
+// locale for each conversion and keeps output machine readable whatever
+// locale the stream has.  User defined types are still formatted with
+// operator<<.
+// #define TINYFORMAT_C_LOCALE
+
+#ifdef TINYFORMAT_C_LOCALE
+#   include <cstdlib>
+#   include <limits>
+#endif
+
+// Define TINYFORMAT_STATS to count the calls, output size and time spent for
+// each format string, and how often slow paths are taken, with per thread
+// counters.  See format_stats().  This requires C++11 and threads.
+// #define TINYFORMAT_STATS
+
+#ifdef TINYFORMAT_STATS
+#   include <atomic>
+#   include <chrono>
+#   include <mutex>
+#   include <string>
+#   include <vector>
+#   if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#       include <intrin.h>
+#   elif defined(__x86_64__) || defined(__i386__)
+#       include <x86intrin.h>
+#   endif
+#endif
+
+// Define TINYFORMAT_USE_SIMD to scan the literal text of format strings 16
+// or 32 bytes at a time with SSE2, AVX2 or NEON, where the target has them.
+// #define TINYFORMAT_USE_SIMD
+
+#ifdef TINYFORMAT_USE_SIMD
+// The vector scan reads whole aligned blocks, which may extend past the end
+// of the string but never over a page boundary.  This is harmless but is
+// reported by AddressSanitizer, so use the scalar scan there.
+#   if defined(__SANITIZE_ADDRESS__)
+#       define TINYFORMAT_SIMD_DISABLED
+#   elif defined(__has_feature)
+#       if __has_feature(address_sanitizer)
+#           define TINYFORMAT_SIMD_DISABLED
+#       endif
+#   endif
+#   if defined(TINYFORMAT_SIMD_DISABLED)
+#   elif defined(__AVX2__)
+#       define TINYFORMAT_SIMD_AVX2
+#       include <immintrin.h>
+#   elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#       define TINYFORMAT_SIMD_SSE2
+#       include <emmintrin.h>
+#   elif defined(__ARM_NEON) || defined(_M_ARM64)
+#       define TINYFORMAT_SIMD_NEON
+#       include <arm_neon.h>
+#   endif
+#   if defined(_MSC_VER) && (defined(TINYFORMAT_SIMD_AVX2) || \
+        defined(TINYFORMAT_SIMD_SSE2) || defined(TINYFORMAT_SIMD_NEON))
+#       include <intrin.h>
+#   endif
+#endif
+
 #ifdef __APPLE__
 // Workaround macOS linker warning: Xcode uses different default symbol
 // visibilities for static libs vs executables (see issue #25)
@@ -175,8 +414,439 @@ namespace tfm = tinyformat;
 #   define TINYFORMAT_HIDDEN
 #endif
 
+// Functions declared with TINYFORMAT_FUNC are defined at the end of this
+// file, or only in tinyformat.cpp with TINYFORMAT_SEPARATE_COMPILATION.
+#ifdef TINYFORMAT_SEPARATE_COMPILATION
+#   define TINYFORMAT_FUNC
+#else
+#   define TINYFORMAT_FUNC inline
+#endif
+
 namespace tinyformat {
 
+/// Traits for string types which hold their characters contiguously.
+///
+/// The "%.Ns" conversion writes the first N characters of such types
+/// directly, rather than formatting the whole value with operator<< and
+/// truncating the result.  Specialize this for other string types, for
+/// example
+///
+///   template<> struct CharRangeTraits<MyString>
+///   {
+///       static const bool isCharRange = true;
+///       static const char* data(const MyString& s) { return s.c_str(); }
+///       static std::size_t size(const MyString& s) { return s.length(); }
+///   };
+template<typename T>
+struct CharRangeTraits
+{
+    static const bool isCharRange = false;
+};
+
+template<>
+struct CharRangeTraits<std::string>
+{
+    static const bool isCharRange = true;
+    static const char* data(const std::string& s) { return s.data(); }
+    static std::size_t size(const std::string& s) { return s.size(); }
+};
+
+#ifdef TINYFORMAT_HAS_STRING_VIEW
+template<>
+struct CharRangeTraits<std::string_view>
+{
+    static const bool isCharRange = true;
+    static const char* data(std::string_view s) { return s.data(); }
+    static std::size_t size(std::string_view s) { return s.size(); }
+};
+#endif
+
+
+#ifdef TINYFORMAT_STATS
+//------------------------------------------------------------------------------
+// Formatting statistics, collected per thread.
+
+/// Statistics for one format string, identified by its address and text.  For a
+/// CompiledFormat this is the address of the copy it holds.
+struct FormatSiteStats
+{
+    std::string format;     // Up to the first 63 characters of the format
+    const void* key;        // Address of the format string
+    unsigned long long calls;
+    unsigned long long bytes;   // Characters of output produced
+    unsigned long long ticks;   // Time formatting; see format_stats()
+};
+
+/// Statistics for all threads, as returned by format_stats().
+struct FormatStats
+{
+    std::vector<FormatSiteStats> sites;     // By decreasing ticks
+    unsigned long long spacePadded;         // " " flag formatted via a copy
+    unsigned long long truncationCopies;    // "%.Ns" formatted via a copy
+    unsigned long long errors;              // Calls of TINYFORMAT_ERROR
+};
+
+namespace detail {
+
+// Counter written only by the thread owning it, so the increment needn't be
+// an atomic read-modify-write; relaxed atomics let other threads read it.
+class StatsCounter
+{
+    public:
+        StatsCounter() : m_value(0) {}
+
+        void add(unsigned long long n)
+        {
+            m_value.store(m_value.load(std::memory_order_relaxed) + n,
+                          std::memory_order_relaxed);
+        }
+
+        unsigned long long get() const { return m_value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<unsigned long long> m_value;
+};
+
+struct StatsSite
+{
+    StatsSite() : key(NULL) { text[0] = '\0'; }
+
+    std::atomic<const char*> key;
+    char text[64];
+    StatsCounter calls;
+    StatsCounter bytes;
+    StatsCounter ticks;
+};
+
+// Statistics table for one thread.  Format strings are found by open
+// addressing on their address, checking the text too since a temporary
+// format string's address may be reused for another; those which don't fit
+// are counted together in the `other` site.
+class ThreadStats
+{
+    public:
+        enum { numSites = 1024, maxProbes = 32 };
+
+        StatsSite& site(const char* fmt)
+        {
+            std::size_t h = (reinterpret_cast<std::size_t>(fmt) >> 3) * 2654435761u;
+            for (int i = 0; i < maxProbes; ++i, ++h) {
+                StatsSite& s = m_sites[h % numSites];
+                const char* key = s.key.load(std::memory_order_relaxed);
+                if (key == fmt && std::strncmp(s.text, fmt, sizeof(s.text) - 1) == 0)
+                    return s;
+                if (key == NULL) {
+                    // Copy the text before publishing the key, as the
+                    // format string may not outlive the statistics.
+                    std::size_t n = 0;
+                    for (; n + 1 < sizeof(s.text) && fmt[n] != '\0'; ++n)
+                        s.text[n] = fmt[n];
+                    s.text[n] = '\0';
+                    s.key.store(fmt, std::memory_order_release);
+                    return s;
+                }
+            }
+            return m_other;
+        }
+
+        StatsCounter spacePadded;
+        StatsCounter truncationCopies;
+        StatsCounter errors;
+
+    private:
+        friend class StatsRegistry;
+
+        StatsSite m_sites[numSites];
+        StatsSite m_other;
+};
+
+// All threads' statistics.  Threads register their table on first use, and
+// on exit fold it into the totals kept here.
+class StatsRegistry
+{
+    public:
+        static StatsRegistry& instance()
+        {
+            static StatsRegistry registry;
+            return registry;
+        }
+
+        void add(ThreadStats* stats)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_threads.push_back(stats);
+        }
+
+        void retire(ThreadStats* stats)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            collect(m_retired, *stats);
+            m_threads.erase(std::find(m_threads.begin(), m_threads.end(), stats));
+        }
+
+        FormatStats snapshot()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            FormatStats result = m_retired;
+            for (std::size_t i = 0; i < m_threads.size(); ++i)
+                collect(result, *m_threads[i]);
+            std::sort(result.sites.begin(), result.sites.end(), byTicks);
+            return result;
+        }
+
+    private:
+        StatsRegistry()
+        {
+            m_retired.spacePadded = m_retired.truncationCopies = m_retired.errors = 0;
+        }
+
+        static bool byTicks(const FormatSiteStats& a, const FormatSiteStats& b)
+        {
+            return a.ticks > b.ticks;
+        }
+
+        static void collectSite(FormatStats& result, const StatsSite& s,
+                                const char* key, const char* text)
+        {
+            FormatSiteStats* site = NULL;
+            for (std::size_t i = 0; i < result.sites.size() && !site; ++i) {
+                if (result.sites[i].key == key && result.sites[i].format == text)
+                    site = &result.sites[i];
+            }
+            if (!site) {
+                FormatSiteStats newSite = { text, key, 0, 0, 0 };
+                result.sites.push_back(newSite);
+                site = &result.sites.back();
+            }
+            site->calls += s.calls.get();
+            site->bytes += s.bytes.get();
+            site->ticks += s.ticks.get();
+        }
+
+        static void collect(FormatStats& result, const ThreadStats& stats)
+        {
+            for (int i = 0; i < ThreadStats::numSites; ++i) {
+                const StatsSite& s = stats.m_sites[i];
+                if (const char* key = s.key.load(std::memory_order_acquire))
+                    collectSite(result, s, key, s.text);
+            }
+            if (stats.m_other.calls.get() != 0)
+                collectSite(result, stats.m_other, NULL, "(other)");
+            result.spacePadded += stats.spacePadded.get();
+            result.truncationCopies += stats.truncationCopies.get();
+            result.errors += stats.errors.get();
+        }
+
+        std::mutex m_mutex;
+        std::vector<ThreadStats*> m_threads;
+        FormatStats m_retired;
+};
+
+class ThreadStatsHandle
+{
+    public:
+        ThreadStatsHandle() : m_stats(new ThreadStats()) { StatsRegistry::instance().add(m_stats); }
+        ~ThreadStatsHandle()
+        {
+            StatsRegistry::instance().retire(m_stats);
+            delete m_stats;
+        }
+
+        ThreadStats& stats() { return *m_stats; }
+
+    private:
+        ThreadStatsHandle(const ThreadStatsHandle&);
+        ThreadStatsHandle& operator=(const ThreadStatsHandle&);
+
+        ThreadStats* m_stats;
+};
+
+inline ThreadStats& threadStats()
+{
+    static thread_local ThreadStatsHandle handle;
+    return handle.stats();
+}
+
+inline unsigned long long statsTicks()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline void statsCountError()
+{
+    threadStats().errors.add(1);
+}
+
+// Stream buffer which counts characters on their way to another buffer.
+class CountingStreambuf : public std::streambuf
+{
+    public:
+        explicit CountingStreambuf(std::streambuf* dest)
+            : m_dest(dest),
+            m_count(0),
+            m_failed(false)
+        {
+            setp(m_buf, m_buf + sizeof(m_buf));
+        }
+
+        /// Pass on any buffered output, returning the number of characters
+        /// written, or -1 if the destination failed.
+        long long finish()
+        {
+            flushBuffer();
+            return m_failed ? -1 : m_count;
+        }
+
+    protected:
+        virtual int_type overflow(int_type c)
+        {
+            if (!flushBuffer())
+                return traits_type::eof();
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize n)
+        {
+            if (n <= epptr() - pptr()) {
+                traits_type::copy(pptr(), s, static_cast<std::size_t>(n));
+                pbump(static_cast<int>(n));
+                return n;
+            }
+            if (!flushBuffer())
+                return 0;
+            const std::streamsize written = m_dest->sputn(s, n);
+            m_count += written;
+            m_failed = m_failed || written != n;
+            return written;
+        }
+
+        virtual int sync()
+        {
+            return flushBuffer() ? m_dest->pubsync() : -1;
+        }
+
+    private:
+        bool flushBuffer()
+        {
+            const std::streamsize n = pptr() - pbase();
+            const std::streamsize written = n > 0 ? m_dest->sputn(pbase(), n) : 0;
+            m_count += written;
+            m_failed = m_failed || written != n;
+            setp(m_buf, m_buf + sizeof(m_buf));
+            return !m_failed;
+        }
+
+        std::streambuf* m_dest;
+        long long m_count;
+        bool m_failed;
+        char m_buf[128];
+};
+
+// Records the calls, ticks and bytes produced for one format string while
+// in scope.  The characters are counted by routing the stream through a
+// CountingStreambuf, except for streams which are already in a failed state
+// or have exceptions enabled, for which the bytes aren't known.
+class StatsScope
+{
+    public:
+        StatsScope(std::ostream& out, const char* fmt)
+            : m_out(out),
+            m_site(threadStats().site(fmt)),
+            m_dest(out.rdbuf()),
+            m_counter(m_dest),
+            m_counting(out.good() && out.exceptions() == std::ios::goodbit && m_dest),
+            m_start(statsTicks())
+        {
+            if (m_counting)
+                m_out.rdbuf(&m_counter);
+        }
+
+        ~StatsScope()
+        {
+            if (m_counting) {
+                const long long n = m_counter.finish();
+                std::ios::iostate state = m_out.rdstate();
+                if (n < 0)
+                    state |= std::ios::badbit;
+                else
+                    m_site.bytes.add(static_cast<unsigned long long>(n));
+                m_out.rdbuf(m_dest);
+                m_out.clear(state);
+            }
+            m_site.calls.add(1);
+            m_site.ticks.add(statsTicks() - m_start);
+        }
+
+    private:
+        StatsScope(const StatsScope&);
+        StatsScope& operator=(const StatsScope&);
+
+        std::ostream& m_out;
+        StatsSite& m_site;
+        std::streambuf* m_dest;
+        CountingStreambuf m_counter;
+        bool m_counting;
+        unsigned long long m_start;
+};
+
+} // namespace detail
+
+/// Return the formatting statistics collected so far, over all threads.
+///
+/// Each call of the formatting functions is counted against the address of
+/// its format string, with the time spent and number of characters produced.
+/// Time is measured in CPU timestamp counter ticks on x86, and otherwise in
+/// nanoseconds.  Characters aren't counted for streams with exceptions
+/// enabled.  Counters of threads still running are read without stopping
+/// them, so may be slightly out of date.
+inline FormatStats format_stats()
+{
+    return detail::StatsRegistry::instance().snapshot();
+}
+
+/// Write a table of the statistics from format_stats() to out.
+inline void dump_format_stats(std::ostream& out)
+{
+    const FormatStats stats = format_stats();
+    char line[128];
+    std::snprintf(line, sizeof(line), "%12s %14s %16s %12s  %s\n",
+                  "calls", "bytes", "ticks", "ticks/call", "format");
+    out << line;
+    for (std::size_t i = 0; i < stats.sites.size(); ++i) {
+        const FormatSiteStats& s = stats.sites[i];
+        std::snprintf(line, sizeof(line), "%12llu %14llu %16llu %12llu  ",
+                      s.calls, s.bytes, s.ticks, s.calls ? s.ticks/s.calls : 0);
+        out << line;
+        // Escape control characters to keep one site per line
+        for (std::size_t j = 0; j < s.format.size(); ++j) {
+            const char c = s.format[j];
+            if (c == '\n')
+                out << "\\n";
+            else if (c == '\t')
+                out << "\\t";
+            else if (static_cast<unsigned char>(c) < ' ')
+                out << '?';
+            else
+                out << c;
+        }
+        out << '\n';
+    }
+    out << "space padded conversions: " << stats.spacePadded << '\n'
+        << "truncation copies: " << stats.truncationCopies << '\n'
+        << "errors: " << stats.errors << '\n';
+}
+#endif // TINYFORMAT_STATS
+
+
 //------------------------------------------------------------------------------
 namespace detail {
 
@@ -211,14 +881,6 @@ struct is_convertible
 };
 
 
-// Detect when a type is not a wchar_t string
-template<typename T> struct is_wchar { typedef int tinyformat_wchar_is_not_supported; };
-template<> struct is_wchar<wchar_t*> {};
-template<> struct is_wchar<const wchar_t*> {};
-template<int n> struct is_wchar<const wchar_t[n]> {};
-template<int n> struct is_wchar<wchar_t[n]> {};
-
-
 // Format the value by casting to type fmtT.  This default implementation
 // should never be called.
 template<typename T, typename fmtT, bool convertible = is_convertible<T, fmtT>::value>
@@ -262,7 +924,7 @@ struct convertToInt
 {
     static int invoke(const T& /*value*/)
     {
-        TINYFORMAT_ERROR("tinyformat: Cannot convert from argument type to "
+        TINYFORMAT_RAISE_ERROR("tinyformat: Cannot convert from argument type to "
                          "integer for use as variable width or precision");
         return 0;
     }
@@ -274,577 +936,6156 @@ struct convertToInt<T,true>
     static int invoke(const T& value) { return static_cast<int>(value); }
 };
 
-// Format at most ntrunc characters to the given stream.
-template<typename T>
-inline void formatTruncated(std::ostream& out, const T& value, int ntrunc)
+// Write n copies of the fill character c to the stream buffer.
+inline bool writeFill(std::streambuf* buf, char c, std::streamsize n)
 {
-    std::ostringstream tmp;
-    tmp << value;
-    std::string result = tmp.str();
-    out.write(result.c_str(), (std::min)(ntrunc, static_cast<int>(result.size())));
-}
-#define TINYFORMAT_DEFINE_FORMAT_TRUNCATED_CSTR(type)       \
-inline void formatTruncated(std::ostream& out, type* value, int ntrunc) \
-{                                                           \
-    std::streamsize len = 0;                                \
-    while (len < ntrunc && value[len] != 0)                 \
-        ++len;                                              \
-    out.write(value, len);                                  \
+    char fill[32];
+    std::fill(fill, fill + sizeof(fill), c);
+    for (; n > 0; n -= static_cast<std::streamsize>(sizeof(fill))) {
+        std::streamsize k = (std::min)(n, static_cast<std::streamsize>(sizeof(fill)));
+        if (buf->sputn(fill, k) != k)
+            return false;
+    }
+    return true;
 }
-// Overload for const char* and char*.  Could overload for signed & unsigned
-// char too, but these are technically unneeded for printf compatibility.
-TINYFORMAT_DEFINE_FORMAT_TRUNCATED_CSTR(const char)
-TINYFORMAT_DEFINE_FORMAT_TRUNCATED_CSTR(char)
-#undef TINYFORMAT_DEFINE_FORMAT_TRUNCATED_CSTR
-
-} // namespace detail
 
+// Write the n characters at s to the stream, padded according to the stream
+// width, fill and adjustment in the same way as operator<<.  For internal
+// adjustment the padding goes after the first prefixLen characters (a sign
+// or "0x" for numbers), otherwise before the text.  This is the basic
+// primitive used to write directly to the stream buffer.
+inline void writePadded(std::ostream& out, const char* s, std::streamsize n,
+                        std::streamsize prefixLen = 0)
+{
+    std::ostream::sentry ok(out);
+    if (ok) {
+        std::streamsize npad = out.width() > n ? out.width() - n : 0;
+        std::ios::fmtflags adjust = out.flags() & std::ios::adjustfield;
+        std::streambuf* buf = out.rdbuf();
+        bool good = true;
+        if (npad == 0)
+            good = buf->sputn(s, n) == n;
+        else if (adjust == std::ios::left)
+            good = buf->sputn(s, n) == n && writeFill(buf, out.fill(), npad);
+        else {
+            if (adjust != std::ios::internal)
+                prefixLen = 0;
+            good = buf->sputn(s, prefixLen) == prefixLen &&
+                   writeFill(buf, out.fill(), npad) &&
+                   buf->sputn(s + prefixLen, n - prefixLen) == n - prefixLen;
+        }
+        if (!good)
+            out.setstate(std::ios::badbit);
+    }
+    out.width(0);
+}
 
-//------------------------------------------------------------------------------
-// Variable formatting functions.  May be overridden for user-defined types if
-// desired.
+// Write C string or std::string directly to the stream buffer, bypassing the
+// more general operator<<.
+inline void writeString(std::ostream& out, const char* s)
+{
+    if (!s) {
+        // As for operator<<(const char*)
+        out.setstate(std::ios::badbit);
+        return;
+    }
+    const char* e = s;
+    while (*e)
+        ++e;
+    writePadded(out, s, e - s);
+}
 
+inline void writeString(std::ostream& out, const std::string& s)
+{
+    writePadded(out, s.data(), static_cast<std::streamsize>(s.size()));
+}
 
-/// Format a value into a stream, delegating to operator<< by default.
-///
-/// Users may override this for their own types.  When this function is called,
-/// the stream flags will have been modified according to the format string.
-/// The format specification is provided in the range [fmtBegin, fmtEnd).  For
-/// truncating conversions, ntrunc is set to the desired maximum number of
-/// characters, for example "%.7s" calls formatValue with ntrunc = 7.
-///
-/// By default, formatValue() uses the usual stream insertion operator
-/// operator<< to format the type T, with special cases for the %c and %p
-/// conversions.
+#ifdef TINYFORMAT_UTF8_TRUNCATION
+// Return n, reduced if necessary so that the first n bytes of the UTF-8
+// string s don't end with part of a multibyte sequence.  s[n] must be
+// readable.  Bytes which aren't valid UTF-8 are counted individually.
+inline std::size_t utf8Truncate(const char* s, std::size_t n)
+{
+    if ((static_cast<unsigned char>(s[n]) & 0xc0) != 0x80)
+        return n;
+    for (std::size_t i = 1; i <= 3 && i <= n; ++i) {
+        const unsigned char c = static_cast<unsigned char>(s[n - i]);
+        if ((c & 0xc0) != 0x80) {
+            const std::size_t len = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+            return len > i ? n - i : n;
+        }
+    }
+    return n;
+}
+#endif
+
+// Wide strings
+//
+// wchar_t strings, which hold UTF-16 or UTF-32 depending on the size of
+// wchar_t, and the char16_t and char32_t strings of C++11 are transcoded to
+// UTF-8 as they are written to the stream.  Unpaired surrogates and values
+// outside the Unicode range are written as U+FFFD.
+
+
+// Decode the code point starting at s[i], advancing i past it
+template<typename CharT>
+inline unsigned long decodeCodePoint(const CharT* s, std::size_t n, std::size_t& i)
+{
+    if (sizeof(CharT) == 2) {
+        const unsigned long c = static_cast<unsigned long>(s[i++]) & 0xffff;
+        if (c < 0xd800 || c >= 0xe000)
+            return c;
+        if (c < 0xdc00 && i < n) {
+            const unsigned long c2 = static_cast<unsigned long>(s[i]) & 0xffff;
+            if (c2 >= 0xdc00 && c2 < 0xe000) {
+                ++i;
+                return 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+            }
+        }
+        return 0xfffd;
+    }
+    const unsigned long c = static_cast<unsigned long>(s[i++]) & 0xffffffffUL;
+    return (c >= 0xd800 && c < 0xe000) || c > 0x10ffff ? 0xfffd : c;
+}
+
+inline std::size_t utf8Length(unsigned long c)
+{
+    return c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+}
+
+inline char* encodeUtf8(char* p, unsigned long c)
+{
+    if (c < 0x80)
+        *p++ = static_cast<char>(c);
+    else if (c < 0x800) {
+        *p++ = static_cast<char>(0xc0 | (c >> 6));
+        *p++ = static_cast<char>(0x80 | (c & 0x3f));
+    }
+    else if (c < 0x10000) {
+        *p++ = static_cast<char>(0xe0 | (c >> 12));
+        *p++ = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        *p++ = static_cast<char>(0x80 | (c & 0x3f));
+    }
+    else {
+        *p++ = static_cast<char>(0xf0 | (c >> 18));
+        *p++ = static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+        *p++ = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        *p++ = static_cast<char>(0x80 | (c & 0x3f));
+    }
+    return p;
+}
+
+// Copy the leading ASCII code units of s[0, n) to p, 16 at a time; returns
+// the number copied.
+#if defined(TINYFORMAT_SIMD_AVX2) || defined(TINYFORMAT_SIMD_SSE2)
+#   define TINYFORMAT_SIMD_ASCII
+template<typename CharT>
+inline std::size_t copyAsciiBlocks(char* p, const CharT* s, std::size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i* v = reinterpret_cast<const __m128i*>(s + i);
+        __m128i bytes;
+        if (sizeof(CharT) == 2) {
+            const __m128i a = _mm_loadu_si128(v);
+            const __m128i b = _mm_loadu_si128(v + 1);
+            const __m128i high = _mm_and_si128(_mm_or_si128(a, b),
+                                               _mm_set1_epi16(static_cast<short>(0xff80)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xffff)
+                break;
+            bytes = _mm_packus_epi16(a, b);
+        }
+        else {
+            const __m128i a = _mm_loadu_si128(v);
+            const __m128i b = _mm_loadu_si128(v + 1);
+            const __m128i c = _mm_loadu_si128(v + 2);
+            const __m128i d = _mm_loadu_si128(v + 3);
+            const __m128i high = _mm_and_si128(
+                _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)),
+                _mm_set1_epi32(static_cast<int>(0xffffff80)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, zero)) != 0xffff)
+                break;
+            bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), bytes);
+    }
+    return i;
+}
+#elif defined(TINYFORMAT_SIMD_NEON)
+#   define TINYFORMAT_SIMD_ASCII
+template<typename CharT>
+inline std::size_t copyAsciiBlocks(char* p, const CharT* s, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t bytes;
+        if (sizeof(CharT) == 2) {
+            const uint16_t* v = reinterpret_cast<const uint16_t*>(s + i);
+            const uint16x8_t a = vld1q_u16(v);
+            const uint16x8_t b = vld1q_u16(v + 8);
+            // Saturating narrowing keeps any high bits nonzero
+            const uint8x8_t high = vqmovn_u16(vshrq_n_u16(vorrq_u16(a, b), 7));
+            if (vget_lane_u64(vreinterpret_u64_u8(high), 0) != 0)
+                break;
+            bytes = vcombine_u8(vmovn_u16(a), vmovn_u16(b));
+        }
+        else {
+            const uint32_t* v = reinterpret_cast<const uint32_t*>(s + i);
+            const uint32x4_t a = vld1q_u32(v);
+            const uint32x4_t b = vld1q_u32(v + 4);
+            const uint32x4_t c = vld1q_u32(v + 8);
+            const uint32x4_t d = vld1q_u32(v + 12);
+            const uint16x4_t high = vqmovn_u32(vshrq_n_u32(
+                vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d)), 7));
+            if (vget_lane_u64(vreinterpret_u64_u16(high), 0) != 0)
+                break;
+            bytes = vcombine_u8(vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b))),
+                                vmovn_u16(vcombine_u16(vmovn_u32(c), vmovn_u32(d))));
+        }
+        vst1q_u8(reinterpret_cast<unsigned char*>(p + i), bytes);
+    }
+    return i;
+}
+#endif
+
+// Write the code units s[0, n) to the stream as UTF-8, padded according to
+// the stream width, fill and adjustment.  For truncating conversions at most
+// ntrunc bytes of whole code points are written.
+template<typename CharT>
+inline void writeWideString(std::ostream& out, const CharT* s, std::size_t n, int ntrunc)
+{
+    std::ostream::sentry ok(out);
+    if (!ok) {
+        out.width(0);
+        return;
+    }
+    std::streamsize npad = 0;
+    if (out.width() > 0 || ntrunc >= 0) {
+        // Find the output length, and the code units which fit
+        std::size_t len = 0;
+        std::size_t i = 0;
+        while (i < n) {
+            std::size_t next = i;
+            const std::size_t k = utf8Length(decodeCodePoint(s, n, next));
+            if (ntrunc >= 0 && len + k > static_cast<std::size_t>(ntrunc))
+                break;
+            len += k;
+            i = next;
+        }
+        n = i;
+        if (out.width() > static_cast<std::streamsize>(len))
+            npad = out.width() - static_cast<std::streamsize>(len);
+    }
+    std::streambuf* buf = out.rdbuf();
+    const bool left = (out.flags() & std::ios::adjustfield) == std::ios::left;
+    bool good = left || writeFill(buf, out.fill(), npad);
+    char utf8[256];
+    for (std::size_t i = 0; good && i < n;) {
+        char* p = utf8;
+        // Leave room for a block of ASCII, or at least one code point
+        char* const end = utf8 + sizeof(utf8) - 16;
+        while (i < n && p <= end) {
+#ifdef TINYFORMAT_SIMD_ASCII
+            if (static_cast<unsigned long>(s[i]) < 0x80) {
+                const std::size_t k = copyAsciiBlocks(p, s + i, (std::min)(
+                    n - i, static_cast<std::size_t>(end - p) + 16));
+                p += k;
+                i += k;
+                if (k > 0)
+                    continue;
+            }
+#endif
+            p = encodeUtf8(p, decodeCodePoint(s, n, i));
+        }
+        good = buf->sputn(utf8, p - utf8) == p - utf8;
+    }
+    if (good && left)
+        good = writeFill(buf, out.fill(), npad);
+    if (!good)
+        out.setstate(std::ios::badbit);
+    out.width(0);
+}
+
+// Detect wide C strings and arrays, which may not be null terminated
 template<typename T>
-inline void formatValue(std::ostream& out, const char* /*fmtBegin*/,
-                        const char* fmtEnd, int ntrunc, const T& value)
+struct WideCStringTraits
 {
-#ifndef TINYFORMAT_ALLOW_WCHAR_STRINGS
-    // Since we don't support printing of wchar_t using "%ls", make it fail at
-    // compile time in preference to printing as a void* at runtime.
-    typedef typename detail::is_wchar<T>::tinyformat_wchar_is_not_supported DummyType;
-    (void) DummyType(); // avoid unused type warning with gcc-4.8
+    static const bool isWideCString = false;
+};
+
+template<typename CharT, std::size_t maxLen = static_cast<std::size_t>(-1)>
+struct WideCStringTraitsImpl
+{
+    static const bool isWideCString = true;
+    typedef CharT charType;
+    static std::size_t length(const CharT* s)
+    {
+        std::size_t len = 0;
+        while (len < maxLen && s[len] != 0)
+            ++len;
+        return len;
+    }
+};
+
+#define TINYFORMAT_DEFINE_WIDE_CSTRING_TRAITS(charType)                     \
+template<> struct WideCStringTraits<charType*>                            \
+    : WideCStringTraitsImpl<charType> {};                                 \
+template<> struct WideCStringTraits<const charType*>                      \
+    : WideCStringTraitsImpl<charType> {};                                 \
+template<std::size_t n> struct WideCStringTraits<charType[n]>             \
+    : WideCStringTraitsImpl<charType, n> {};                              \
+template<std::size_t n> struct WideCStringTraits<const charType[n]>       \
+    : WideCStringTraitsImpl<charType, n> {};
+TINYFORMAT_DEFINE_WIDE_CSTRING_TRAITS(wchar_t)
+#ifdef TINYFORMAT_HAS_UNICODE_CHARS
+TINYFORMAT_DEFINE_WIDE_CSTRING_TRAITS(char16_t)
+TINYFORMAT_DEFINE_WIDE_CSTRING_TRAITS(char32_t)
 #endif
-    // The mess here is to support the %c and %p conversions: if these
-    // conversions are active we try to convert the type to a char or const
-    // void* respectively and format that instead of the value itself.  For the
-    // %p conversion it's important to avoid dereferencing the pointer, which
-    // could otherwise lead to a crash when printing a dangling (const char*).
-    const bool canConvertToChar = detail::is_convertible<T,char>::value;
-    const bool canConvertToVoidPtr = detail::is_convertible<T, const void*>::value;
-    if (canConvertToChar && *(fmtEnd-1) == 'c')
-        detail::formatValueAsType<T, char>::invoke(out, value);
-    else if (canConvertToVoidPtr && *(fmtEnd-1) == 'p')
-        detail::formatValueAsType<T, const void*>::invoke(out, value);
-#ifdef TINYFORMAT_OLD_LIBSTDCPLUSPLUS_WORKAROUND
-    else if (detail::formatZeroIntegerWorkaround<T>::invoke(out, value)) /**/;
+#undef TINYFORMAT_DEFINE_WIDE_CSTRING_TRAITS
+
+// Write a wide C string.  The version with isWideCString=false is never
+// called.
+template<typename T, bool isWideCString = WideCStringTraits<T>::isWideCString>
+struct formatWideCString
+{
+    static void invoke(std::ostream& /*out*/, const T& /*value*/, int /*ntrunc*/)
+        { TINYFORMAT_ASSERT(0); }
+};
+
+template<typename T>
+struct formatWideCString<T, true>
+{
+    static void invoke(std::ostream& out, const T& value, int ntrunc)
+    {
+        typedef WideCStringTraits<T> Traits;
+        const typename Traits::charType* s = value;
+        if (!s) {
+            // As for operator<<(const char*)
+            out.setstate(std::ios::badbit);
+            return;
+        }
+        writeWideString(out, s, Traits::length(s), ntrunc);
+    }
+};
+
+// Return true if numbers are formatted by the stream as in the "C" locale,
+// allowing the num_put facet to be bypassed with the writers below.  With
+// TINYFORMAT_C_LOCALE the stream locale is ignored.
+#ifdef TINYFORMAT_C_LOCALE
+inline bool hasClassicLocale(const std::ios_base& /*out*/)
+{
+    return true;
+}
+#else
+inline bool hasClassicLocale(const std::ios_base& out)
+{
+    return out.getloc() == std::locale::classic();
+}
 #endif
-    else if (ntrunc >= 0) {
-        // Take care not to overread C strings in truncating conversions like
-        // "%.4s" where at most 4 characters may be read.
-        detail::formatTruncated(out, value, ntrunc);
+
+// Pairs of decimal digits "00" to "99", so integers can be converted two
+// digits per division.
+inline const char* decimalDigitPairs()
+{
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    return pairs;
+}
+
+// Convert u to digits in the given base, writing backward from `end`.
+// Returns a pointer to the first digit.
+template<typename UIntT>
+inline char* formatDecimal(char* end, UIntT u)
+{
+    const char* pairs = decimalDigitPairs();
+    while (u >= 100) {
+        const char* d = pairs + 2*static_cast<unsigned>(u % 100);
+        u /= 100;
+        *--end = d[1];
+        *--end = d[0];
     }
-    else
-        out << value;
+    if (u >= 10) {
+        const char* d = pairs + 2*static_cast<unsigned>(u);
+        *--end = d[1];
+        *--end = d[0];
+    }
+    else {
+        *--end = static_cast<char>('0' + u);
+    }
+    return end;
 }
 
+template<typename UIntT>
+inline char* formatHex(char* end, UIntT u, bool upper)
+{
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    do {
+        *--end = digits[u & 0xf];
+        u >>= 4;
+    } while (u != 0);
+    return end;
+}
 
-// Overloaded version for char types to support printing as an integer
-#define TINYFORMAT_DEFINE_FORMATVALUE_CHAR(charType)                  \
-inline void formatValue(std::ostream& out, const char* /*fmtBegin*/,  \
-                        const char* fmtEnd, int /**/, charType value) \
-{                                                                     \
-    switch (*(fmtEnd-1)) {                                            \
-        case 'u': case 'd': case 'i': case 'o': case 'X': case 'x':   \
-            out << static_cast<int>(value); break;                    \
-        default:                                                      \
-            out << value;                   break;                    \
-    }                                                                 \
+template<typename UIntT>
+inline char* formatOctal(char* end, UIntT u)
+{
+    do {
+        *--end = static_cast<char>('0' + (u & 0x7));
+        u >>= 3;
+    } while (u != 0);
+    return end;
 }
-// per 3.9.1: char, signed char and unsigned char are all distinct types
-TINYFORMAT_DEFINE_FORMATVALUE_CHAR(char)
-TINYFORMAT_DEFINE_FORMATVALUE_CHAR(signed char)
-TINYFORMAT_DEFINE_FORMATVALUE_CHAR(unsigned char)
-#undef TINYFORMAT_DEFINE_FORMATVALUE_CHAR
 
+// Write an integer to the stream according to the stream flags, width and
+// fill.  u holds the value, or the magnitude of a negative decimal value.
+// The output is identical to the num_put facet in the "C" locale: showpos
+// only affects signed values, and oct or hex show the bits of the value.
+template<typename UIntT>
+inline void writeInteger(std::ostream& out, UIntT u, bool isSigned, bool negative)
+{
+    const std::ios::fmtflags flags = out.flags();
+    const std::ios::fmtflags base = flags & std::ios::basefield;
+    // Enough for octal digits plus sign or base prefix
+    char buf[3*sizeof(UIntT) + 4];
+    char* end = buf + sizeof(buf);
+    char* begin = end;
+    std::streamsize prefixLen = 0;
+    if (base == std::ios::oct) {
+        begin = formatOctal(end, u);
+        if ((flags & std::ios::showbase) && u != 0)
+            *--begin = '0';
+    }
+    else if (base == std::ios::hex) {
+        const bool upper = (flags & std::ios::uppercase) != 0;
+        begin = formatHex(end, u, upper);
+        if ((flags & std::ios::showbase) && u != 0) {
+            *--begin = upper ? 'X' : 'x';
+            *--begin = '0';
+            prefixLen = 2;
+        }
+    }
+    else {
+        begin = formatDecimal(end, u);
+        if (negative) {
+            *--begin = '-';
+            prefixLen = 1;
+        }
+        else if (isSigned && (flags & std::ios::showpos)) {
+            *--begin = '+';
+            prefixLen = 1;
+        }
+    }
+    writePadded(out, begin, end - begin, prefixLen);
+}
 
-//------------------------------------------------------------------------------
-// Tools for emulating variadic templates in C++98.  The basic idea here is
-// stolen from the boost preprocessor metaprogramming library and cut down to
-// be just general enough for what we need.
+// Integer writers for each built in integer type, falling back to the
+// stream if it has a non-classic locale which might alter the output.  The
+// magnitude of a negative value is cast back to utype, since for short the
+// subtraction is done in int.
+#define TINYFORMAT_DEFINE_WRITE_INTEGER(type)                           \
+inline void writeInteger(std::ostream& out, type value)                 \
+{                                                                       \
+    typedef unsigned type utype;                                        \
+    const std::ios::fmtflags base = out.flags() & std::ios::basefield;  \
+    if (!hasClassicLocale(out))                                         \
+        out << value;                                                   \
+    else if (base == std::ios::oct || base == std::ios::hex)            \
+        writeInteger(out, static_cast<utype>(value), true, false);      \
+    else if (value < 0)                                                 \
+        writeInteger(out, static_cast<utype>(utype(0) -                 \
+                                             static_cast<utype>(value)),\
+                     true, true);                                       \
+    else                                                                \
+        writeInteger(out, static_cast<utype>(value), true, false);      \
+}                                                                       \
+inline void writeInteger(std::ostream& out, unsigned type value)        \
+{                                                                       \
+    if (!hasClassicLocale(out))                                         \
+        out << value;                                                   \
+    else                                                                \
+        writeInteger(out, value, false, false);                         \
+}
+TINYFORMAT_DEFINE_WRITE_INTEGER(short)
+TINYFORMAT_DEFINE_WRITE_INTEGER(int)
+TINYFORMAT_DEFINE_WRITE_INTEGER(long)
+#ifdef TINYFORMAT_HAS_LONG_LONG
+TINYFORMAT_DEFINE_WRITE_INTEGER(long long)
+#endif
+#undef TINYFORMAT_DEFINE_WRITE_INTEGER
 
-#define TINYFORMAT_ARGTYPES(n) TINYFORMAT_ARGTYPES_ ## n
-#define TINYFORMAT_VARARGS(n) TINYFORMAT_VARARGS_ ## n
-#define TINYFORMAT_PASSARGS(n) TINYFORMAT_PASSARGS_ ## n
-#define TINYFORMAT_PASSARGS_TAIL(n) TINYFORMAT_PASSARGS_TAIL_ ## n
+// Write bool as an integer, or as "true" or "false" with boolalpha
+inline void writeBool(std::ostream& out, bool value)
+{
+    if (!hasClassicLocale(out))
+        out << value;
+    else if (out.flags() & std::ios::boolalpha) {
+        if (value)
+            writePadded(out, "true", 4);
+        else
+            writePadded(out, "false", 5);
+    }
+    else
+        writeInteger(out, static_cast<long>(value));
+}
 
-// To keep it as transparent as possible, the macros below have been generated
-// using python via the excellent cog code generation script.  This avoids
-// the need for a bunch of complex (but more general) preprocessor tricks as
-// used in boost.preprocessor.
-//
-// To rerun the code generation in place, use `cog -r tinyformat.h`
-// (see http://nedbatchelder.com/code/cog).  Alternatively you can just create
-// extra versions by hand.
+#ifdef TINYFORMAT_C_LOCALE
+// Write a pointer in hex with a "0x" prefix, as num_put does in libstdc++
+inline void writePointer(std::ostream& out, const void* value)
+{
+    const std::ios::fmtflags flags = out.flags();
+    out.flags((flags & ~(std::ios::basefield | std::ios::uppercase)) |
+              std::ios::hex | std::ios::showbase);
+    writeInteger(out, reinterpret_cast<std::size_t>(value));
+    out.flags(flags);
+}
 
-/*[[[cog
-maxParams = 16
+// Write a floating point value with the C library's sprintf, according to the
+// float field, precision, showpos, showpoint and uppercase flags of the
+// stream.  length is the printf length modifier for T.  sprintf takes the
+// decimal point from the LC_NUMERIC locale, which is "C" unless the program
+// calls setlocale(), so any other radix character is replaced with '.'.
+template<typename T>
+inline void writeFloatPrintf(std::ostream& out, T value, const char* length)
+{
+    const std::ios::fmtflags flags = out.flags();
+    const std::ios::fmtflags field = flags & std::ios::floatfield;
+    const bool upper = (flags & std::ios::uppercase) != 0;
+    const bool hexFloat = field == (std::ios::fixed | std::ios::scientific);
+    const int precision = out.precision() < 0 ? 6 : static_cast<int>(out.precision());
+    char spec[16];
+    char* s = spec;
+    *s++ = '%';
+    if (flags & std::ios::showpos)
+        *s++ = '+';
+    if (flags & std::ios::showpoint)
+        *s++ = '#';
+    // As with num_put, hex floats show all the digits of the value
+    if (!hexFloat) {
+        *s++ = '.';
+        *s++ = '*';
+    }
+    while (*length)
+        *s++ = *length++;
+    *s++ = hexFloat ? (upper ? 'A' : 'a') :
+           field == std::ios::fixed ? (upper ? 'F' : 'f') :
+           field == std::ios::scientific ? (upper ? 'E' : 'e') :
+           (upper ? 'G' : 'g');
+    *s = '\0';
+    // Enough for all the integer digits of %f, or the hex digits of %a
+    const std::size_t size = std::numeric_limits<T>::max_exponent10 +
+                             std::numeric_limits<T>::digits/4 + precision + 16;
+    char small[128];
+    std::vector<char> large;
+    char* buf = small;
+    if (size > sizeof(small)) {
+        large.resize(size);
+        buf = &large[0];
+    }
+    int len = hexFloat ? std::sprintf(buf, spec, value)
+                       : std::sprintf(buf, spec, precision, value);
+    if (len < 0)
+        len = 0;
+    // Replace the radix character, which may be several bytes, with '.'
+    int n = 0;
+    for (int i = 0; i < len; ++i) {
+        const char c = buf[i];
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+            (c >= 'A' && c <= 'Z') || c == '+' || c == '-')
+            buf[n++] = c;
+        else if (n == 0 || buf[n-1] != '.')
+            buf[n++] = '.';
+    }
+    // num_put pads after the sign, or else after the "0x" of hex floats
+    std::streamsize prefixLen = (n > 0 && (buf[0] == '-' || buf[0] == '+')) ? 1 : 0;
+    if (hexFloat && prefixLen == 0 && n > 1 && buf[0] == '0')
+        prefixLen = 2;
+    writePadded(out, buf, n, prefixLen);
+}
 
-def makeCommaSepLists(lineTemplate, elemTemplate, startInd=1):
-    for j in range(startInd,maxParams+1):
-        list = ', '.join([elemTemplate % {'i':i} for i in range(startInd,j+1)])
-        cog.outl(lineTemplate % {'j':j, 'list':list})
+// Write a floating point value which the float engine leaves to the stream
+inline void streamFloat(std::ostream& out, double value)      { writeFloatPrintf(out, value, ""); }
+inline void streamFloat(std::ostream& out, long double value) { writeFloatPrintf(out, value, "L"); }
+#else
+inline void streamFloat(std::ostream& out, double value)      { out << value; }
+inline void streamFloat(std::ostream& out, long double value) { out << value; }
+#endif
 
-makeCommaSepLists('#define TINYFORMAT_ARGTYPES_%(j)d %(list)s',
-                  'class T%(i)d')
+// Floating point output.
+//
+// Floats are laid out from a string of decimal digits d[0..n) and an
+// exponent x, representing the value d[0].d[1]d[2]... * 10^x.  Missing
+// digits are zero.
 
-cog.outl()
-makeCommaSepLists('#define TINYFORMAT_VARARGS_%(j)d %(list)s',
-                  'const T%(i)d& v%(i)d')
+// Write the digits in fixed notation with the given number of decimals.
+inline char* writeFixedDigits(char* p, const char* d, int n, int x,
+                              int decimals, bool point)
+{
+    for (int place = x > 0 ? x : 0; place >= -decimals; --place) {
+        const int i = x - place;
+        *p++ = (i >= 0 && i < n) ? d[i] : '0';
+        if (place == 0 && (decimals > 0 || point))
+            *p++ = '.';
+    }
+    return p;
+}
 
-cog.outl()
-makeCommaSepLists('#define TINYFORMAT_PASSARGS_%(j)d %(list)s', 'v%(i)d')
+// Write the digits in scientific notation with the given number of decimals
+// and an exponent of at least two digits, as for printf's %e.
+inline char* writeScientificDigits(char* p, const char* d, int n, int x,
+                                   int decimals, bool point, bool upper)
+{
+    *p++ = n > 0 ? d[0] : '0';
+    if (decimals > 0 || point)
+        *p++ = '.';
+    for (int i = 1; i <= decimals; ++i)
+        *p++ = i < n ? d[i] : '0';
+    *p++ = upper ? 'E' : 'e';
+    *p++ = x < 0 ? '-' : '+';
+    const unsigned ux = x < 0 ? -x : x;
+    if (ux < 10)
+        *p++ = '0';
+    char tmp[8];
+    char* end = tmp + sizeof(tmp);
+    for (const char* c = formatDecimal(end, ux); c != end; ++c)
+        *p++ = *c;
+    return p;
+}
 
-cog.outl()
-cog.outl('#define TINYFORMAT_PASSARGS_TAIL_1')
-makeCommaSepLists('#define TINYFORMAT_PASSARGS_TAIL_%(j)d , %(list)s',
-                  'v%(i)d', startInd = 2)
+// Write the digits as printf's %g does for the given precision: fixed
+// notation for exponents in [-4, precision), otherwise scientific, with
+// trailing zeros removed unless point is set.
+inline char* writeGeneralDigits(char* p, const char* d, int n, int x,
+                                int precision, bool point, bool upper)
+{
+    int nsig = precision;
+    if (!point) {
+        nsig = n;
+        while (nsig > 1 && d[nsig-1] == '0')
+            --nsig;
+        if (nsig < 1)
+            nsig = 1;
+    }
+    if (precision > x && x >= -4)
+        return writeFixedDigits(p, d, n, x, (std::max)(nsig - 1 - x, 0), point);
+    return writeScientificDigits(p, d, n, x, nsig - 1, point, upper);
+}
 
-cog.outl()
-cog.outl('#define TINYFORMAT_FOREACH_ARGNUM(m) \\\n    ' +
-         ' '.join(['m(%d)' % (j,) for j in range(1,maxParams+1)]))
-]]]*/
-#define TINYFORMAT_ARGTYPES_1 class T1
-#define TINYFORMAT_ARGTYPES_2 class T1, class T2
-#define TINYFORMAT_ARGTYPES_3 class T1, class T2, class T3
-#define TINYFORMAT_ARGTYPES_4 class T1, class T2, class T3, class T4
-#define TINYFORMAT_ARGTYPES_5 class T1, class T2, class T3, class T4, class T5
-#define TINYFORMAT_ARGTYPES_6 class T1, class T2, class T3, class T4, class T5, class T6
-#define TINYFORMAT_ARGTYPES_7 class T1, class T2, class T3, class T4, class T5, class T6, class T7
-#define TINYFORMAT_ARGTYPES_8 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8
-#define TINYFORMAT_ARGTYPES_9 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9
-#define TINYFORMAT_ARGTYPES_10 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10
-#define TINYFORMAT_ARGTYPES_11 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11
-#define TINYFORMAT_ARGTYPES_12 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12
-#define TINYFORMAT_ARGTYPES_13 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12, class T13
-#define TINYFORMAT_ARGTYPES_14 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12, class T13, class T14
-#define TINYFORMAT_ARGTYPES_15 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12, class T13, class T14, class T15
-#define TINYFORMAT_ARGTYPES_16 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12, class T13, class T14, class T15, class T16
+// Find the shortest digits of value > 0 which read back as value by asking
+// the stream for increasing precision.  This is slow, but only used when
+// the float engine below is unavailable or gives up.
+#ifdef TINYFORMAT_C_LOCALE
+inline bool readsBackAs(const char* s, double value)
+{
+    return std::strtod(s, NULL) == value;
+}
 
-#define TINYFORMAT_VARARGS_1 const T1& v1
-#define TINYFORMAT_VARARGS_2 const T1& v1, const T2& v2
-#define TINYFORMAT_VARARGS_3 const T1& v1, const T2& v2, const T3& v3
-#define TINYFORMAT_VARARGS_4 const T1& v1, const T2& v2, const T3& v3, const T4& v4
-#define TINYFORMAT_VARARGS_5 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5
-#define TINYFORMAT_VARARGS_6 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6
-#define TINYFORMAT_VARARGS_7 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7
-#define TINYFORMAT_VARARGS_8 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8
-#define TINYFORMAT_VARARGS_9 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9
-#define TINYFORMAT_VARARGS_10 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10
-#define TINYFORMAT_VARARGS_11 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11
-#define TINYFORMAT_VARARGS_12 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12
-#define TINYFORMAT_VARARGS_13 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12, const T13& v13
-#define TINYFORMAT_VARARGS_14 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12, const T13& v13, const T14& v14
-#define TINYFORMAT_VARARGS_15 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12, const T13& v13, const T14& v14, const T15& v15
-#define TINYFORMAT_VARARGS_16 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12, const T13& v13, const T14& v14, const T15& v15, const T16& v16
+inline bool readsBackAs(const char* s, float value)
+{
+    return static_cast<float>(std::strtod(s, NULL)) == value;
+}
 
-#define TINYFORMAT_PASSARGS_1 v1
-#define TINYFORMAT_PASSARGS_2 v1, v2
-#define TINYFORMAT_PASSARGS_3 v1, v2, v3
-#define TINYFORMAT_PASSARGS_4 v1, v2, v3, v4
-#define TINYFORMAT_PASSARGS_5 v1, v2, v3, v4, v5
-#define TINYFORMAT_PASSARGS_6 v1, v2, v3, v4, v5, v6
-#define TINYFORMAT_PASSARGS_7 v1, v2, v3, v4, v5, v6, v7
-#define TINYFORMAT_PASSARGS_8 v1, v2, v3, v4, v5, v6, v7, v8
-#define TINYFORMAT_PASSARGS_9 v1, v2, v3, v4, v5, v6, v7, v8, v9
-#define TINYFORMAT_PASSARGS_10 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10
-#define TINYFORMAT_PASSARGS_11 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11
-#define TINYFORMAT_PASSARGS_12 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12
-#define TINYFORMAT_PASSARGS_13 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13
+// As below, but with sprintf and strtod, which share the LC_NUMERIC radix.
+template<typename T>
+inline void shortestDigitsSlow(T value, char* d, int& n, int& x)
+{
+    char s[32];
+    for (int precision = 0; precision < 17; ++precision) {
+        std::sprintf(s, "%.*e", precision, static_cast<double>(value));
+        if (readsBackAs(s, value))
+            break;
+    }
+    // s is of the form d<radix>ddde[+-]xx
+    n = 0;
+    const char* c = s;
+    for (; *c && *c != 'e'; ++c) {
+        if (*c >= '0' && *c <= '9')
+            d[n++] = *c;
+    }
+    const bool negativeExponent = *c && c[1] == '-';
+    x = 0;
+    for (c += *c ? 2 : 0; *c; ++c)
+        x = 10*x + (*c - '0');
+    if (negativeExponent)
+        x = -x;
+}
+#else
+template<typename T>
+inline void shortestDigitsSlow(T value, char* d, int& n, int& x)
+{
+    std::ostringstream tmp;
+    tmp.imbue(std::locale::classic());
+    tmp.setf(std::ios::scientific, std::ios::floatfield);
+    std::string s;
+    for (int precision = 0; precision < 17; ++precision) {
+        tmp.str(std::string());
+        tmp.precision(precision);
+        tmp << value;
+        s = tmp.str();
+        std::istringstream in(s);
+        in.imbue(std::locale::classic());
+        T readBack = 0;
+        if ((in >> readBack) && readBack == value)
+            break;
+    }
+    // s is of the form d.ddde[+-]xx
+    n = 0;
+    std::string::size_type i = 0;
+    for (; i < s.size() && s[i] != 'e'; ++i) {
+        if (s[i] != '.')
+            d[n++] = s[i];
+    }
+    const bool negativeExponent = i + 1 < s.size() && s[i+1] == '-';
+    x = 0;
+    for (i += 2; i < s.size(); ++i)
+        x = 10*x + (s[i] - '0');
+    if (negativeExponent)
+        x = -x;
+}
+#endif
+
+#ifdef TINYFORMAT_USE_FLOAT_ENGINE
+// The float engine converts doubles to decimal without the num_put facet,
+// giving the same output as printf in the "C" locale.  %f uses exact
+// integer arithmetic, as in the "fixed dtoa" of the double-conversion
+// library.  %e and %g use the "counted" form of Grisu, and %r uses Grisu3 to
+// find the shortest digits which round trip (F. Loitsch, "Printing
+// Floating-Point Numbers Quickly and Accurately with Integers", PLDI 2010).
+// Grisu gives up for a small fraction of inputs where it can't be sure of
+// the last digit; such values are left to the stream, as are non-finite
+// values and precisions beyond what a double holds.
+
+typedef unsigned long long UInt64;
+
+// A floating point number f*2^e with a 64 bit significand.
+struct DiyFp
+{
+    DiyFp(UInt64 f_, int e_) : f(f_), e(e_) {}
+    UInt64 f;
+    int e;
+};
+
+// Product of x and y, rounded to a 64 bit significand.
+inline DiyFp multiply(const DiyFp& x, const DiyFp& y)
+{
+    const UInt64 mask32 = 0xffffffffu;
+    const UInt64 a = x.f >> 32, b = x.f & mask32;
+    const UInt64 c = y.f >> 32, d = y.f & mask32;
+    const UInt64 ac = a*c, bc = b*c, ad = a*d, bd = b*d;
+    const UInt64 mid = (bd >> 32) + (ad & mask32) + (bc & mask32) +
+                       (UInt64(1) << 31);
+    return DiyFp(ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64);
+}
+
+inline DiyFp normalize(DiyFp x)
+{
+    while (!(x.f >> 63)) {
+        x.f <<= 1;
+        --x.e;
+    }
+    return x;
+}
+
+// Return a cached approximation of 10^k, choosing k such that multiplying a
+// normalized DiyFp with exponent e by it gives an exponent in [-60, -32].
+inline DiyFp cachedPowerOfTen(int e, int& k)
+{
+    // Normalized 10^k for k = -348, -340, ..., 340
+    struct CachedPower { unsigned hi, lo; short e; };
+    static const CachedPower powers[] = {
+        {0xfa8fd5a0, 0x081c0288, -1220}, {0xbaaee17f, 0xa23ebf76, -1193},
+        {0x8b16fb20, 0x3055ac76, -1166}, {0xcf42894a, 0x5dce35ea, -1140},
+        {0x9a6bb0aa, 0x55653b2d, -1113}, {0xe61acf03, 0x3d1a45df, -1087},
+        {0xab70fe17, 0xc79ac6ca, -1060}, {0xff77b1fc, 0xbebcdc4f, -1034},
+        {0xbe5691ef, 0x416bd60c, -1007}, {0x8dd01fad, 0x907ffc3c, -980},
+        {0xd3515c28, 0x31559a83, -954}, {0x9d71ac8f, 0xada6c9b5, -927},
+        {0xea9c2277, 0x23ee8bcb, -901}, {0xaecc4991, 0x4078536d, -874},
+        {0x823c1279, 0x5db6ce57, -847}, {0xc2109436, 0x4dfb5637, -821},
+        {0x9096ea6f, 0x3848984f, -794}, {0xd77485cb, 0x25823ac7, -768},
+        {0xa086cfcd, 0x97bf97f4, -741}, {0xef340a98, 0x172aace5, -715},
+        {0xb23867fb, 0x2a35b28e, -688}, {0x84c8d4df, 0xd2c63f3b, -661},
+        {0xc5dd4427, 0x1ad3cdba, -635}, {0x936b9fce, 0xbb25c996, -608},
+        {0xdbac6c24, 0x7d62a584, -582}, {0xa3ab6658, 0x0d5fdaf6, -555},
+        {0xf3e2f893, 0xdec3f126, -529}, {0xb5b5ada8, 0xaaff80b8, -502},
+        {0x87625f05, 0x6c7c4a8b, -475}, {0xc9bcff60, 0x34c13053, -449},
+        {0x964e858c, 0x91ba2655, -422}, {0xdff97724, 0x70297ebd, -396},
+        {0xa6dfbd9f, 0xb8e5b88f, -369}, {0xf8a95fcf, 0x88747d94, -343},
+        {0xb9447093, 0x8fa89bcf, -316}, {0x8a08f0f8, 0xbf0f156b, -289},
+        {0xcdb02555, 0x653131b6, -263}, {0x993fe2c6, 0xd07b7fac, -236},
+        {0xe45c10c4, 0x2a2b3b06, -210}, {0xaa242499, 0x697392d3, -183},
+        {0xfd87b5f2, 0x8300ca0e, -157}, {0xbce50864, 0x92111aeb, -130},
+        {0x8cbccc09, 0x6f5088cc, -103}, {0xd1b71758, 0xe219652c, -77},
+        {0x9c400000, 0x00000000, -50}, {0xe8d4a510, 0x00000000, -24},
+        {0xad78ebc5, 0xac620000, 3}, {0x813f3978, 0xf8940984, 30},
+        {0xc097ce7b, 0xc90715b3, 56}, {0x8f7e32ce, 0x7bea5c70, 83},
+        {0xd5d238a4, 0xabe98068, 109}, {0x9f4f2726, 0x179a2245, 136},
+        {0xed63a231, 0xd4c4fb27, 162}, {0xb0de6538, 0x8cc8ada8, 189},
+        {0x83c7088e, 0x1aab65db, 216}, {0xc45d1df9, 0x42711d9a, 242},
+        {0x924d692c, 0xa61be758, 269}, {0xda01ee64, 0x1a708dea, 295},
+        {0xa26da399, 0x9aef774a, 322}, {0xf209787b, 0xb47d6b85, 348},
+        {0xb454e4a1, 0x79dd1877, 375}, {0x865b8692, 0x5b9bc5c2, 402},
+        {0xc83553c5, 0xc8965d3d, 428}, {0x952ab45c, 0xfa97a0b3, 455},
+        {0xde469fbd, 0x99a05fe3, 481}, {0xa59bc234, 0xdb398c25, 508},
+        {0xf6c69a72, 0xa3989f5c, 534}, {0xb7dcbf53, 0x54e9bece, 561},
+        {0x88fcf317, 0xf22241e2, 588}, {0xcc20ce9b, 0xd35c78a5, 614},
+        {0x98165af3, 0x7b2153df, 641}, {0xe2a0b5dc, 0x971f303a, 667},
+        {0xa8d9d153, 0x5ce3b396, 694}, {0xfb9b7cd9, 0xa4a7443c, 720},
+        {0xbb764c4c, 0xa7a44410, 747}, {0x8bab8eef, 0xb6409c1a, 774},
+        {0xd01fef10, 0xa657842c, 800}, {0x9b10a4e5, 0xe9913129, 827},
+        {0xe7109bfb, 0xa19c0c9d, 853}, {0xac2820d9, 0x623bf429, 880},
+        {0x80444b5e, 0x7aa7cf85, 907}, {0xbf21e440, 0x03acdd2d, 933},
+        {0x8e679c2f, 0x5e44ff8f, 960}, {0xd433179d, 0x9c8cb841, 986},
+        {0x9e19db92, 0xb4e31ba9, 1013}, {0xeb96bf6e, 0xbadf77d9, 1039},
+        {0xaf87023b, 0x9bf0ee6b, 1066}
+    };
+    const double dk = (-60 - (e + 64) + 63) * 0.30102999566398114; // log10(2)
+    int ceilDk = static_cast<int>(dk);
+    if (ceilDk < dk)
+        ++ceilDk;
+    const int index = (348 + ceilDk - 1) / 8 + 1;
+    k = -348 + 8*index;
+    return DiyFp((UInt64(powers[index].hi) << 32) | powers[index].lo,
+                 powers[index].e);
+}
+
+// Return the largest power of ten <= n > 0, setting numDigits to the
+// number of digits of n.
+inline unsigned biggestPowerOfTen(unsigned n, int& numDigits)
+{
+    unsigned power = 1;
+    numDigits = 1;
+    while (n / 10 >= power) {
+        power *= 10;
+        ++numDigits;
+    }
+    return power;
+}
+
+// Final digit adjustment for grisuShortest().  rest is the distance from
+// the digits to tooHigh, in units the size of the last digit tenKappa.
+inline bool roundWeed(char* d, int n, UInt64 distanceTooHighW,
+                      UInt64 unsafeInterval, UInt64 rest, UInt64 tenKappa,
+                      UInt64 unit)
+{
+    const UInt64 smallDistance = distanceTooHighW - unit;
+    const UInt64 bigDistance = distanceTooHighW + unit;
+    // Move the digits towards w while they're known to get closer to it
+    while (rest < smallDistance && unsafeInterval - rest >= tenKappa &&
+           (rest + tenKappa < smallDistance ||
+            smallDistance - rest >= rest + tenKappa - smallDistance)) {
+        --d[n-1];
+        rest += tenKappa;
+    }
+    // Give up if the next smaller digits could be closer to w too
+    if (rest < bigDistance && unsafeInterval - rest >= tenKappa &&
+        (rest + tenKappa < bigDistance ||
+         bigDistance - rest > rest + tenKappa - bigDistance))
+        return false;
+    // Give up if the result isn't safely inside the rounding interval
+    return 2*unit <= rest && rest <= unsafeInterval - 4*unit;
+}
+
+// Grisu3: find the shortest digits d[0..n) which lie within the rounding
+// interval of the value f*2^e > 0 and are closest to it.  lowerCloser is
+// true when the next smaller float is nearer than the next larger one.
+// Returns false if the result can't be guaranteed to be correct.
+inline bool grisuShortest(UInt64 f, int e, bool lowerCloser,
+                          char* d, int& n, int& x)
+{
+    const DiyFp w = normalize(DiyFp(f, e));
+    const DiyFp mPlus = normalize(DiyFp((f << 1) + 1, e - 1));
+    DiyFp mMinus = lowerCloser ? DiyFp((f << 2) - 1, e - 2)
+                               : DiyFp((f << 1) - 1, e - 1);
+    mMinus.f <<= mMinus.e - mPlus.e;
+    mMinus.e = mPlus.e;
+    int k = 0;
+    const DiyFp c = cachedPowerOfTen(w.e, k);
+    const DiyFp sw = multiply(w, c);
+    const DiyFp low = multiply(mMinus, c);
+    const DiyFp high = multiply(mPlus, c);
+    // The scaled values are out by up to one unit, so generate digits in
+    // the "unsafe interval" (tooLow, tooHigh) and check the result is within
+    // the safe interval at the end.
+    UInt64 unit = 1;
+    const UInt64 tooLow = low.f - unit;
+    const UInt64 tooHigh = high.f + unit;
+    UInt64 unsafeInterval = tooHigh - tooLow;
+    const int shift = -sw.e;
+    const UInt64 one = UInt64(1) << shift;
+    unsigned integrals = static_cast<unsigned>(tooHigh >> shift);
+    UInt64 fractionals = tooHigh & (one - 1);
+    int kappa = 0;
+    unsigned divisor = biggestPowerOfTen(integrals, kappa);
+    n = 0;
+    while (kappa > 0) {
+        d[n++] = static_cast<char>('0' + integrals / divisor);
+        integrals %= divisor;
+        --kappa;
+        const UInt64 rest = (UInt64(integrals) << shift) + fractionals;
+        if (rest < unsafeInterval) {
+            x = kappa - k + n - 1;
+            return roundWeed(d, n, tooHigh - sw.f, unsafeInterval, rest,
+                             UInt64(divisor) << shift, unit);
+        }
+        divisor /= 10;
+    }
+    for (;;) {
+        fractionals *= 10;
+        unit *= 10;
+        unsafeInterval *= 10;
+        d[n++] = static_cast<char>('0' + (fractionals >> shift));
+        fractionals &= one - 1;
+        --kappa;
+        if (fractionals < unsafeInterval) {
+            x = kappa - k + n - 1;
+            return roundWeed(d, n, (tooHigh - sw.f) * unit, unsafeInterval,
+                             fractionals, one, unit);
+        }
+    }
+}
+
+inline bool shortestDigits(double value, char* d, int& n, int& x)
+{
+    UInt64 bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const int biased = static_cast<int>(bits >> 52) & 0x7ff;
+    const UInt64 mantissa = bits & ((UInt64(1) << 52) - 1);
+    return grisuShortest(biased == 0 ? mantissa : mantissa | (UInt64(1) << 52),
+                         (biased == 0 ? 1 : biased) - 1075,
+                         mantissa == 0 && biased > 1, d, n, x);
+}
+
+inline bool shortestDigits(float value, char* d, int& n, int& x)
+{
+    // Use the float's own rounding interval, so that 0.1f is "0.1"
+    unsigned bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const int biased = static_cast<int>(bits >> 23) & 0xff;
+    const unsigned mantissa = bits & 0x7fffff;
+    return grisuShortest(biased == 0 ? mantissa : mantissa | 0x800000,
+                         (biased == 0 ? 1 : biased) - 150,
+                         mantissa == 0 && biased > 1, d, n, x);
+}
+
+// Final rounding for grisuCounted(): round the digits up or down according
+// to rest (the remainder in units where tenKappa is the last digit), unless
+// the error in the scaled value makes the direction uncertain.
+inline bool roundWeedCounted(char* d, int n, UInt64 rest, UInt64 tenKappa,
+                             UInt64 unit, int& kappa)
+{
+    if (unit >= tenKappa || tenKappa - unit <= unit)
+        return false;
+    // Round down if 2*(rest + unit) <= tenKappa
+    if (tenKappa - rest > rest && tenKappa - 2*rest >= 2*unit)
+        return true;
+    // Round up if 2*(rest - unit) >= tenKappa
+    if (rest > unit && tenKappa - (rest - unit) <= rest - unit) {
+        ++d[n-1];
+        for (int i = n - 1; i > 0 && d[i] == '0' + 10; --i) {
+            d[i] = '0';
+            ++d[i-1];
+        }
+        if (d[0] == '0' + 10) {
+            d[0] = '1';
+            ++kappa;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Grisu in "counted" mode: generate the first count > 0 digits of the value
+// f*2^e > 0, correctly rounded.  Returns false if the result can't be
+// guaranteed to be correct, notably for exact ties.
+inline bool grisuCounted(UInt64 f, int e, int count, char* d, int& n, int& x)
+{
+    const DiyFp w = normalize(DiyFp(f, e));
+    int k = 0;
+    const DiyFp sw = multiply(w, cachedPowerOfTen(w.e, k));
+    const int shift = -sw.e;
+    const UInt64 one = UInt64(1) << shift;
+    unsigned integrals = static_cast<unsigned>(sw.f >> shift);
+    UInt64 fractionals = sw.f & (one - 1);
+    UInt64 error = 1;
+    int kappa = 0;
+    unsigned divisor = biggestPowerOfTen(integrals, kappa);
+    n = 0;
+    while (kappa > 0) {
+        d[n++] = static_cast<char>('0' + integrals / divisor);
+        integrals %= divisor;
+        --kappa;
+        if (n == count)
+            break;
+        divisor /= 10;
+    }
+    bool ok = false;
+    if (n == count) {
+        ok = roundWeedCounted(d, n, (UInt64(integrals) << shift) + fractionals,
+                              UInt64(divisor) << shift, error, kappa);
+    }
+    else {
+        while (n < count && fractionals > error) {
+            fractionals *= 10;
+            error *= 10;
+            d[n++] = static_cast<char>('0' + (fractionals >> shift));
+            fractionals &= one - 1;
+            --kappa;
+        }
+        ok = n == count && roundWeedCounted(d, n, fractionals, one, error, kappa);
+    }
+    x = kappa - k + n - 1;
+    return ok;
+}
+
+// Add one in the last place of the digits d[0..n) of 0.ddd * 10^decimalPoint
+inline void roundUpDigits(char* d, int& n, int& decimalPoint)
+{
+    if (n == 0) {
+        d[n++] = '1';
+        decimalPoint = 1;
+        return;
+    }
+    ++d[n-1];
+    for (int i = n - 1; i > 0 && d[i] == '0' + 10; --i) {
+        d[i] = '0';
+        ++d[i-1];
+    }
+    if (d[0] == '0' + 10) {
+        d[0] = '1';
+        ++decimalPoint;
+    }
+}
+
+// Append the digits of fractionals*2^exponent < 1 (where -128 <= exponent
+// < 0) to d, rounded to count places with ties to even as printf does.
+// Multiplying by five rather than ten and moving the binary point keeps
+// the arithmetic exact in 64 or 128 bits.
+inline void fixedFractionals(UInt64 fractionals, int exponent, int count,
+                             char* d, int& n, int& decimalPoint)
+{
+    bool roundUp = false;
+    if (-exponent <= 64) {
+        int point = -exponent;
+        for (int i = 0; i < count && fractionals != 0; ++i) {
+            fractionals *= 5;
+            --point;
+            const unsigned digit = static_cast<unsigned>(fractionals >> point);
+            d[n++] = static_cast<char>('0' + digit);
+            fractionals -= UInt64(digit) << point;
+        }
+        if (fractionals != 0) {
+            const UInt64 half = UInt64(1) << (point - 1);
+            roundUp = fractionals > half ||
+                      (fractionals == half && n > 0 && ((d[n-1] - '0') & 1));
+        }
+    }
+    else {
+        // 128 bit fixed point number hi:lo with the point at bit 128
+        const int s = 128 + exponent;
+        UInt64 hi = s == 0 ? 0 : fractionals >> (64 - s);
+        UInt64 lo = fractionals << s;
+        int point = 128;
+        for (int i = 0; i < count && (hi | lo) != 0; ++i) {
+            const UInt64 lo0 = (lo & 0xffffffffu) * 5;
+            const UInt64 lo1 = (lo >> 32) * 5 + (lo0 >> 32);
+            lo = (lo1 << 32) | (lo0 & 0xffffffffu);
+            hi = hi*5 + (lo1 >> 32);
+            --point;
+            const unsigned digit = static_cast<unsigned>(hi >> (point - 64));
+            d[n++] = static_cast<char>('0' + digit);
+            hi -= UInt64(digit) << (point - 64);
+        }
+        if ((hi | lo) != 0) {
+            const UInt64 half = UInt64(1) << (point - 65);
+            roundUp = hi > half || (hi == half && lo != 0) ||
+                      (hi == half && lo == 0 && n > 0 && ((d[n-1] - '0') & 1));
+        }
+    }
+    if (roundUp)
+        roundUpDigits(d, n, decimalPoint);
+}
+
+// Exact digits of significand*2^exponent rounded to fracDigits places after
+// the point.  On return the value is 0.d[0..n) * 10^decimalPoint, with no
+// leading or trailing zeros (n == 0 for zero).  Returns false for values of
+// 2^64 or more, or more than 20 places.
+inline bool fixedDigits(UInt64 significand, int exponent, int fracDigits,
+                        char* d, int& n, int& decimalPoint)
+{
+    if (exponent > 11 || fracDigits > 20)
+        return false;
+    n = 0;
+    decimalPoint = 0;
+    if (exponent > -53) {
+        const UInt64 integrals = exponent >= 0 ? significand << exponent
+                                               : significand >> -exponent;
+        if (integrals != 0) {
+            char tmp[24];
+            char* end = tmp + sizeof(tmp);
+            for (const char* c = formatDecimal(end, integrals); c != end; ++c)
+                d[n++] = *c;
+        }
+        decimalPoint = n;
+        if (exponent < 0) {
+            fixedFractionals(significand - (integrals << -exponent), exponent,
+                             fracDigits, d, n, decimalPoint);
+        }
+    }
+    else if (exponent >= -128) {
+        fixedFractionals(significand, exponent, fracDigits, d, n, decimalPoint);
+    }
+    // else the value is less than 2^-75 and rounds to zero
+    while (n > 0 && d[n-1] == '0')
+        --n;
+    int leadingZeros = 0;
+    while (leadingZeros < n && d[leadingZeros] == '0')
+        ++leadingZeros;
+    if (leadingZeros > 0) {
+        n -= leadingZeros;
+        std::memmove(d, d + leadingZeros, n);
+        decimalPoint -= leadingZeros;
+    }
+    return true;
+}
+
+// Write the exact hexadecimal form of a double as printf's %a does
+inline char* writeHexFloat(char* p, UInt64 mantissa, int biased, bool point,
+                           bool upper)
+{
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    *p++ = '0';
+    *p++ = upper ? 'X' : 'x';
+    *p++ = biased != 0 ? '1' : '0';
+    const int exponent = biased != 0 ? biased - 1023 : mantissa != 0 ? -1022 : 0;
+    if (mantissa != 0 || point)
+        *p++ = '.';
+    for (int shift = 48; mantissa != 0; shift -= 4) {
+        *p++ = digits[(mantissa >> shift) & 0xf];
+        mantissa &= (UInt64(1) << shift) - 1;
+    }
+    *p++ = upper ? 'P' : 'p';
+    *p++ = exponent < 0 ? '-' : '+';
+    const unsigned ux = exponent < 0 ? -exponent : exponent;
+    char tmp[8];
+    char* end = tmp + sizeof(tmp);
+    for (const char* c = formatDecimal(end, ux); c != end; ++c)
+        *p++ = *c;
+    return p;
+}
+
+// Format value into buf as the num_put facet does in the "C" locale,
+// according to the float field, precision, showpos, showpoint and uppercase
+// flags of the stream.  Returns the length, or -1 if the value should be
+// left to the stream.  buf must hold at least 64 characters.
+inline int formatFloat(char* buf, double value, const std::ios_base& out,
+                       std::streamsize& prefixLen)
+{
+    UInt64 bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const int biased = static_cast<int>(bits >> 52) & 0x7ff;
+    const UInt64 mantissa = bits & ((UInt64(1) << 52) - 1);
+    if (biased == 0x7ff)
+        return -1; // inf or nan
+    const std::ios::fmtflags flags = out.flags();
+    const std::ios::fmtflags field = flags & std::ios::floatfield;
+    const bool point = (flags & std::ios::showpoint) != 0;
+    const bool upper = (flags & std::ios::uppercase) != 0;
+    const std::streamsize precision = out.precision() < 0 ? 6 : out.precision();
+    char* p = buf;
+    if (bits >> 63)
+        *p++ = '-';
+    else if (flags & std::ios::showpos)
+        *p++ = '+';
+    prefixLen = p - buf;
+    if (field == (std::ios::fixed | std::ios::scientific)) {
+        // num_put pads hex floats after the sign, or else after the "0x"
+        if (prefixLen == 0)
+            prefixLen = 2;
+        return static_cast<int>(writeHexFloat(p, mantissa, biased, point, upper) - buf);
+    }
+    const UInt64 significand = biased == 0 ? mantissa : mantissa | (UInt64(1) << 52);
+    const int exponent = (biased == 0 ? 1 : biased) - 1075;
+    char d[48];
+    int n = 0;
+    int x = 0;
+    if (field == std::ios::fixed) {
+        int decimalPoint = 0;
+        if (precision > 20 ||
+            !fixedDigits(significand, exponent, static_cast<int>(precision),
+                         d, n, decimalPoint))
+            return -1;
+        x = n > 0 ? decimalPoint - 1 : 0;
+        p = writeFixedDigits(p, d, n, x, static_cast<int>(precision), point);
+    }
+    else {
+        if (precision > 17)
+            return -1;
+        const int count = field == std::ios::scientific ? static_cast<int>(precision) + 1
+                          : precision == 0 ? 1 : static_cast<int>(precision);
+        if (count > 17)
+            return -1;
+        if (significand != 0 &&
+            !grisuCounted(significand, exponent, count, d, n, x))
+            return -1;
+        if (field == std::ios::scientific)
+            p = writeScientificDigits(p, d, n, x, count - 1, point, upper);
+        else
+            p = writeGeneralDigits(p, d, n, x, count, point, upper);
+    }
+    return static_cast<int>(p - buf);
+}
+
+// Write a double or float (which num_put formats as a double)
+TINYFORMAT_FUNC void writeFloat(std::ostream& out, double value);
+#endif // TINYFORMAT_USE_FLOAT_ENGINE
+
+// Write value for the %r conversion: as %g, but with the precision
+// increased to the shortest number of significant digits which read back
+// as the same value.
+template<typename T>
+inline void writeShortest(std::ostream& out, T value)
+{
+    if (!(value - value == 0)) {
+        streamFloat(out, value); // inf or nan
+        return;
+    }
+    const bool negative = value < 0 || (value == 0 && 1/value < 0);
+    const T magnitude = negative ? -value : value;
+    const bool classic = hasClassicLocale(out);
+    char d[20];
+    int n = 0;
+    int x = 0;
+    if (magnitude == 0)
+        d[n++] = '0';
+#ifdef TINYFORMAT_USE_FLOAT_ENGINE
+    // Grisu3 digits are occasionally shorter than any correctly rounded
+    // ones, which the stream can't reproduce in other locales.
+    else if (classic && shortestDigits(magnitude, d, n, x)) /**/;
+#endif
+    else
+        shortestDigitsSlow(magnitude, d, n, x);
+    const std::ios::fmtflags flags = out.flags();
+    const bool point = (flags & std::ios::showpoint) != 0;
+    const std::streamsize precision = out.precision() < 0 ? 6 :
+                                      out.precision() == 0 ? 1 : out.precision();
+    int digits = n;
+    if (precision > n)
+        digits = static_cast<int>((std::min)(precision, static_cast<std::streamsize>(1000)));
+    if (classic && digits <= 40) {
+        char buf[64];
+        char* p = buf;
+        if (negative)
+            *p++ = '-';
+        else if (flags & std::ios::showpos)
+            *p++ = '+';
+        const std::streamsize prefixLen = p - buf;
+        p = writeGeneralDigits(p, d, n, x, digits, point,
+                               (flags & std::ios::uppercase) != 0);
+        writePadded(out, buf, p - buf, prefixLen);
+    }
+    else {
+        // Let the stream round to the same number of digits in the notation
+        // which %g would choose
+        const int nsig = point ? digits : n;
+        if (digits > x && x >= -4) {
+            out.setf(std::ios::fixed, std::ios::floatfield);
+            out.precision((std::max)(nsig - 1 - x, 0));
+        }
+        else {
+            out.setf(std::ios::scientific, std::ios::floatfield);
+            out.precision(nsig - 1);
+        }
+        streamFloat(out, value);
+    }
+}
+
+// Stream a value for formatValue() when no conversion specific special case
+// applies.  Overloaded below for built in types which can be written more
+// efficiently than via operator<<.
+template<typename T>
+inline void streamValue(std::ostream& out, const T& value) { out << value; }
+
+inline void streamValue(std::ostream& out, const char* value)        { writeString(out, value); }
+inline void streamValue(std::ostream& out, char* value)              { writeString(out, value); }
+inline void streamValue(std::ostream& out, const std::string& value) { writeString(out, value); }
+inline void streamValue(std::ostream& out, bool value)               { writeBool(out, value); }
+#ifdef TINYFORMAT_USE_FLOAT_ENGINE
+inline void streamValue(std::ostream& out, float value)              { writeFloat(out, value); }
+inline void streamValue(std::ostream& out, double value)             { writeFloat(out, value); }
+#elif defined(TINYFORMAT_C_LOCALE)
+inline void streamValue(std::ostream& out, float value)              { streamFloat(out, value); }
+inline void streamValue(std::ostream& out, double value)             { streamFloat(out, value); }
+#endif
+#ifdef TINYFORMAT_C_LOCALE
+inline void streamValue(std::ostream& out, long double value)        { streamFloat(out, value); }
+inline void streamValue(std::ostream& out, const void* value)        { writePointer(out, value); }
+inline void streamValue(std::ostream& out, void* value)              { writePointer(out, value); }
+#endif
+#define TINYFORMAT_DEFINE_STREAMVALUE_INTEGER(type)                        \
+inline void streamValue(std::ostream& out, type value)                     \
+    { writeInteger(out, value); }                                          \
+inline void streamValue(std::ostream& out, unsigned type value)            \
+    { writeInteger(out, value); }
+TINYFORMAT_DEFINE_STREAMVALUE_INTEGER(short)
+TINYFORMAT_DEFINE_STREAMVALUE_INTEGER(int)
+TINYFORMAT_DEFINE_STREAMVALUE_INTEGER(long)
+#ifdef TINYFORMAT_HAS_LONG_LONG
+TINYFORMAT_DEFINE_STREAMVALUE_INTEGER(long long)
+#endif
+#undef TINYFORMAT_DEFINE_STREAMVALUE_INTEGER
+
+// Stream a value for the %r conversion, which only differs from %g for
+// floating point types.
+template<typename T>
+inline void streamShortest(std::ostream& out, const T& value) { streamValue(out, value); }
+
+inline void streamShortest(std::ostream& out, float value)  { writeShortest(out, value); }
+inline void streamShortest(std::ostream& out, double value) { writeShortest(out, value); }
+
+#ifdef TINYFORMAT_C_LOCALE
+// %p, without the num_put facet
+template<typename T>
+struct formatValueAsType<T, const void*, true>
+{
+    static void invoke(std::ostream& out, const T& value)
+        { writePointer(out, static_cast<const void*>(value)); }
+};
+#endif
+
+
+// Stream buffer which passes at most n characters on to another stream
+// buffer and then refuses any more, so that a stream writing to it fails
+// and stops formatting.
+class TruncatingStreambuf : public std::streambuf
+{
+    public:
+        TruncatingStreambuf(std::streambuf* dest, std::streamsize n)
+            : m_dest(dest), m_remaining(n), m_destFailed(false) {}
+
+        /// Return true if writing to the destination buffer failed.
+        bool destFailed() const { return m_destFailed; }
+
+    protected:
+        virtual int_type overflow(int_type c)
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof()))
+                return traits_type::not_eof(c);
+            if (m_remaining <= 0)
+                return traits_type::eof();
+            if (traits_type::eq_int_type(m_dest->sputc(traits_type::to_char_type(c)),
+                                         traits_type::eof())) {
+                m_destFailed = true;
+                return traits_type::eof();
+            }
+            --m_remaining;
+            return c;
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize n)
+        {
+            const std::streamsize k = (std::min)(n, m_remaining);
+            const std::streamsize written = m_dest->sputn(s, k);
+            if (written != k)
+                m_destFailed = true;
+            m_remaining -= written;
+            return written;
+        }
+
+    private:
+        std::streambuf* m_dest;
+        std::streamsize m_remaining;
+        bool m_destFailed;
+};
+
+// Format at most ntrunc characters to the given stream.  Types with
+// CharRangeTraits are written directly; others are formatted with
+// operator<< in the default stream state.
+template<typename T, bool isCharRange = CharRangeTraits<T>::isCharRange>
+struct formatTruncatedImpl
+{
+    static void invoke(std::ostream& out, const T& value, int ntrunc)
+    {
+#ifdef TINYFORMAT_STREAMING_TRUNCATION
+        std::ostream::sentry ok(out);
+        if (ok) {
+            TruncatingStreambuf buf(out.rdbuf(), ntrunc);
+            std::ostream tmp(&buf);
+            tmp << value;
+            if (buf.destFailed())
+                out.setstate(std::ios::badbit);
+        }
+#else
+#   ifdef TINYFORMAT_STATS
+        threadStats().truncationCopies.add(1);
+#   endif
+        std::ostringstream tmp;
+        tmp << value;
+        std::string result = tmp.str();
+        std::size_t n = (std::min)(static_cast<std::size_t>(ntrunc), result.size());
+#   ifdef TINYFORMAT_UTF8_TRUNCATION
+        n = utf8Truncate(result.c_str(), n);
+#   endif
+        out.write(result.c_str(), static_cast<std::streamsize>(n));
+#endif
+    }
+};
+
+template<typename T>
+struct formatTruncatedImpl<T, true>
+{
+    static void invoke(std::ostream& out, const T& value, int ntrunc)
+    {
+        const std::size_t size = CharRangeTraits<T>::size(value);
+        const char* data = CharRangeTraits<T>::data(value);
+        std::size_t n = (std::min)(static_cast<std::size_t>(ntrunc), size);
+#ifdef TINYFORMAT_UTF8_TRUNCATION
+        if (n < size)
+            n = utf8Truncate(data, n);
+#endif
+        out.write(data, static_cast<std::streamsize>(n));
+    }
+};
+
+template<typename T>
+inline void formatTruncated(std::ostream& out, const T& value, int ntrunc)
+{
+    formatTruncatedImpl<T>::invoke(out, value, ntrunc);
+}
+inline void formatTruncatedCString(std::ostream& out, const char* value, int ntrunc)
+{
+    std::streamsize len = 0;
+    while (len < ntrunc && value[len] != 0)
+        ++len;
+#ifdef TINYFORMAT_UTF8_TRUNCATION
+    len = static_cast<std::streamsize>(utf8Truncate(value, static_cast<std::size_t>(len)));
+#endif
+    out.write(value, len);
+}
+#define TINYFORMAT_DEFINE_FORMAT_TRUNCATED_CSTR(type)       \
+inline void formatTruncated(std::ostream& out, type* value, int ntrunc) \
+{                                                           \
+    formatTruncatedCString(out, value, ntrunc);             \
+}
+// Overload for const char* and char*.  Could overload for signed & unsigned
+// char too, but these are technically unneeded for printf compatibility.
+TINYFORMAT_DEFINE_FORMAT_TRUNCATED_CSTR(const char)
+TINYFORMAT_DEFINE_FORMAT_TRUNCATED_CSTR(char)
+#undef TINYFORMAT_DEFINE_FORMAT_TRUNCATED_CSTR
+
+} // namespace detail
+
+
+//------------------------------------------------------------------------------
+// Variable formatting functions.  May be overridden for user-defined types if
+// desired.
+
+
+/// Format a value into a stream, delegating to operator<< by default.
+///
+/// Users may override this for their own types.  When this function is called,
+/// the stream flags will have been modified according to the format string.
+/// The format specification is provided in the range [fmtBegin, fmtEnd).  For
+/// truncating conversions, ntrunc is set to the desired maximum number of
+/// characters, for example "%.7s" calls formatValue with ntrunc = 7.
+///
+/// By default, formatValue() uses the usual stream insertion operator
+/// operator<< to format the type T, with special cases for the %c and %p
+/// conversions.
+template<typename T>
+inline void formatValue(std::ostream& out, const char* /*fmtBegin*/,
+                        const char* fmtEnd, int ntrunc, const T& value)
+{
+    // The mess here is to support the %c and %p conversions: if these
+    // conversions are active we try to convert the type to a char or const
+    // void* respectively and format that instead of the value itself.  For the
+    // %p conversion it's important to avoid dereferencing the pointer, which
+    // could otherwise lead to a crash when printing a dangling (const char*).
+    const bool canConvertToChar = detail::is_convertible<T,char>::value;
+    const bool canConvertToVoidPtr = detail::is_convertible<T, const void*>::value;
+    if (canConvertToChar && *(fmtEnd-1) == 'c')
+        detail::formatValueAsType<T, char>::invoke(out, value);
+    else if (canConvertToVoidPtr && *(fmtEnd-1) == 'p')
+        detail::formatValueAsType<T, const void*>::invoke(out, value);
+#ifndef TINYFORMAT_ALLOW_WCHAR_STRINGS
+    else if (detail::WideCStringTraits<T>::isWideCString)
+        detail::formatWideCString<T>::invoke(out, value, ntrunc);
+#endif
+#ifdef TINYFORMAT_OLD_LIBSTDCPLUSPLUS_WORKAROUND
+    else if (detail::formatZeroIntegerWorkaround<T>::invoke(out, value)) /**/;
+#endif
+    else if (ntrunc >= 0) {
+        // Take care not to overread C strings in truncating conversions like
+        // "%.4s" where at most 4 characters may be read.
+        detail::formatTruncated(out, value, ntrunc);
+    }
+    else if (*(fmtEnd-1) == 'r' || *(fmtEnd-1) == 'R')
+        detail::streamShortest(out, value);
+    else
+        detail::streamValue(out, value);
+}
+
+
+// Overloaded version for char types to support printing as an integer
+#define TINYFORMAT_DEFINE_FORMATVALUE_CHAR(charType)                  \
+inline void formatValue(std::ostream& out, const char* /*fmtBegin*/,  \
+                        const char* fmtEnd, int /**/, charType value) \
+{                                                                     \
+    switch (*(fmtEnd-1)) {                                            \
+        case 'u': case 'd': case 'i': case 'o': case 'X': case 'x':   \
+            detail::writeInteger(out, static_cast<int>(value)); break;\
+        default: {                                                    \
+            const char c = static_cast<char>(value);                  \
+            detail::writePadded(out, &c, 1);                          \
+            break;                                                    \
+        }                                                             \
+    }                                                                 \
+}
+// per 3.9.1: char, signed char and unsigned char are all distinct types
+TINYFORMAT_DEFINE_FORMATVALUE_CHAR(char)
+TINYFORMAT_DEFINE_FORMATVALUE_CHAR(signed char)
+TINYFORMAT_DEFINE_FORMATVALUE_CHAR(unsigned char)
+#undef TINYFORMAT_DEFINE_FORMATVALUE_CHAR
+
+#ifndef TINYFORMAT_ALLOW_WCHAR_STRINGS
+// Overloads for wide string classes, which are written as UTF-8.  Wide C
+// strings are handled by the generic formatValue().
+#define TINYFORMAT_DEFINE_FORMATVALUE_WIDE(charType)                              \
+inline void formatValue(std::ostream& out, const char* /*fmtBegin*/,              \
+                        const char* /*fmtEnd*/, int ntrunc,                       \
+                        const std::basic_string<charType>& value)                 \
+{                                                                                 \
+    detail::writeWideString(out, value.data(), value.size(), ntrunc);             \
+}
+TINYFORMAT_DEFINE_FORMATVALUE_WIDE(wchar_t)
+#ifdef TINYFORMAT_HAS_UNICODE_CHARS
+TINYFORMAT_DEFINE_FORMATVALUE_WIDE(char16_t)
+TINYFORMAT_DEFINE_FORMATVALUE_WIDE(char32_t)
+#endif
+#undef TINYFORMAT_DEFINE_FORMATVALUE_WIDE
+
+#ifdef TINYFORMAT_HAS_STRING_VIEW
+#define TINYFORMAT_DEFINE_FORMATVALUE_WIDE_VIEW(charType)                         \
+inline void formatValue(std::ostream& out, const char* /*fmtBegin*/,              \
+                        const char* /*fmtEnd*/, int ntrunc,                       \
+                        std::basic_string_view<charType> value)                   \
+{                                                                                 \
+    detail::writeWideString(out, value.data(), value.size(), ntrunc);             \
+}
+TINYFORMAT_DEFINE_FORMATVALUE_WIDE_VIEW(wchar_t)
+TINYFORMAT_DEFINE_FORMATVALUE_WIDE_VIEW(char16_t)
+TINYFORMAT_DEFINE_FORMATVALUE_WIDE_VIEW(char32_t)
+#undef TINYFORMAT_DEFINE_FORMATVALUE_WIDE_VIEW
+#endif
+#endif // TINYFORMAT_ALLOW_WCHAR_STRINGS
+
+
+#ifndef TINYFORMAT_VARIADIC_ONLY
+//------------------------------------------------------------------------------
+// Tools for emulating variadic templates in C++98.  The basic idea here is
+// stolen from the boost preprocessor metaprogramming library and cut down to
+// be just general enough for what we need.
+
+#define TINYFORMAT_ARGTYPES(n) TINYFORMAT_ARGTYPES_ ## n
+#define TINYFORMAT_VARARGS(n) TINYFORMAT_VARARGS_ ## n
+#define TINYFORMAT_PASSARGS(n) TINYFORMAT_PASSARGS_ ## n
+#define TINYFORMAT_PASSARGS_TAIL(n) TINYFORMAT_PASSARGS_TAIL_ ## n
+
+// To keep it as transparent as possible, the macros below have been generated
+// using python via the excellent cog code generation script.  This avoids
+// the need for a bunch of complex (but more general) preprocessor tricks as
+// used in boost.preprocessor.
+//
+// To rerun the code generation in place, use `cog -r tinyformat.h`
+// (see http://nedbatchelder.com/code/cog).  Alternatively you can just create
+// extra versions by hand.
+
+/*[[[cog
+maxParams = 16
+
+def makeCommaSepLists(lineTemplate, elemTemplate, startInd=1):
+    for j in range(startInd,maxParams+1):
+        list = ', '.join([elemTemplate % {'i':i} for i in range(startInd,j+1)])
+        cog.outl(lineTemplate % {'j':j, 'list':list})
+
+makeCommaSepLists('#define TINYFORMAT_ARGTYPES_%(j)d %(list)s',
+                  'class T%(i)d')
+
+cog.outl()
+makeCommaSepLists('#define TINYFORMAT_VARARGS_%(j)d %(list)s',
+                  'const T%(i)d& v%(i)d')
+
+cog.outl()
+makeCommaSepLists('#define TINYFORMAT_PASSARGS_%(j)d %(list)s', 'v%(i)d')
+
+cog.outl()
+cog.outl('#define TINYFORMAT_PASSARGS_TAIL_1')
+makeCommaSepLists('#define TINYFORMAT_PASSARGS_TAIL_%(j)d , %(list)s',
+                  'v%(i)d', startInd = 2)
+
+cog.outl()
+cog.outl('#define TINYFORMAT_FOREACH_ARGNUM(m) \\\n    ' +
+         ' '.join(['m(%d)' % (j,) for j in range(1,maxParams+1)]))
+]]]*/
+#define TINYFORMAT_ARGTYPES_1 class T1
+#define TINYFORMAT_ARGTYPES_2 class T1, class T2
+#define TINYFORMAT_ARGTYPES_3 class T1, class T2, class T3
+#define TINYFORMAT_ARGTYPES_4 class T1, class T2, class T3, class T4
+#define TINYFORMAT_ARGTYPES_5 class T1, class T2, class T3, class T4, class T5
+#define TINYFORMAT_ARGTYPES_6 class T1, class T2, class T3, class T4, class T5, class T6
+#define TINYFORMAT_ARGTYPES_7 class T1, class T2, class T3, class T4, class T5, class T6, class T7
+#define TINYFORMAT_ARGTYPES_8 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8
+#define TINYFORMAT_ARGTYPES_9 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9
+#define TINYFORMAT_ARGTYPES_10 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10
+#define TINYFORMAT_ARGTYPES_11 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11
+#define TINYFORMAT_ARGTYPES_12 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12
+#define TINYFORMAT_ARGTYPES_13 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12, class T13
+#define TINYFORMAT_ARGTYPES_14 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12, class T13, class T14
+#define TINYFORMAT_ARGTYPES_15 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12, class T13, class T14, class T15
+#define TINYFORMAT_ARGTYPES_16 class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11, class T12, class T13, class T14, class T15, class T16
+
+#define TINYFORMAT_VARARGS_1 const T1& v1
+#define TINYFORMAT_VARARGS_2 const T1& v1, const T2& v2
+#define TINYFORMAT_VARARGS_3 const T1& v1, const T2& v2, const T3& v3
+#define TINYFORMAT_VARARGS_4 const T1& v1, const T2& v2, const T3& v3, const T4& v4
+#define TINYFORMAT_VARARGS_5 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5
+#define TINYFORMAT_VARARGS_6 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6
+#define TINYFORMAT_VARARGS_7 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7
+#define TINYFORMAT_VARARGS_8 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8
+#define TINYFORMAT_VARARGS_9 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9
+#define TINYFORMAT_VARARGS_10 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10
+#define TINYFORMAT_VARARGS_11 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11
+#define TINYFORMAT_VARARGS_12 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12
+#define TINYFORMAT_VARARGS_13 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12, const T13& v13
+#define TINYFORMAT_VARARGS_14 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12, const T13& v13, const T14& v14
+#define TINYFORMAT_VARARGS_15 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12, const T13& v13, const T14& v14, const T15& v15
+#define TINYFORMAT_VARARGS_16 const T1& v1, const T2& v2, const T3& v3, const T4& v4, const T5& v5, const T6& v6, const T7& v7, const T8& v8, const T9& v9, const T10& v10, const T11& v11, const T12& v12, const T13& v13, const T14& v14, const T15& v15, const T16& v16
+
+#define TINYFORMAT_PASSARGS_1 v1
+#define TINYFORMAT_PASSARGS_2 v1, v2
+#define TINYFORMAT_PASSARGS_3 v1, v2, v3
+#define TINYFORMAT_PASSARGS_4 v1, v2, v3, v4
+#define TINYFORMAT_PASSARGS_5 v1, v2, v3, v4, v5
+#define TINYFORMAT_PASSARGS_6 v1, v2, v3, v4, v5, v6
+#define TINYFORMAT_PASSARGS_7 v1, v2, v3, v4, v5, v6, v7
+#define TINYFORMAT_PASSARGS_8 v1, v2, v3, v4, v5, v6, v7, v8
+#define TINYFORMAT_PASSARGS_9 v1, v2, v3, v4, v5, v6, v7, v8, v9
+#define TINYFORMAT_PASSARGS_10 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10
+#define TINYFORMAT_PASSARGS_11 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11
+#define TINYFORMAT_PASSARGS_12 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12
+#define TINYFORMAT_PASSARGS_13 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13
 #define TINYFORMAT_PASSARGS_14 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14
 #define TINYFORMAT_PASSARGS_15 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15
 #define TINYFORMAT_PASSARGS_16 v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15, v16
 
-#define TINYFORMAT_PASSARGS_TAIL_1
-#define TINYFORMAT_PASSARGS_TAIL_2 , v2
-#define TINYFORMAT_PASSARGS_TAIL_3 , v2, v3
-#define TINYFORMAT_PASSARGS_TAIL_4 , v2, v3, v4
-#define TINYFORMAT_PASSARGS_TAIL_5 , v2, v3, v4, v5
-#define TINYFORMAT_PASSARGS_TAIL_6 , v2, v3, v4, v5, v6
-#define TINYFORMAT_PASSARGS_TAIL_7 , v2, v3, v4, v5, v6, v7
-#define TINYFORMAT_PASSARGS_TAIL_8 , v2, v3, v4, v5, v6, v7, v8
-#define TINYFORMAT_PASSARGS_TAIL_9 , v2, v3, v4, v5, v6, v7, v8, v9
-#define TINYFORMAT_PASSARGS_TAIL_10 , v2, v3, v4, v5, v6, v7, v8, v9, v10
-#define TINYFORMAT_PASSARGS_TAIL_11 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11
-#define TINYFORMAT_PASSARGS_TAIL_12 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12
-#define TINYFORMAT_PASSARGS_TAIL_13 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13
-#define TINYFORMAT_PASSARGS_TAIL_14 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14
-#define TINYFORMAT_PASSARGS_TAIL_15 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15
-#define TINYFORMAT_PASSARGS_TAIL_16 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15, v16
+#define TINYFORMAT_PASSARGS_TAIL_1
+#define TINYFORMAT_PASSARGS_TAIL_2 , v2
+#define TINYFORMAT_PASSARGS_TAIL_3 , v2, v3
+#define TINYFORMAT_PASSARGS_TAIL_4 , v2, v3, v4
+#define TINYFORMAT_PASSARGS_TAIL_5 , v2, v3, v4, v5
+#define TINYFORMAT_PASSARGS_TAIL_6 , v2, v3, v4, v5, v6
+#define TINYFORMAT_PASSARGS_TAIL_7 , v2, v3, v4, v5, v6, v7
+#define TINYFORMAT_PASSARGS_TAIL_8 , v2, v3, v4, v5, v6, v7, v8
+#define TINYFORMAT_PASSARGS_TAIL_9 , v2, v3, v4, v5, v6, v7, v8, v9
+#define TINYFORMAT_PASSARGS_TAIL_10 , v2, v3, v4, v5, v6, v7, v8, v9, v10
+#define TINYFORMAT_PASSARGS_TAIL_11 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11
+#define TINYFORMAT_PASSARGS_TAIL_12 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12
+#define TINYFORMAT_PASSARGS_TAIL_13 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13
+#define TINYFORMAT_PASSARGS_TAIL_14 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14
+#define TINYFORMAT_PASSARGS_TAIL_15 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15
+#define TINYFORMAT_PASSARGS_TAIL_16 , v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15, v16
+
+#define TINYFORMAT_FOREACH_ARGNUM(m) \
+    m(1) m(2) m(3) m(4) m(5) m(6) m(7) m(8) m(9) m(10) m(11) m(12) m(13) m(14) m(15) m(16)
+//[[[end]]]
+#endif // TINYFORMAT_VARIADIC_ONLY
+
+
+
+class Buffer;
+
+namespace detail {
+
+// Built in types which FormatArg formats without calling through its
+// actions table, for conversions where formatValue() would just stream them.
+// Floating point is left to formatValue(): its writers are large, and their
+// cost is dominated by the conversion rather than the dispatch.
+//
+// The tags from ArgBool on are only used by serialize_format(), which also
+// writes these values as the type tags of its records, so new tags must be
+// added at the end.
+enum FormatArgType
+{
+    ArgOther,
+    ArgInt,
+    ArgUnsigned,
+    ArgLong,
+    ArgUnsignedLong,
+    ArgLongLong,
+    ArgUnsignedLongLong,
+    ArgConstCharPtr,
+    ArgCharPtr,
+    ArgCharArray,
+    ArgString,
+    ArgBool,
+    ArgChar,
+    ArgSignedChar,
+    ArgUnsignedChar,
+    ArgShort,
+    ArgUnsignedShort,
+    ArgFloat,
+    ArgDouble,
+    ArgLongDouble,
+    ArgConstVoidPtr,
+    ArgVoidPtr,
+    ArgStringView
+};
+
+template<typename T>
+struct FormatArgTypeOf { enum { value = ArgOther }; };
+
+#define TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(type, tag)                     \
+template<> struct FormatArgTypeOf<type> { enum { value = tag }; };
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(int, ArgInt)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(unsigned int, ArgUnsigned)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(long, ArgLong)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(unsigned long, ArgUnsignedLong)
+#ifdef TINYFORMAT_HAS_LONG_LONG
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(long long, ArgLongLong)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(unsigned long long, ArgUnsignedLongLong)
+#endif
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(bool, ArgBool)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(char, ArgChar)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(signed char, ArgSignedChar)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(unsigned char, ArgUnsignedChar)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(short, ArgShort)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(unsigned short, ArgUnsignedShort)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(float, ArgFloat)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(double, ArgDouble)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(long double, ArgLongDouble)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(const void*, ArgConstVoidPtr)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(void*, ArgVoidPtr)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(const char*, ArgConstCharPtr)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(char*, ArgCharPtr)
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(std::string, ArgString)
+#ifdef TINYFORMAT_HAS_STRING_VIEW
+TINYFORMAT_DEFINE_FORMAT_ARG_TYPE(std::string_view, ArgStringView)
+#endif
+#undef TINYFORMAT_DEFINE_FORMAT_ARG_TYPE
+
+template<std::size_t N>
+struct FormatArgTypeOf<char[N]> { enum { value = ArgCharArray }; };
+
+
+// Actions on the type of a format() argument, with one constant table per
+// type so that a FormatArg needs only a single pointer to reach them.
+struct FormatArgActions
+{
+    void (*format)(std::ostream& out, const char* fmtBegin,
+                   const char* fmtEnd, int ntrunc, const void* value);
+    int (*toInt)(const void* value);
+    int type;  // FormatArgType
+};
+
+template<typename T>
+struct FormatArgActionsFor
+{
+    TINYFORMAT_HIDDEN static void formatImpl(std::ostream& out, const char* fmtBegin,
+                    const char* fmtEnd, int ntrunc, const void* value)
+    {
+        formatValue(out, fmtBegin, fmtEnd, ntrunc, *static_cast<const T*>(value));
+    }
+
+    TINYFORMAT_HIDDEN static int toIntImpl(const void* value)
+    {
+        return convertToInt<T>::invoke(*static_cast<const T*>(value));
+    }
+
+    TINYFORMAT_HIDDEN static const FormatArgActions table;
+};
+
+template<typename T>
+const FormatArgActions FormatArgActionsFor<T>::table = {
+    &FormatArgActionsFor<T>::formatImpl,
+    &FormatArgActionsFor<T>::toIntImpl,
+    FormatArgTypeOf<T>::value
+};
+
+
+// Type-opaque holder for an argument to format(), with associated actions on
+// the type held as a pointer to a table of functions.  This allows FormatArg's
+// for each argument to be allocated as a homogeneous array inside FormatList
+// whereas a naive implementation based on inheritance does not.  A FormatArg
+// is two pointers, which keeps argument lists small to build and copy.
+class FormatArg
+{
+    public:
+        FormatArg()
+            : m_value(NULL),
+            m_actions(NULL)
+        { }
+
+        template<typename T>
+        FormatArg(const T& value)
+            // C-style cast here allows us to also remove volatile; we put it
+            // back in the *Impl functions before dereferencing to avoid UB.
+            : m_value((const void*)(&value)),
+            m_actions(&FormatArgActionsFor<T>::table)
+        { }
+
+        void format(std::ostream& out, const char* fmtBegin,
+                    const char* fmtEnd, int ntrunc) const
+        {
+            TINYFORMAT_ASSERT(m_value);
+            TINYFORMAT_ASSERT(m_actions);
+            if (ntrunc < 0 && formatBuiltin(out, *(fmtEnd-1)))
+                return;
+            m_actions->format(out, fmtBegin, fmtEnd, ntrunc, m_value);
+        }
+
+        /// Format via formatValue(), without the built in fast path, for
+        /// rarely used code paths which needn't be inlined.
+        void formatGeneric(std::ostream& out, const char* fmtBegin,
+                           const char* fmtEnd, int ntrunc) const
+        {
+            TINYFORMAT_ASSERT(m_value);
+            TINYFORMAT_ASSERT(m_actions);
+            m_actions->format(out, fmtBegin, fmtEnd, ntrunc, m_value);
+        }
+
+        int toInt() const
+        {
+            TINYFORMAT_ASSERT(m_value);
+            TINYFORMAT_ASSERT(m_actions);
+            return m_actions->toInt(m_value);
+        }
+
+        /// Append the type tag and value of the argument to out, in the
+        /// record format of serialize_format().
+        void serialize(Buffer& out) const;
+
+    private:
+        template<typename T>
+        const T& get() const { return *static_cast<const T*>(m_value); }
+
+        template<typename T>
+        static bool streamed(std::ostream& out, const T& value)
+        {
+            streamValue(out, value);
+            return true;
+        }
+
+        // Format the common built in types in place, giving the same output
+        // as formatValue() but without an indirect call.  Returns false for
+        // other types and for the %c and %p special cases.
+        bool formatBuiltin(std::ostream& out, char conv) const
+        {
+            // The old libstdc++ workaround for zero is in formatValue()
+#ifndef TINYFORMAT_OLD_LIBSTDCPLUSPLUS_WORKAROUND
+            const bool numeric = conv != 'c';
+#endif
+            switch (m_actions->type) {
+#ifndef TINYFORMAT_OLD_LIBSTDCPLUSPLUS_WORKAROUND
+                case ArgInt:              return numeric && streamed(out, get<int>());
+                case ArgUnsigned:         return numeric && streamed(out, get<unsigned int>());
+                case ArgLong:             return numeric && streamed(out, get<long>());
+                case ArgUnsignedLong:     return numeric && streamed(out, get<unsigned long>());
+#ifdef TINYFORMAT_HAS_LONG_LONG
+                case ArgLongLong:         return numeric && streamed(out, get<long long>());
+                case ArgUnsignedLongLong: return numeric && streamed(out, get<unsigned long long>());
+#endif
+#endif
+                case ArgConstCharPtr:     return conv != 'p' && streamed(out, get<const char*>());
+                case ArgCharPtr:          return conv != 'p' && streamed(out, get<char*>());
+                case ArgCharArray:        return conv != 'p' &&
+                                                 streamed(out, static_cast<const char*>(m_value));
+                case ArgString:           return streamed(out, get<std::string>());
+                default:                  return false;
+            }
+        }
+
+        const void* m_value;
+        const FormatArgActions* m_actions;
+};
+
+
+// Parse and return an integer from the string c, as atoi()
+// On return, c is set to one past the end of the integer.
+TINYFORMAT_CONSTEXPR14 inline int parseIntAndAdvance(const char*& c)
+{
+    int i = 0;
+    for (;*c >= '0' && *c <= '9'; ++c)
+        i = 10*i + (*c - '0');
+    return i;
+}
+
+// Names of the arguments for format strings which refer to them by name:
+// names[i] is the name of argument i.
+struct ArgNames
+{
+    const char* const* names;
+    int count;
+};
+
+// Parse an argument name "(name)" at `c`, advancing `c` past the ')'.
+// Returns the index of the argument with that name, or -1 on error.
+TINYFORMAT_CONSTEXPR14 inline int parseArgName(const char*& c, const ArgNames* names)
+{
+    TINYFORMAT_ASSERT(*c == '(');
+    const char* nameBegin = ++c;
+    while (*c != ')' && *c != '\0')
+        ++c;
+    if (*c == '\0') {
+        TINYFORMAT_RAISE_ERROR("tinyformat: Argument name not terminated by ')'");
+        return -1;
+    }
+    const char* nameEnd = c++;
+    if (!names) {
+        TINYFORMAT_RAISE_ERROR("tinyformat: Named arguments require a CompiledFormat "
+                         "constructed with argument names");
+        return -1;
+    }
+    for (int i = 0; i < names->count; ++i) {
+        const char* n = names->names[i];
+        const char* p = nameBegin;
+        while (p != nameEnd && *n == *p) {
+            ++n;
+            ++p;
+        }
+        if (p == nameEnd && *n == '\0')
+            return i;
+    }
+    TINYFORMAT_RAISE_ERROR("tinyformat: Unknown argument name");
+    return -1;
+}
+
+// Parse width or precision `n` from format string pointer `c`, and advance it
+// to the next character. If an indirection is requested with `*`, `fromArg`
+// is set and the argument to read is recorded in `argRef`: -1 for the next
+// argument, or `m-1` for "*m$" or the index of the name for "*(name)" in
+// positional mode.  Returns true if one or more characters were read.
+TINYFORMAT_CONSTEXPR14 inline bool parseWidthOrPrecision(int& n, int& argRef, bool& fromArg,
+                                                         const char*& c, bool positionalMode,
+                                                         const ArgNames* names = NULL)
+{
+    if (*c >= '0' && *c <= '9') {
+        n = parseIntAndAdvance(c);
+    }
+    else if (*c == '*') {
+        ++c;
+        n = 0;
+        if (positionalMode && *c == '(') {
+            int pos = parseArgName(c, names);
+            if (pos >= 0) {
+                argRef = pos;
+                fromArg = true;
+            }
+        }
+        else if (positionalMode) {
+            int pos = parseIntAndAdvance(c) - 1;
+            if (*c != '$') {
+                TINYFORMAT_RAISE_ERROR("tinyformat: Non-positional argument used after a positional one");
+            }
+            else if (pos < 0) {
+                TINYFORMAT_RAISE_ERROR("tinyformat: Positional argument out of range");
+            }
+            else {
+                argRef = pos;
+                fromArg = true;
+            }
+            ++c;
+        }
+        else {
+            argRef = -1;
+            fromArg = true;
+        }
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Return a pointer to the first '%' or '\0' at or after c.
+TINYFORMAT_FUNC const char* findPercentOrNul(const char* c);
+
+// Print literal part of format string and return next format spec position.
+//
+// Skips over any occurrences of '%%', printing a literal '%' to the output.
+// The position of the first % character of the next nontrivial format spec is
+// returned, or the end of string.
+TINYFORMAT_FUNC const char* printFormatStringLiteral(std::ostream& out, const char* fmt);
+
+
+// Parsed form of a single conversion specification.
+//
+// Width and precision given literally in the format string are stored
+// directly; those read from the argument list with `*` or `*m$` are recorded
+// as argument references which are resolved when the spec is formatted.
+struct FormatSpec
+{
+    enum Flags
+    {
+        Flag_Left         = 1 << 0,  // '-'
+        Flag_Plus         = 1 << 1,  // '+'
+        Flag_Space        = 1 << 2,  // ' '
+        Flag_Alt          = 1 << 3,  // '#'
+        Flag_Zero         = 1 << 4,  // '0'
+        Flag_WidthSet     = 1 << 5,
+        Flag_WidthArg     = 1 << 6,  // width read from argument list
+        Flag_PrecisionSet = 1 << 7,
+        Flag_PrecisionArg = 1 << 8   // precision read from argument list
+    };
+
+    TINYFORMAT_CONSTEXPR14 FormatSpec()
+        : argIndex(-1), width(0), widthArg(-1),
+        precision(0), precisionArg(-1), flags(0), conversion('\0')
+    { }
+
+    int argIndex;      // Positional argument index, or -1 for the next argument
+    int width;
+    int widthArg;      // Positional index for `*m$`, or -1 for the next argument
+    int precision;
+    int precisionArg;  // As for widthArg
+    unsigned short flags;
+    char conversion;   // Conversion specifier character
+};
+
+
+// Parse a format spec into `spec`, leaving the stream untouched.
+//
+// The format mini-language recognized here is meant to be the one from C99,
+// with the form "%[flags][width][.precision][length]type" with POSIX
+// positional arguments extension.
+//
+// POSIX positional arguments extension:
+// Conversions can be applied to the nth argument after the format in
+// the argument list, rather than to the next unused argument. In this case,
+// the conversion specifier character % (see below) is replaced by the sequence
+// "%n$", where n is a decimal integer in the range [1,{NL_ARGMAX}],
+// giving the position of the argument in the argument list. This feature
+// provides for the definition of format strings that select arguments
+// in an order appropriate to specific languages.
+//
+// The format can contain either numbered argument conversion specifications
+// (that is, "%n$" and "*m$"), or unnumbered argument conversion specifications
+// (that is, % and * ), but not both. The only exception to this is that %%
+// can be mixed with the "%n$" form. The results of mixing numbered and
+// unnumbered argument specifications in a format string are undefined.
+// When numbered argument specifications are used, specifying the Nth argument
+// requires that all the leading arguments, from the first to the (N-1)th,
+// are specified in the format string.
+//
+// In format strings containing the "%n$" form of conversion specification,
+// numbered arguments in the argument list can be referenced from the format
+// string as many times as required.
+//
+// As an extension, "%(name)" and "*(name)" refer to arguments by name in the
+// same way as "%n$" and "*m$", when the argument names are given in `names`.
+//
+// Errors which can be detected from the format string alone are reported
+// here; argument indices are range checked in streamStateFromSpec().  The
+// function returns a pointer to the character after the end of the current
+// format spec.
+TINYFORMAT_CONSTEXPR14 inline const char* parseFormatSpec(FormatSpec& spec, bool& positionalMode,
+                                                          const char* fmtStart,
+                                                          const ArgNames* names = NULL)
+{
+    TINYFORMAT_ASSERT(*fmtStart == '%');
+    const char* c = fmtStart + 1;
+
+    // 1) Parse an argument index (if followed by '$') or a width possibly
+    // preceded with '0' flag.
+    if (*c >= '0' && *c <= '9') {
+        const char tmpc = *c;
+        int value = parseIntAndAdvance(c);
+        if (*c == '$') {
+            // value is an argument index
+            if (value > 0)
+                spec.argIndex = value - 1;
+            else
+                TINYFORMAT_RAISE_ERROR("tinyformat: Positional argument out of range");
+            ++c;
+            positionalMode = true;
+        }
+        else if (positionalMode) {
+            TINYFORMAT_RAISE_ERROR("tinyformat: Non-positional argument used after a positional one");
+        }
+        else {
+            if (tmpc == '0')
+                spec.flags |= FormatSpec::Flag_Zero;
+            if (value != 0) {
+                // Nonzero value means that we parsed width.
+                spec.flags |= FormatSpec::Flag_WidthSet;
+                spec.width = value;
+            }
+        }
+    }
+    else if (*c == '(') {
+        // Named argument, which is positional
+        int index = parseArgName(c, names);
+        if (index >= 0)
+            spec.argIndex = index;
+        positionalMode = true;
+    }
+    else if (positionalMode) {
+        TINYFORMAT_RAISE_ERROR("tinyformat: Non-positional argument used after a positional one");
+    }
+    // 2) Parse flags and width if we did not do it in previous step.
+    if (!(spec.flags & FormatSpec::Flag_WidthSet)) {
+        // Parse flags
+        for (;; ++c) {
+            switch (*c) {
+                case '#': spec.flags |= FormatSpec::Flag_Alt;   continue;
+                case '0': spec.flags |= FormatSpec::Flag_Zero;  continue;
+                case '-': spec.flags |= FormatSpec::Flag_Left;  continue;
+                case ' ': spec.flags |= FormatSpec::Flag_Space; continue;
+                case '+': spec.flags |= FormatSpec::Flag_Plus;  continue;
+                default:
+                    break;
+            }
+            break;
+        }
+        // Parse width
+        bool fromArg = false;
+        if (parseWidthOrPrecision(spec.width, spec.widthArg, fromArg, c, positionalMode, names)) {
+            spec.flags |= FormatSpec::Flag_WidthSet;
+            if (fromArg)
+                spec.flags |= FormatSpec::Flag_WidthArg;
+        }
+    }
+    // 3) Parse precision
+    if (*c == '.') {
+        ++c;
+        spec.flags |= FormatSpec::Flag_PrecisionSet;
+        bool fromArg = false;
+        parseWidthOrPrecision(spec.precision, spec.precisionArg, fromArg, c, positionalMode,
+                              names);
+        if (fromArg)
+            spec.flags |= FormatSpec::Flag_PrecisionArg;
+    }
+    // 4) Ignore any C99 length modifier
+    while (*c == 'l' || *c == 'h' || *c == 'L' ||
+           *c == 'j' || *c == 'z' || *c == 't') {
+        ++c;
+    }
+    // 5) We're up to the conversion specifier character.
+    spec.conversion = *c;
+    switch (*c) {
+        case 'n':
+            // Not supported - will cause problems!
+            TINYFORMAT_RAISE_ERROR("tinyformat: %n conversion spec not supported");
+            break;
+        case '\0':
+            TINYFORMAT_RAISE_ERROR("tinyformat: Conversion spec incorrectly "
+                             "terminated by end of string");
+            return c;
+        default:
+            break;
+    }
+    return c+1;
+}
+
+
+// Resolve a width or precision which is read from the argument list.  On
+// return, `n` holds the value and argIndex is advanced past the argument if
+// it was used in sequential mode.
+TINYFORMAT_FUNC bool resolveWidthOrPrecision(int& n, int argRef,
+                                             const detail::FormatArg* args,
+                                             int& argIndex, int numArgs);
+
+
+// Set the stream state according to a parsed format spec.
+//
+// Formatting options which can't be natively represented using the ostream
+// state are returned in spacePadPositive (for space padded positive numbers)
+// and ntrunc (for truncating conversions).  argIndex is set to the argument
+// to be formatted, reading any variable width and precision from the
+// argument list on the way.  Returns false if the spec refers to arguments
+// which are out of range.
+TINYFORMAT_FUNC bool streamStateFromSpec(std::ostream& out, bool& spacePadPositive,
+                                         int& ntrunc, const FormatSpec& spec,
+                                         const detail::FormatArg* args,
+                                         int& argIndex, int numArgs);
+
+
+// Stream buffer which collects output in a fixed size internal array,
+// switching to heap storage only if the output grows too large for it.
+class StackStreambuf : public std::streambuf
+{
+    public:
+        StackStreambuf()
+            : m_heap(NULL)
+        {
+            setp(m_stack, m_stack + sizeof(m_stack));
+        }
+
+        ~StackStreambuf() { delete[] m_heap; }
+
+        char* data() { return pbase(); }
+        const char* data() const { return pbase(); }
+        std::size_t size() const { return static_cast<std::size_t>(pptr() - pbase()); }
+        std::string str() const { return std::string(data(), size()); }
+
+        // Remove the contents, keeping any heap storage for reuse.
+        void clear() { setp(pbase(), epptr()); }
+
+    protected:
+        virtual int_type overflow(int_type c)
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof()))
+                return traits_type::not_eof(c);
+            reserve(size() + 1);
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+            return c;
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize n)
+        {
+            if (n > epptr() - pptr())
+                reserve(size() + static_cast<std::size_t>(n));
+            traits_type::copy(pptr(), s, static_cast<std::size_t>(n));
+            pbump(static_cast<int>(n));
+            return n;
+        }
+
+    private:
+        // Not copyable
+        StackStreambuf(const StackStreambuf&);
+        StackStreambuf& operator=(const StackStreambuf&);
+
+        void reserve(std::size_t newSize)
+        {
+            std::size_t oldSize = size();
+            std::size_t capacity = static_cast<std::size_t>(epptr() - pbase());
+            if (newSize <= capacity)
+                return;
+            capacity = (std::max)(2*capacity, newSize);
+            char* heap = new char[capacity];
+            traits_type::copy(heap, pbase(), oldSize);
+            delete[] m_heap;
+            m_heap = heap;
+            setp(m_heap, m_heap + capacity);
+            pbump(static_cast<int>(oldSize));
+        }
+
+        char* m_heap;
+        char m_stack[256];
+};
+
+
+// Format the argument selected by `spec` into the stream, where
+// [fmtBegin,fmtEnd) is the text of the spec.  Returns false if the argument
+// list doesn't match the spec.
+TINYFORMAT_FUNC bool formatSpecArg(std::ostream& out, const FormatSpec& spec,
+                                   const char* fmtBegin, const char* fmtEnd,
+                                   const detail::FormatArg* args,
+                                   int& argIndex, int numArgs);
+
+
+// Saves the parts of the stream state which formatting changes, and restores
+// them on destruction.
+class StreamStateSaver
+{
+    public:
+        explicit StreamStateSaver(std::ostream& out)
+            : m_out(out),
+            m_width(out.width()),
+            m_precision(out.precision()),
+            m_flags(out.flags()),
+            m_fill(out.fill())
+        { }
+
+        ~StreamStateSaver()
+        {
+            m_out.width(m_width);
+            m_out.precision(m_precision);
+            m_out.flags(m_flags);
+            m_out.fill(m_fill);
+        }
+
+    private:
+        StreamStateSaver(const StreamStateSaver&);
+        StreamStateSaver& operator=(const StreamStateSaver&);
+
+        std::ostream& m_out;
+        std::streamsize m_width;
+        std::streamsize m_precision;
+        std::ios::fmtflags m_flags;
+        char m_fill;
+};
+
+
+//------------------------------------------------------------------------------
+// Format using the format string fmt.  The stream state is left as set up
+// for the last conversion; callers which don't own the stream should restore
+// it with a StreamStateSaver.
+TINYFORMAT_FUNC void formatImpl(std::ostream& out, const char* fmt,
+                                const detail::FormatArg* args,
+                                int numArgs);
+
+
+// Stream buffer which writes into a fixed size array.  Output which doesn't
+// fit is discarded, but still counted by size().
+class ArrayStreambuf : public std::streambuf
+{
+    public:
+        ArrayStreambuf(char* buf, std::size_t n)
+            : m_discarded(0)
+        {
+            setp(buf, buf + n);
+        }
+
+        /// Total number of characters written, including discarded ones.
+        std::size_t size() const
+        {
+            return static_cast<std::size_t>(pptr() - pbase()) + m_discarded;
+        }
+
+    protected:
+        virtual int_type overflow(int_type c)
+        {
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+                ++m_discarded;
+            return traits_type::not_eof(c);
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize n)
+        {
+            std::streamsize k = (std::min)(n, static_cast<std::streamsize>(epptr() - pptr()));
+            traits_type::copy(pptr(), s, static_cast<std::size_t>(k));
+            pbump(static_cast<int>(k));
+            m_discarded += static_cast<std::size_t>(n - k);
+            return n;
+        }
+
+    private:
+        std::size_t m_discarded;
+};
+
+
+// Stream buffer which writes to an output iterator, via a small buffer to
+// avoid a virtual call per character.
+template<typename OutputIt>
+class OutputIteratorStreambuf : public std::streambuf
+{
+    public:
+        explicit OutputIteratorStreambuf(OutputIt it)
+            : m_it(it)
+        {
+            setp(m_buf, m_buf + sizeof(m_buf));
+        }
+
+        /// Flush any buffered output and return the iterator one past the
+        /// last character written.
+        OutputIt finish()
+        {
+            flushBuffer();
+            return m_it;
+        }
+
+    protected:
+        virtual int_type overflow(int_type c)
+        {
+            flushBuffer();
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+    private:
+        void flushBuffer()
+        {
+            m_it = std::copy(pbase(), pptr(), m_it);
+            setp(m_buf, m_buf + sizeof(m_buf));
+        }
+
+        OutputIt m_it;
+        char m_buf[128];
+};
+
+
+// Stream buffer which appends to a std::string, making use of any capacity
+// it already has.
+class StringAppendStreambuf : public std::streambuf
+{
+    public:
+        explicit StringAppendStreambuf(std::string& str)
+            : m_str(str)
+        { }
+
+    protected:
+        virtual int_type overflow(int_type c)
+        {
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+                m_str.push_back(traits_type::to_char_type(c));
+            return traits_type::not_eof(c);
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize n)
+        {
+            m_str.append(s, static_cast<std::size_t>(n));
+            return n;
+        }
+
+    private:
+        std::string& m_str;
+};
+
+
+// A span of literal text in a pre-parsed format string, followed by the
+// conversion spec occupying [literalEnd,specEnd).  Offsets are relative to the
+// start of the format string.  For "%%" the first '%' ends the literal and
+// the second is skipped as a spec with conversion '%'.
+struct FormatSegment
+{
+    TINYFORMAT_CONSTEXPR14 FormatSegment()
+        : literalBegin(0), literalEnd(0), specEnd(0)
+    { }
+
+    int literalBegin;
+    int literalEnd;
+    int specEnd;
+    FormatSpec spec;
+};
+
+
+// Parse the segment of format string `fmt` with literal text starting at
+// `literal`, where `c` is the first '%' or '\0' after it, and advance `c`
+// past the segment.  Returns false if there are no more conversion specs,
+// leaving `c` at the start of the trailing literal text.
+TINYFORMAT_CONSTEXPR14 inline bool parseFormatSegmentAt(FormatSegment& seg, bool& positionalMode,
+                                                        const char* fmt, const char* literal,
+                                                        const char*& c,
+                                                        const ArgNames* names = NULL)
+{
+    if (*c == '\0') {
+        c = literal;
+        return false;
+    }
+    seg.literalBegin = static_cast<int>(literal - fmt);
+    if (*(c+1) == '%') {
+        // "%%" - keep the first '%' with the literal text
+        seg.literalEnd = static_cast<int>(c + 1 - fmt);
+        seg.spec.conversion = '%';
+        c += 2;
+    }
+    else {
+        seg.literalEnd = static_cast<int>(c - fmt);
+        c = parseFormatSpec(seg.spec, positionalMode, c, names);
+    }
+    seg.specEnd = static_cast<int>(c - fmt);
+    return true;
+}
+
+// As parseFormatSegmentAt(), for a segment starting at `c`.
+TINYFORMAT_CONSTEXPR14 inline bool parseFormatSegment(FormatSegment& seg, bool& positionalMode,
+                                                      const char* fmt, const char*& c)
+{
+    const char* literal = c;
+    while (*c != '\0' && *c != '%')
+        ++c;
+    return parseFormatSegmentAt(seg, positionalMode, fmt, literal, c);
+}
+
+
+// Update the number of arguments required by a format string to include
+// those used by `seg`.  In positional mode this is the largest argument
+// index referenced, otherwise the count of arguments consumed.
+TINYFORMAT_CONSTEXPR14 inline void countSegmentArgs(int& numArgs, const FormatSegment& seg,
+                                                    bool positionalMode)
+{
+    const FormatSpec& spec = seg.spec;
+    if (spec.conversion == '%')
+        return;
+    const bool widthArg = (spec.flags & FormatSpec::Flag_WidthArg) != 0;
+    const bool precisionArg = (spec.flags & FormatSpec::Flag_PrecisionArg) != 0;
+    if (positionalMode) {
+        if (spec.argIndex >= numArgs)
+            numArgs = spec.argIndex + 1;
+        if (widthArg && spec.widthArg >= numArgs)
+            numArgs = spec.widthArg + 1;
+        if (precisionArg && spec.precisionArg >= numArgs)
+            numArgs = spec.precisionArg + 1;
+    }
+    else {
+        numArgs += 1 + (widthArg ? 1 : 0) + (precisionArg ? 1 : 0);
+    }
+}
+
+
+// Format using a sequence of segments from a pre-parsed format string.  As for
+// formatImpl(), the stream state is not restored.
+TINYFORMAT_FUNC void formatSegmentsImpl(std::ostream& out, const char* fmt,
+                                        const FormatSegment* segments, int numSegments,
+                                        int tailBegin, int tailEnd, bool positionalMode,
+                                        const detail::FormatArg* args, int numArgs);
+
+} // namespace detail
+
+
+class CompiledFormat;
+class Formatter;
+namespace detail { class BatchWriter; class BufferAppendStreambuf; }
+#ifdef TINYFORMAT_USE_CONSTEXPR_PARSER
+template<typename FmtT> struct StaticFormat;
+#endif
+
+/// List of template arguments format(), held in a type-opaque way.
+///
+/// A const reference to FormatList (typedef'd as FormatListRef) may be
+/// conveniently used to pass arguments to non-template functions: All type
+/// information has been stripped from the arguments, leaving just enough of a
+/// common interface to perform formatting as required.
+class FormatList
+{
+    public:
+        FormatList(detail::FormatArg* args, int N)
+            : m_args(args), m_N(N) { }
+
+        friend void vformat(std::ostream& out, const char* fmt,
+                            const FormatList& list);
+        friend void vformat(std::ostream& out, const CompiledFormat& fmt,
+                            const FormatList& list);
+#ifdef TINYFORMAT_USE_CONSTEXPR_PARSER
+        template<typename FmtT>
+        friend void vformat(std::ostream& out, StaticFormat<FmtT> fmt,
+                            const FormatList& list);
+#endif
+        friend void vserialize_format(Buffer& out, std::size_t id,
+                                      const FormatList& list);
+        friend class Formatter;
+        friend class detail::BatchWriter;
+
+    private:
+        const detail::FormatArg* m_args;
+        int m_N;
+};
+
+/// Reference to type-opaque format list for passing to vformat()
+typedef const FormatList& FormatListRef;
+
+
+namespace detail {
+
+// Format list subclass with fixed storage to avoid dynamic allocation
+template<std::size_t N>
+class FormatListN : public FormatList
+{
+    public:
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+        template<typename... Args>
+        FormatListN(const Args&... args)
+            : FormatList(&m_formatterStore[0], N),
+            m_formatterStore { FormatArg(args)... }
+        { static_assert(sizeof...(args) == N, "Number of args must be N"); }
+#else // C++98 version
+        void init(int) {}
+#       define TINYFORMAT_MAKE_FORMATLIST_CONSTRUCTOR(n)                \
+                                                                        \
+        template<TINYFORMAT_ARGTYPES(n)>                                \
+        FormatListN(TINYFORMAT_VARARGS(n))                              \
+            : FormatList(&m_formatterStore[0], n)                       \
+        { TINYFORMAT_ASSERT(n == N); init(0, TINYFORMAT_PASSARGS(n)); } \
+                                                                        \
+        template<TINYFORMAT_ARGTYPES(n)>                                \
+        void init(int i, TINYFORMAT_VARARGS(n))                         \
+        {                                                               \
+            m_formatterStore[i] = FormatArg(v1);                        \
+            init(i+1 TINYFORMAT_PASSARGS_TAIL(n));                      \
+        }
+
+        TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_FORMATLIST_CONSTRUCTOR)
+#       undef TINYFORMAT_MAKE_FORMATLIST_CONSTRUCTOR
+#endif
+        FormatListN(const FormatListN& other)
+            : FormatList(&m_formatterStore[0], N)
+        { std::copy(&other.m_formatterStore[0], &other.m_formatterStore[N],
+                    &m_formatterStore[0]); }
+
+    private:
+        FormatArg m_formatterStore[N];
+};
+
+// Special 0-arg version - MSVC says zero-sized C array in struct is nonstandard
+template<> class FormatListN<0> : public FormatList
+{
+    public: FormatListN() : FormatList(0, 0) {}
+};
+
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+template<int... Is> struct IntSequence {};
+template<int N, int... Is>
+struct MakeIntSequence : MakeIntSequence<N-1, N-1, Is...> {};
+template<int... Is>
+struct MakeIntSequence<0, Is...> { typedef IntSequence<Is...> type; };
+#endif
+
+
+// Copy of string data owned by a FormatArgStore, which formats as a
+// std::string would.  Strings of up to sizeof(m_buf) characters are held
+// without allocation.
+class StoredString
+{
+    public:
+        StoredString(const char* s) { init(s, s ? std::strlen(s) : 0); }
+        StoredString(const std::string& s) { init(s.data(), s.size()); }
+#ifdef TINYFORMAT_HAS_STRING_VIEW
+        StoredString(std::string_view s) { init(s.data(), s.size()); }
+#endif
+        StoredString(const StoredString& other) { init(other.m_data, other.m_size); }
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+        StoredString(StoredString&& other) noexcept
+            : m_size(other.m_size)
+        {
+            if (other.m_data == other.m_buf) {
+                std::memcpy(m_buf, other.m_buf, m_size);
+                m_data = m_buf;
+            }
+            else {
+                m_data = other.m_data;
+                other.m_data = NULL;
+            }
+        }
+#endif
+
+        ~StoredString()
+        {
+            if (m_data != m_buf)
+                delete[] m_data;
+        }
+
+        // NULL for a null C string
+        const char* data() const { return m_data; }
+        std::size_t size() const { return m_size; }
+
+    private:
+        StoredString& operator=(const StoredString&);
+
+        void init(const char* s, std::size_t n)
+        {
+            m_size = n;
+            if (!s) {
+                m_data = NULL;
+                return;
+            }
+            char* d = (n <= sizeof(m_buf)) ? m_buf : new char[n];
+            std::memcpy(d, s, n);
+            m_data = d;
+        }
+
+        const char* m_data;
+        std::size_t m_size;
+        char m_buf[16];
+};
+
+inline std::ostream& operator<<(std::ostream& out, const StoredString& s)
+{
+    if (!s.data())
+        out.setstate(std::ios::badbit);  // As for operator<<(const char*)
+    else
+        writePadded(out, s.data(), static_cast<std::streamsize>(s.size()));
+    return out;
+}
+
+
+// The type used by FormatArgStore to hold a copy of an argument of type T.
+// Strings are copied into a StoredString, which owns its characters; other
+// arrays decay to pointers as they would in a call to printf().
+template<typename T> struct StoredArgType { typedef T type; };
+template<typename T> struct StoredArgType<volatile T> { typedef T type; };
+template<typename T, std::size_t N> struct StoredArgType<T[N]> { typedef const T* type; };
+template<std::size_t N> struct StoredArgType<char[N]> { typedef StoredString type; };
+template<> struct StoredArgType<char*> { typedef StoredString type; };
+template<> struct StoredArgType<const char*> { typedef StoredString type; };
+template<> struct StoredArgType<std::string> { typedef StoredString type; };
+#ifdef TINYFORMAT_HAS_STRING_VIEW
+template<> struct StoredArgType<std::string_view> { typedef StoredString type; };
+#endif
+
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+// The type used to hold an argument of type T which is moved into a
+// FormatArgStore.  A std::string temporary is kept as it is, which moves
+// its characters rather than copying them, and fits in an inline slot.
+template<typename T> struct MovedArgType { typedef typename StoredArgType<T>::type type; };
+template<> struct MovedArgType<std::string> { typedef std::string type; };
+
+// The stored type for an argument passed as a forwarding reference T&&
+template<typename T>
+struct ForwardedArgType
+{
+    typedef typename std::remove_cv<typename std::remove_reference<T>::type>::type value_type;
+    typedef typename std::conditional<std::is_lvalue_reference<T>::value,
+                                      typename StoredArgType<value_type>::type,
+                                      typename MovedArgType<value_type>::type>::type type;
+};
+#endif
+
+
+template<typename T>
+struct alignmentOf
+{
+    struct Helper { char c; T t; };
+    static const std::size_t value = sizeof(Helper) - sizeof(T);
+};
+
+// Inline storage of an ArgSlot, big and aligned enough for any arithmetic
+// type, pointer or short StoredString.
+union ArgSlotStorage
+{
+    char buf[4*sizeof(void*)];
+    void* ptr;
+    double d;
+    long double ld;
+};
+
+// Construction and destruction of a T held in ArgSlotStorage, inline
+// if it fits or on the heap otherwise.  move() leaves a moved from value in
+// src to be destroyed as usual.
+template<typename T, bool isInline = (sizeof(T) <= sizeof(ArgSlotStorage) &&
+                                      alignmentOf<T>::value <= alignmentOf<ArgSlotStorage>::value)>
+struct ArgSlotOps
+{
+    static const T& get(const ArgSlotStorage& s) { return *reinterpret_cast<const T*>(s.buf); }
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+    static const bool nothrowMove = std::is_nothrow_move_constructible<T>::value;
+    template<typename U>
+    static void create(ArgSlotStorage& s, U&& value) { new (s.buf) T(std::forward<U>(value)); }
+    static void move(ArgSlotStorage& s, ArgSlotStorage& src)
+    {
+        new (s.buf) T(std::move(*reinterpret_cast<T*>(src.buf)));
+    }
+#else
+    static const bool nothrowMove = false;
+    template<typename U>
+    static void create(ArgSlotStorage& s, const U& value) { new (s.buf) T(value); }
+    static void move(ArgSlotStorage& s, ArgSlotStorage& src) { create(s, get(src)); }
+#endif
+    static void destroy(ArgSlotStorage& s) { reinterpret_cast<T*>(s.buf)->~T(); }
+};
+
+template<typename T>
+struct ArgSlotOps<T, false>
+{
+    static const T& get(const ArgSlotStorage& s) { return *static_cast<const T*>(s.ptr); }
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+    template<typename U>
+    static void create(ArgSlotStorage& s, U&& value) { s.ptr = new T(std::forward<U>(value)); }
+#else
+    template<typename U>
+    static void create(ArgSlotStorage& s, const U& value) { s.ptr = new T(value); }
+#endif
+    static const bool nothrowMove = true;
+    static void move(ArgSlotStorage& s, ArgSlotStorage& src)
+    {
+        s.ptr = src.ptr;
+        src.ptr = NULL;
+    }
+    static void destroy(ArgSlotStorage& s) { delete static_cast<T*>(s.ptr); }
+};
+
+// Actions on the type held in an ArgSlot, with one constant table per type
+// as for FormatArgActions.  copy() and move() construct the value held in
+// src in s, returning a FormatArg which refers to it.
+struct ArgSlotActions
+{
+    FormatArg (*copy)(ArgSlotStorage& s, const ArgSlotStorage& src);
+    FormatArg (*move)(ArgSlotStorage& s, ArgSlotStorage& src);
+    void (*destroy)(ArgSlotStorage& s);
+    bool nothrowMove;
+};
+
+template<typename T>
+struct ArgSlotActionsFor
+{
+    static FormatArg copyImpl(ArgSlotStorage& s, const ArgSlotStorage& src)
+    {
+        ArgSlotOps<T>::create(s, ArgSlotOps<T>::get(src));
+        return FormatArg(ArgSlotOps<T>::get(s));
+    }
+
+    static FormatArg moveImpl(ArgSlotStorage& s, ArgSlotStorage& src)
+    {
+        ArgSlotOps<T>::move(s, src);
+        return FormatArg(ArgSlotOps<T>::get(s));
+    }
+
+    static void destroyImpl(ArgSlotStorage& s) { ArgSlotOps<T>::destroy(s); }
+
+    static const ArgSlotActions table;
+};
+
+template<typename T>
+const ArgSlotActions ArgSlotActionsFor<T>::table = {
+    &ArgSlotActionsFor<T>::copyImpl,
+    &ArgSlotActionsFor<T>::moveImpl,
+    &ArgSlotActionsFor<T>::destroyImpl,
+    ArgSlotOps<T>::nothrowMove
+};
+
+// Array which is deleted on destruction unless released.
+template<typename T>
+class ScopedArray
+{
+    public:
+        explicit ScopedArray(T* p) : m_p(p) { }
+        ~ScopedArray() { delete[] m_p; }
+
+        T* get() const { return m_p; }
+        T* release() { T* p = m_p; m_p = NULL; return p; }
+
+    private:
+        ScopedArray(const ScopedArray&);
+        ScopedArray& operator=(const ScopedArray&);
+
+        T* m_p;
+};
+
+// Owning storage for a single argument of a FormatArgStore.  As for
+// FormatArg, the operations on the type held are a pointer to a table of
+// functions, so that slots can be held in a homogeneous array.
+class ArgSlot
+{
+    public:
+        ArgSlot() : m_actions(NULL) { }
+        ~ArgSlot() { reset(); }
+
+        // Store a copy of value, or move it in if it's an rvalue, returning
+        // a FormatArg which refers to it.
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+        template<typename T>
+        FormatArg assign(T&& value)
+        {
+            typedef typename ForwardedArgType<T>::type Stored;
+            reset();
+            ArgSlotOps<Stored>::create(m_storage, std::forward<T>(value));
+            m_actions = &ArgSlotActionsFor<Stored>::table;
+            return FormatArg(ArgSlotOps<Stored>::get(m_storage));
+        }
+#else
+        template<typename T>
+        FormatArg assign(const T& value)
+        {
+            typedef typename StoredArgType<T>::type Stored;
+            reset();
+            ArgSlotOps<Stored>::create(m_storage, value);
+            m_actions = &ArgSlotActionsFor<Stored>::table;
+            return FormatArg(ArgSlotOps<Stored>::get(m_storage));
+        }
+#endif
+
+        FormatArg copyFrom(const ArgSlot& other)
+        {
+            reset();
+            if (!other.m_actions)
+                return FormatArg();
+            FormatArg arg = other.m_actions->copy(m_storage, other.m_storage);
+            m_actions = other.m_actions;
+            return arg;
+        }
+
+        // Move the value held by other into this slot.  other still holds
+        // the moved from value until it's reset.
+        FormatArg moveFrom(ArgSlot& other)
+        {
+            reset();
+            if (!other.m_actions)
+                return FormatArg();
+            FormatArg arg = other.m_actions->move(m_storage, other.m_storage);
+            m_actions = other.m_actions;
+            return arg;
+        }
+
+        // Whether moveFrom() of this slot never throws
+        bool nothrowMove() const { return !m_actions || m_actions->nothrowMove; }
+
+        void reset()
+        {
+            if (m_actions) {
+                m_actions->destroy(m_storage);
+                m_actions = NULL;
+            }
+        }
+
+    private:
+        // Not copyable; use copyFrom() so the FormatArg can be updated.
+        ArgSlot(const ArgSlot&);
+        ArgSlot& operator=(const ArgSlot&);
+
+        ArgSlotStorage m_storage;
+        const ArgSlotActions* m_actions;
+};
+
+} // namespace detail
+
+
+template<>
+struct CharRangeTraits<detail::StoredString>
+{
+    static const bool isCharRange = true;
+    static const char* data(const detail::StoredString& s) { return s.data(); }
+    static std::size_t size(const detail::StoredString& s) { return s.size(); }
+};
+
+
+/// Format list which owns copies of its arguments.
+///
+/// A FormatList refers to the caller's arguments, so can't outlive them.  A
+/// FormatArgStore instead copies each argument as it is added, so it may be
+/// kept and formatted later, possibly on another thread:
+///
+///   tfm::FormatArgStore args = tfm::makeFormatArgStore(name, 42);
+///   // ... later
+///   tfm::vformat(std::cout, "%s: %d\n", args);
+///
+/// Arithmetic values, pointers, strings of up to 16 characters and other
+/// small types are stored inline, and the first inlineCapacity arguments
+/// need no allocation.  Larger user defined types are copied to the heap.
+/// Strings (char arrays, C strings, std::string and std::string_view) are
+/// copied by value, so "%p" of a C string in the store prints its text.  In
+/// C++11, temporaries are moved into the store rather than copied, and a
+/// std::string temporary keeps its characters without copying them.
+class FormatArgStore : public FormatList
+{
+    public:
+        static const int inlineCapacity = 8;
+
+        FormatArgStore()
+            : FormatList(m_inlineArgs, 0),
+            m_args(m_inlineArgs),
+            m_slots(m_inlineSlots),
+            m_size(0),
+            m_capacity(inlineCapacity)
+        { }
+
+        FormatArgStore(const FormatArgStore& other)
+            : FormatList(m_inlineArgs, 0),
+            m_args(m_inlineArgs),
+            m_slots(m_inlineSlots),
+            m_size(0),
+            m_capacity(inlineCapacity)
+        {
+            copyFrom(other);
+        }
+
+        FormatArgStore& operator=(const FormatArgStore& other)
+        {
+            if (this != &other) {
+                clear();
+                copyFrom(other);
+            }
+            return *this;
+        }
+
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+        /// Take the arguments of other, leaving it empty.
+        FormatArgStore(FormatArgStore&& other)
+            : FormatList(m_inlineArgs, 0),
+            m_args(m_inlineArgs),
+            m_slots(m_inlineSlots),
+            m_size(0),
+            m_capacity(inlineCapacity)
+        {
+            moveFrom(other);
+        }
+
+        FormatArgStore& operator=(FormatArgStore&& other)
+        {
+            if (this != &other) {
+                clear();
+                moveFrom(other);
+            }
+            return *this;
+        }
+#endif
+
+        ~FormatArgStore()
+        {
+            clear();
+            if (m_slots != m_inlineSlots) {
+                delete[] m_args;
+                delete[] m_slots;
+            }
+        }
+
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+        /// Append value to the argument list, moving it if it's an rvalue
+        /// or copying it otherwise.
+        template<typename T>
+        void push_back(T&& value)
+        {
+            reserve(m_size + 1);
+            m_args[m_size] = m_slots[m_size].assign(std::forward<T>(value));
+            ++m_size;
+            updateList();
+        }
+#else
+        /// Append a copy of value to the argument list.
+        template<typename T>
+        void push_back(const T& value)
+        {
+            reserve(m_size + 1);
+            m_args[m_size] = m_slots[m_size].assign(value);
+            ++m_size;
+            updateList();
+        }
+#endif
+
+        /// Number of arguments held.
+        int size() const { return m_size; }
+
+        /// Remove all arguments, keeping any storage for reuse.
+        void clear()
+        {
+            for (int i = 0; i < m_size; ++i)
+                m_slots[i].reset();
+            m_size = 0;
+            updateList();
+        }
+
+    private:
+        void updateList()
+        {
+            static_cast<FormatList&>(*this) = FormatList(m_args, m_size);
+        }
+
+        void copyFrom(const FormatArgStore& other)
+        {
+            reserve(other.m_size);
+            for (; m_size < other.m_size; ++m_size)
+                m_args[m_size] = m_slots[m_size].copyFrom(other.m_slots[m_size]);
+            updateList();
+        }
+
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+        // Take the arguments of other, taking over its arrays if they're on
+        // the heap.  This store must be empty.
+        void moveFrom(FormatArgStore& other)
+        {
+            if (other.m_slots != other.m_inlineSlots) {
+                if (m_slots != m_inlineSlots) {
+                    delete[] m_args;
+                    delete[] m_slots;
+                }
+                m_args = other.m_args;
+                m_slots = other.m_slots;
+                m_size = other.m_size;
+                m_capacity = other.m_capacity;
+                other.m_args = other.m_inlineArgs;
+                other.m_slots = other.m_inlineSlots;
+                other.m_capacity = inlineCapacity;
+                other.m_size = 0;
+            }
+            else {
+                reserve(other.m_size);
+                for (; m_size < other.m_size; ++m_size)
+                    m_args[m_size] = m_slots[m_size].moveFrom(other.m_slots[m_size]);
+            }
+            other.clear();
+            updateList();
+        }
+#endif
+
+        void reserve(int n)
+        {
+            if (n <= m_capacity)
+                return;
+            int capacity = (std::max)(2*m_capacity, n);
+            detail::ScopedArray<detail::FormatArg> args(new detail::FormatArg[capacity]);
+            detail::ScopedArray<detail::ArgSlot> slots(new detail::ArgSlot[capacity]);
+            // Copy the values which might throw when moved first, so that
+            // this store is unchanged if that fails.
+            for (int i = 0; i < m_size; ++i) {
+                if (!m_slots[i].nothrowMove())
+                    args.get()[i] = slots.get()[i].copyFrom(m_slots[i]);
+            }
+            for (int i = 0; i < m_size; ++i) {
+                if (m_slots[i].nothrowMove())
+                    args.get()[i] = slots.get()[i].moveFrom(m_slots[i]);
+            }
+            for (int i = 0; i < m_size; ++i)
+                m_slots[i].reset();
+            if (m_slots != m_inlineSlots) {
+                delete[] m_args;
+                delete[] m_slots;
+            }
+            m_args = args.release();
+            m_slots = slots.release();
+            m_capacity = capacity;
+            updateList();
+        }
+
+        detail::FormatArg* m_args;
+        detail::ArgSlot* m_slots;
+        int m_size;
+        int m_capacity;
+        detail::FormatArg m_inlineArgs[inlineCapacity];
+        detail::ArgSlot m_inlineSlots[inlineCapacity];
+};
+
+
+/// Format list referring to the elements of a container, for argument lists
+/// whose length is only known at run time, such as table rows with a varying
+/// number of columns:
+///
+///   std::vector<double> row = /* ... */;
+///   tfm::vformat(std::cout, rowFmt, tfm::DynamicFormatList(row));
+///
+/// As for FormatList, the elements are referred to rather than copied, so
+/// they must outlive the list, and dereferencing the iterators must give a
+/// reference to the element itself (which rules out std::vector<bool>).  Use
+/// a FormatArgStore for arguments of mixed types or which need copying.  The
+/// first inlineCapacity elements need no allocation.
+class DynamicFormatList : public FormatList
+{
+    public:
+        static const int inlineCapacity = 16;
+
+        /// Refer to the elements of c, from c.begin() to c.end().
+        template<typename Container>
+        explicit DynamicFormatList(const Container& c)
+            : FormatList(m_inlineArgs, 0),
+            m_heapArgs(NULL),
+            m_size(0)
+        {
+            init(c.begin(), c.end());
+        }
+
+        template<typename T, std::size_t N>
+        explicit DynamicFormatList(const T (&a)[N])
+            : FormatList(m_inlineArgs, 0),
+            m_heapArgs(NULL),
+            m_size(0)
+        {
+            init(a, a + N);
+        }
+
+        /// Refer to the elements in the range [begin, end).
+        template<typename Iter>
+        DynamicFormatList(Iter begin, Iter end)
+            : FormatList(m_inlineArgs, 0),
+            m_heapArgs(NULL),
+            m_size(0)
+        {
+            init(begin, end);
+        }
+
+        DynamicFormatList(const DynamicFormatList& other)
+            : FormatList(m_inlineArgs, 0),
+            m_heapArgs(NULL),
+            m_size(0)
+        {
+            copyFrom(other);
+        }
+
+        DynamicFormatList& operator=(const DynamicFormatList& other)
+        {
+            if (this != &other)
+                copyFrom(other);
+            return *this;
+        }
+
+        ~DynamicFormatList() { delete[] m_heapArgs; }
+
+        /// Number of arguments referred to.
+        int size() const { return m_size; }
+
+    private:
+        template<typename Iter>
+        void init(Iter begin, Iter end)
+        {
+            int n = 0;
+            for (Iter i = begin; i != end; ++i)
+                ++n;
+            detail::FormatArg* args = allocate(n);
+            for (; begin != end; ++begin)
+                args[m_size++] = detail::FormatArg(*begin);
+            updateList();
+        }
+
+        void copyFrom(const DynamicFormatList& other)
+        {
+            const detail::FormatArg* src = other.args();
+            std::copy(src, src + other.m_size, allocate(other.m_size));
+            m_size = other.m_size;
+            updateList();
+        }
+
+        // Storage for n arguments, discarding the current ones
+        detail::FormatArg* allocate(int n)
+        {
+            delete[] m_heapArgs;
+            m_heapArgs = NULL;
+            m_size = 0;
+            if (n > inlineCapacity)
+                m_heapArgs = new detail::FormatArg[n];
+            return args();
+        }
+
+        detail::FormatArg* args() { return m_heapArgs ? m_heapArgs : m_inlineArgs; }
+        const detail::FormatArg* args() const { return m_heapArgs ? m_heapArgs : m_inlineArgs; }
+
+        void updateList()
+        {
+            static_cast<FormatList&>(*this) = FormatList(args(), m_size);
+        }
+
+        detail::FormatArg* m_heapArgs;
+        int m_size;
+        detail::FormatArg m_inlineArgs[inlineCapacity];
+};
+
+
+
+/// Format string which has been parsed ahead of time.
+///
+/// Parsing splits the format string into literal text and conversion specs
+/// once, so that repeated formatting with vformat() or format() doesn't need
+/// to scan the string again.  Errors in the format string itself are reported
+/// via TINYFORMAT_ERROR during construction; errors which depend on the
+/// arguments are reported when formatting.  The format string is copied, so
+/// the CompiledFormat doesn't depend on the lifetime of `fmt`.
+class CompiledFormat
+{
+    public:
+        explicit CompiledFormat(const char* fmt)
+            : m_fmt(fmt),
+            m_tailBegin(0),
+            m_positionalMode(false),
+            m_numArgs(0)
+        {
+            parse(NULL);
+        }
+
+        /// Parse a format string which may refer to arguments by name, as
+        /// "%(name)s", or "*(name)" for a variable width or precision.
+        /// names[i] is the name of argument i.  Names are resolved to
+        /// argument indices here, so formatting costs the same as for "%n$"
+        /// positional arguments, and unknown names are reported at
+        /// construction.  The names needn't outlive the constructor call.
+        CompiledFormat(const char* fmt, const char* const* names, int numNames)
+            : m_fmt(fmt),
+            m_tailBegin(0),
+            m_positionalMode(false),
+            m_numArgs(0)
+        {
+            detail::ArgNames argNames = { names, numNames };
+            parse(&argNames);
+        }
+
+        template<std::size_t N>
+        CompiledFormat(const char* fmt, const char* const (&names)[N])
+            : m_fmt(fmt),
+            m_tailBegin(0),
+            m_positionalMode(false),
+            m_numArgs(0)
+        {
+            detail::ArgNames argNames = { names, static_cast<int>(N) };
+            parse(&argNames);
+        }
+
+        /// Number of arguments consumed by the format string.  In positional
+        /// mode, this is the largest argument index referenced.
+        int numArgs() const { return m_numArgs; }
+
+    private:
+        friend void vformat(std::ostream& out, const CompiledFormat& fmt,
+                            const FormatList& list);
+        friend class Formatter;
+        friend class detail::BatchWriter;
+
+        void parse(const detail::ArgNames* names);
+
+        std::string m_fmt;
+        std::vector<detail::FormatSegment> m_segments;
+        int m_tailBegin;
+        bool m_positionalMode;
+        int m_numArgs;
+};
+
+
+/// Growable character buffer for formatted output.
+///
+/// Unlike std::string, a Buffer exposes its capacity and clear() keeps the
+/// storage, so a buffer reused for many formatting calls allocates only
+/// while it grows.  Output of up to inlineCapacity characters is kept in the
+/// object itself:
+///
+///   tfm::Buffer buf;
+///   for (...) {
+///       buf.clear();
+///       tfm::append_format(buf, "%s=%d\n", key, value);
+///       write(fd, buf.data(), buf.size());
+///   }
+///
+/// The contents are not null terminated.
+class Buffer
+{
+    public:
+        static const std::size_t inlineCapacity = 256;
+
+        Buffer()
+            : m_data(m_inline),
+            m_size(0),
+            m_capacity(inlineCapacity)
+        { }
+
+        ~Buffer()
+        {
+            if (m_data != m_inline)
+                delete[] m_data;
+        }
+
+        char* data() { return m_data; }
+        const char* data() const { return m_data; }
+        std::size_t size() const { return m_size; }
+        std::size_t capacity() const { return m_capacity; }
+        bool empty() const { return m_size == 0; }
+        std::string str() const { return std::string(m_data, m_size); }
+
+        /// Remove the contents, keeping the storage for reuse.
+        void clear() { m_size = 0; }
+
+        /// Make sure the capacity is at least n characters.
+        void reserve(std::size_t n)
+        {
+            if (n <= m_capacity)
+                return;
+            std::size_t capacity = (std::max)(2*m_capacity, n);
+            char* data = new char[capacity];
+            std::memcpy(data, m_data, m_size);
+            if (m_data != m_inline)
+                delete[] m_data;
+            m_data = data;
+            m_capacity = capacity;
+        }
+
+        void append(const char* s, std::size_t n)
+        {
+            reserve(m_size + n);
+            std::memcpy(m_data + m_size, s, n);
+            m_size += n;
+        }
+
+        void push_back(char c)
+        {
+            reserve(m_size + 1);
+            m_data[m_size++] = c;
+        }
+
+    private:
+        friend class detail::BufferAppendStreambuf;
+
+        // Not copyable
+        Buffer(const Buffer&);
+        Buffer& operator=(const Buffer&);
+
+        char* m_data;
+        std::size_t m_size;
+        std::size_t m_capacity;
+        char m_inline[inlineCapacity];
+};
+
+
+namespace detail {
+
+// Stream buffer which appends to a Buffer, writing straight into its spare
+// capacity.  The size of the Buffer is updated on sync() and destruction.
+class BufferAppendStreambuf : public std::streambuf
+{
+    public:
+        explicit BufferAppendStreambuf(Buffer& buf)
+            : m_buf(buf)
+        {
+            resetPut();
+        }
+
+        ~BufferAppendStreambuf() { commit(); }
+
+    protected:
+        virtual int_type overflow(int_type c)
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof()))
+                return traits_type::not_eof(c);
+            grow(1);
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+            return c;
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize n)
+        {
+            if (n > epptr() - pptr())
+                grow(static_cast<std::size_t>(n));
+            traits_type::copy(pptr(), s, static_cast<std::size_t>(n));
+            pbump(static_cast<int>(n));
+            return n;
+        }
+
+        virtual int sync()
+        {
+            commit();
+            return 0;
+        }
+
+    private:
+        void commit()
+        {
+            m_buf.m_size = static_cast<std::size_t>(pptr() - m_buf.m_data);
+        }
+
+        void resetPut()
+        {
+            setp(m_buf.m_data + m_buf.m_size, m_buf.m_data + m_buf.m_capacity);
+        }
+
+        void grow(std::size_t n)
+        {
+            commit();
+            m_buf.reserve(m_buf.m_size + n);
+            resetPut();
+        }
+
+        Buffer& m_buf;
+};
+
+
+// Result type of formatting with an allocator: a string using Alloc.  Only
+// defined for allocators of char, so that the allocator overloads of format()
+// don't compete with those taking a stream.
+template<typename T> struct EnableIfChar {};
+template<> struct EnableIfChar<char> { typedef void type; };
+
+template<typename Alloc, typename Enable = void>
+struct AllocatorString {};
+
+template<typename Alloc>
+struct AllocatorString<Alloc,
+    typename EnableIfChar<typename Alloc::value_type>::type>
+{
+    typedef std::basic_string<char, std::char_traits<char>, Alloc> type;
+};
+
+} // namespace detail
+
+
+#ifdef TINYFORMAT_USE_CONSTEXPR_PARSER
+
+namespace detail {
+
+// Format string segments parsed at compile time.
+template<int N>
+struct StaticFormatSegments
+{
+    FormatSegment segments[N > 0 ? N : 1];
+    int numArgs = 0;
+    int tailBegin = 0;
+    bool positionalMode = false;
+};
+
+constexpr int countFormatSegments(const char* fmt)
+{
+    int n = 0;
+    bool positionalMode = false;
+    const char* c = fmt;
+    FormatSegment seg;
+    while (parseFormatSegment(seg, positionalMode, fmt, c)) {
+        seg = FormatSegment();
+        ++n;
+    }
+    return n;
+}
+
+template<int N>
+constexpr StaticFormatSegments<N> parseStaticFormat(const char* fmt)
+{
+    StaticFormatSegments<N> result;
+    const char* c = fmt;
+    for (int i = 0; i < N; ++i) {
+        parseFormatSegment(result.segments[i], result.positionalMode, fmt, c);
+        countSegmentArgs(result.numArgs, result.segments[i], result.positionalMode);
+    }
+    result.tailBegin = static_cast<int>(c - fmt);
+    return result;
+}
+
+constexpr int staticStrlen(const char* s)
+{
+    int n = 0;
+    while (s[n] != '\0')
+        ++n;
+    return n;
+}
+
+// Parsed form of the format string provided by FmtT::str(), held as static
+// constexpr data so that each distinct format string is parsed exactly once
+// during compilation.
+template<typename FmtT>
+struct StaticFormatData
+{
+    static constexpr int numSegments = countFormatSegments(FmtT::str());
+    static constexpr int length = staticStrlen(FmtT::str());
+    static constexpr StaticFormatSegments<numSegments> parsed =
+        parseStaticFormat<numSegments>(FmtT::str());
+};
+
+template<typename FmtT>
+constexpr int StaticFormatData<FmtT>::numSegments;
+template<typename FmtT>
+constexpr int StaticFormatData<FmtT>::length;
+template<typename FmtT>
+constexpr StaticFormatSegments<StaticFormatData<FmtT>::numSegments>
+    StaticFormatData<FmtT>::parsed;
+
+template<typename FmtT, int I>
+inline void formatStaticSegment(std::ostream& out, const FormatArg* args,
+                                int& argIndex, int numArgs, bool& ok)
+{
+    constexpr const FormatSegment& seg = StaticFormatData<FmtT>::parsed.segments[I];
+    if (!ok)
+        return;
+    const char* fmt = FmtT::str();
+    out.write(fmt + seg.literalBegin, seg.literalEnd - seg.literalBegin);
+    if (seg.spec.conversion != '%')
+        ok = formatSpecArg(out, seg.spec, fmt + seg.literalEnd, fmt + seg.specEnd,
+                           args, argIndex, numArgs);
+}
+
+// Format using the compile time parse of FmtT, as a sequence of calls - one
+// for each segment of the format string - with the spec of each segment
+// known to the compiler.
+template<typename FmtT, int... Is>
+inline void formatStaticImpl(std::ostream& out, IntSequence<Is...>,
+                             const FormatArg* args, int numArgs)
+{
+    typedef StaticFormatData<FmtT> Data;
+    int argIndex = 0;
+    bool ok = true;
+    int expand[] = { 0, (formatStaticSegment<FmtT, Is>(out, args, argIndex, numArgs, ok), 0)... };
+    (void)expand;
+    (void)args;
+    if (ok) {
+        out.write(FmtT::str() + Data::parsed.tailBegin, Data::length - Data::parsed.tailBegin);
+        if (!Data::parsed.positionalMode && argIndex < numArgs)
+            TINYFORMAT_RAISE_ERROR("tinyformat: Not enough conversion specifiers in format string");
+    }
+}
+
+// Check the number of arguments passed with a StaticFormat at compile time.
+template<typename FmtT, std::size_t numArgs>
+inline void checkStaticFormatArgs()
+{
+    typedef StaticFormatData<FmtT> Data;
+    static_assert(Data::parsed.positionalMode ?
+                  Data::parsed.numArgs <= int(numArgs) :
+                  Data::parsed.numArgs == int(numArgs),
+                  "tinyformat: Number of arguments doesn't match format string");
+}
+
+} // namespace detail
+
+
+/// Format string literal which is parsed and checked at compile time.
+///
+/// Objects of this type are created with the TINYFORMAT_FMT macro and may be
+/// passed to format(), printf() and printfln() in place of a format string.
+template<typename FmtT>
+struct StaticFormat
+{
+    typedef detail::StaticFormatData<FmtT> Data;
+    static const char* str() { return FmtT::str(); }
+};
+
+/// Wrap a string literal format string for parsing at compile time, checking
+/// the number of arguments against the format string:
+///
+///   tfm::printf(TINYFORMAT_FMT("%s:%d\n"), file, line);
+///
+/// Errors in the format string (such as "%n") fail the constant evaluation
+/// of the parser, and so are reported as compile errors.
+#define TINYFORMAT_FMT(fmtString)                                         \
+    ([] {                                                                 \
+        struct TinyformatFmt                                              \
+        {                                                                 \
+            static constexpr const char* str() { return fmtString; }      \
+        };                                                                \
+        return ::tinyformat::StaticFormat<TinyformatFmt>();               \
+    }())
+
+#endif // TINYFORMAT_USE_CONSTEXPR_PARSER
+
+
+//------------------------------------------------------------------------------
+// Primary API functions
+
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+
+/// Make type-agnostic format list from list of template arguments.
+///
+/// The exact return type of this function is an implementation detail and
+/// shouldn't be relied upon.  Instead it should be stored as a FormatListRef:
+///
+///   FormatListRef formatList = makeFormatList( /*...*/ );
+template<typename... Args>
+detail::FormatListN<sizeof...(Args)> makeFormatList(const Args&... args)
+{
+    return detail::FormatListN<sizeof...(args)>(args...);
+}
+
+/// Make a format list holding copies of the given arguments, moving rather
+/// than copying temporaries.
+template<typename... Args>
+FormatArgStore makeFormatArgStore(Args&&... args)
+{
+    FormatArgStore store;
+    int expand[] = { 0, (store.push_back(std::forward<Args>(args)), 0)... };
+    (void)expand;
+    return store;
+}
+
+#else // C++98 version
+
+inline detail::FormatListN<0> makeFormatList()
+{
+    return detail::FormatListN<0>();
+}
+#define TINYFORMAT_MAKE_MAKEFORMATLIST(n)                     \
+template<TINYFORMAT_ARGTYPES(n)>                              \
+detail::FormatListN<n> makeFormatList(TINYFORMAT_VARARGS(n))  \
+{                                                             \
+    return detail::FormatListN<n>(TINYFORMAT_PASSARGS(n));    \
+}
+TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_MAKEFORMATLIST)
+#undef TINYFORMAT_MAKE_MAKEFORMATLIST
+
+namespace detail {
+inline void pushFormatArgs(FormatArgStore&) {}
+#define TINYFORMAT_MAKE_PUSHFORMATARGS(n)                                \
+template<TINYFORMAT_ARGTYPES(n)>                                         \
+void pushFormatArgs(FormatArgStore& store, TINYFORMAT_VARARGS(n))        \
+{                                                                        \
+    store.push_back(v1);                                                 \
+    pushFormatArgs(store TINYFORMAT_PASSARGS_TAIL(n));                   \
+}
+TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_PUSHFORMATARGS)
+#undef TINYFORMAT_MAKE_PUSHFORMATARGS
+} // namespace detail
+
+inline FormatArgStore makeFormatArgStore()
+{
+    return FormatArgStore();
+}
+#define TINYFORMAT_MAKE_MAKEFORMATARGSTORE(n)                 \
+template<TINYFORMAT_ARGTYPES(n)>                              \
+FormatArgStore makeFormatArgStore(TINYFORMAT_VARARGS(n))      \
+{                                                             \
+    FormatArgStore store;                                     \
+    detail::pushFormatArgs(store, TINYFORMAT_PASSARGS(n));    \
+    return store;                                             \
+}
+TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_MAKEFORMATARGSTORE)
+#undef TINYFORMAT_MAKE_MAKEFORMATARGSTORE
+
+#endif
+
+/// Format list of arguments to the stream according to the given format string.
+///
+/// The name vformat() is chosen for the semantic similarity to vprintf(): the
+/// list of format arguments is held in a single function argument.
+TINYFORMAT_FUNC void vformat(std::ostream& out, const char* fmt, FormatListRef list);
+
+/// Format list of arguments to the stream according to a pre-parsed format.
+TINYFORMAT_FUNC void vformat(std::ostream& out, const CompiledFormat& fmt, FormatListRef list);
+
+/// Format list of arguments according to the given format string and return
+/// the result as a string.
+TINYFORMAT_FUNC std::string vformat(const char* fmt, FormatListRef list);
+
+/// Format list of arguments according to a pre-parsed format and return the
+/// result as a string.
+TINYFORMAT_FUNC std::string vformat(const CompiledFormat& fmt, FormatListRef list);
+
+/// Format list of arguments according to the given format string, appending
+/// the result to str.  Reusing str across calls avoids reallocation once it
+/// has grown large enough.
+TINYFORMAT_FUNC void vappend_format(std::string& str, const char* fmt, FormatListRef list);
+
+/// Format list of arguments according to the given format string, appending
+/// the result to buf.
+TINYFORMAT_FUNC void vappend_format(Buffer& buf, const char* fmt, FormatListRef list);
+
+/// Append a binary record of the format string id and the list of arguments
+/// to out, to be formatted later by a BinaryDecoder.
+///
+/// No formatting is done: numbers, pointers and bools are copied as their
+/// native bytes and strings are copied with their length, each after a one
+/// byte type tag.  Other types are formatted with "%s" when serialized and
+/// are decoded as strings.  A record is
+///
+///   varint id, varint argument count, { u8 tag, value }...
+///
+/// where varints are unsigned LEB128, and string values are a varint length
+/// followed by the characters.  Since values are in the native byte order
+/// and sizes, records must be decoded by a program built for the same
+/// target.
+TINYFORMAT_FUNC void vserialize_format(Buffer& out, std::size_t id, FormatListRef list);
+
+/// Formats records written by serialize_format() as text, using the format
+/// string registered for the id of each record:
+///
+///   tfm::BinaryDecoder decoder;
+///   decoder.add_format(1, "%s: read %d bytes\n");
+///   // ... then for each chunk of records
+///   while (std::size_t n = decoder.decode(std::cout, data, size)) {
+///       data += n;
+///       size -= n;
+///   }
+///
+/// The arguments are rebuilt with the types they had when serialized and
+/// formatted with vformat(), so the output is the same as formatting them
+/// directly, other than "%p" of a C string printing its text.
+class BinaryDecoder
+{
+    public:
+        /// Register the format string for records with the given id,
+        /// replacing any previous format with that id.
+        void add_format(std::size_t id, const char* fmt);
+
+        /// Format the record at the start of the size bytes at data to out,
+        /// returning the length of the record, or 0 if the data holds only
+        /// part of a record.  A record with an unknown id is reported via
+        /// TINYFORMAT_ERROR and skipped.  On malformed data an error is
+        /// reported and size is returned, since the end of the record can't
+        /// be found.
+        std::size_t decode(std::ostream& out, const char* data,
+                           std::size_t size) const;
+
+    private:
+        typedef std::pair<std::size_t, CompiledFormat> Entry;
+
+        struct IdLess
+        {
+            bool operator()(const Entry& e, std::size_t id) const { return e.first < id; }
+        };
+
+        // Sorted by id
+        std::vector<Entry> m_formats;
+};
+
+namespace detail {
+
+// Stream which formats a line in memory before it's written out as a whole.
+// The buffer keeps its storage between lines.
+class LineStream
+{
+    public:
+        LineStream()
+            : m_stream(&m_buf),
+            m_inUse(false)
+        { }
+
+        bool inUse() const { return m_inUse; }
+        std::ostream& stream() { return m_stream; }
+        const char* data() const { return m_buf.data(); }
+        std::size_t size() const { return m_buf.size(); }
+
+        // Marks the stream as in use for the formatting of one line, which
+        // uses the locale loc.
+        class Use
+        {
+            public:
+                Use(LineStream& line, const std::locale& loc)
+                    : m_line(line)
+                {
+                    line.m_inUse = true;
+                    line.m_buf.clear();
+                    // Clear any error state left by a user defined operator<<
+                    if (!line.m_stream.good())
+                        line.m_stream.clear();
+                    if (line.m_stream.getloc() != loc)
+                        line.m_stream.imbue(loc);
+                }
+
+                ~Use() { m_line.m_inUse = false; }
+
+            private:
+                Use(const Use&);
+                Use& operator=(const Use&);
+
+                LineStream& m_line;
+        };
+
+    private:
+        // Not copyable
+        LineStream(const LineStream&);
+        LineStream& operator=(const LineStream&);
+
+        StackStreambuf m_buf;
+        std::ostream m_stream;
+        bool m_inUse;
+};
+
+#ifdef TINYFORMAT_HAS_THREAD_LOCAL
+// Owns the LineStream of a thread, and marks it gone when the thread exits so
+// that printing from the destructors of later thread_local or static objects
+// falls back to a stream of its own.
+class ThreadLineStream
+{
+    public:
+        struct Slot
+        {
+            LineStream* line;
+            bool exited;
+        };
+
+        explicit ThreadLineStream(Slot& slot)
+            : m_slot(slot)
+        {
+            slot.line = &m_line;
+        }
+
+        ~ThreadLineStream()
+        {
+            m_slot.line = NULL;
+            m_slot.exited = true;
+        }
+
+    private:
+        ThreadLineStream(const ThreadLineStream&);
+        ThreadLineStream& operator=(const ThreadLineStream&);
+
+        Slot& m_slot;
+        LineStream m_line;
+};
+
+// Return the calling thread's LineStream, or NULL if the thread is exiting.
+inline LineStream* threadLineStream()
+{
+    // The slot is trivially destructible, so remains usable while the thread
+    // exits.
+    static thread_local ThreadLineStream::Slot slot = { NULL, false };
+    if (!slot.line && !slot.exited) {
+        static thread_local ThreadLineStream owner(slot);
+        (void)owner;
+    }
+    return slot.line;
+}
+#endif
+
+template<typename Fmt, typename Write>
+inline void formatLineTo(LineStream& line, const Write& write, const std::locale& loc,
+                         const Fmt& fmt, FormatListRef list, bool newline)
+{
+    LineStream::Use use(line, loc);
+    vformat(line.stream(), fmt, list);
+    if (newline)
+        line.stream().put('\n');
+    write(line.data(), line.size());
+}
+
+// Format the list of arguments in memory with the locale loc, and pass the
+// complete output to a single call of write(data, size).
+//
+// The calling thread's LineStream is used where possible, so that no stream
+// is constructed.  Formatting doesn't lock anything, so threads writing with
+// a thread safe write() don't contend until the write itself.  A nested call
+// from an operator<< which itself prints uses a stream of its own.
+template<typename Fmt, typename Write>
+void formatLine(const Write& write, const std::locale& loc, const Fmt& fmt,
+                FormatListRef list, bool newline)
+{
+#ifdef TINYFORMAT_HAS_THREAD_LOCAL
+    LineStream* threadLine = threadLineStream();
+    if (threadLine && !threadLine->inUse()) {
+        formatLineTo(*threadLine, write, loc, fmt, list, newline);
+        return;
+    }
+#endif
+    LineStream line;
+    formatLineTo(line, write, loc, fmt, list, newline);
+}
+
+struct FileWrite
+{
+    explicit FileWrite(std::FILE* file) : file(file) { }
+    void operator()(const char* s, std::size_t n) const { std::fwrite(s, 1, n, file); }
+    std::FILE* file;
+};
+
+struct StreamWrite
+{
+    explicit StreamWrite(std::ostream& out) : out(out) { }
+    void operator()(const char* s, std::size_t n) const
+    {
+        out.write(s, static_cast<std::streamsize>(n));
+    }
+    std::ostream& out;
+};
+
+TINYFORMAT_FUNC void fprintfImpl(std::FILE* file, const char* fmt, FormatListRef list,
+                                 bool newline);
+
+// Format to std::cout, with a single write for TINYFORMAT_ATOMIC_PRINTF.
+TINYFORMAT_FUNC void printImpl(const char* fmt, FormatListRef list, bool newline);
+
+} // namespace detail
+
+/// Format list of arguments to the C stream file according to the given
+/// format string.  The output is assembled in memory and passed to a single
+/// fwrite(), so iostreams and std::cout aren't involved.
+inline void vfprintf(std::FILE* file, const char* fmt, FormatListRef list)
+{
+    detail::fprintfImpl(file, fmt, list, false);
+}
+
+/// Format list of arguments according to the given format string and return
+/// the result as a string which allocates its storage with alloc.
+///
+/// The output is collected on the stack, so that the string makes a single
+/// allocation of exactly the right size.
+template<typename Alloc>
+typename detail::AllocatorString<Alloc>::type
+vformat(const Alloc& alloc, const char* fmt, FormatListRef list)
+{
+    detail::StackStreambuf sbuf;
+    std::ostream out(&sbuf);
+    vformat(out, fmt, list);
+    return typename detail::AllocatorString<Alloc>::type(sbuf.data(),
+                                                         sbuf.size(), alloc);
+}
+
+/// Format list of arguments according to a pre-parsed format and return the
+/// result as a string which allocates its storage with alloc.
+template<typename Alloc>
+typename detail::AllocatorString<Alloc>::type
+vformat(const Alloc& alloc, const CompiledFormat& fmt, FormatListRef list)
+{
+    detail::StackStreambuf sbuf;
+    std::ostream out(&sbuf);
+    vformat(out, fmt, list);
+    return typename detail::AllocatorString<Alloc>::type(sbuf.data(),
+                                                         sbuf.size(), alloc);
+}
+
+#ifdef TINYFORMAT_HAS_PMR
+/// Format list of arguments according to the given format string and return
+/// the result as a string allocated from the memory resource mr.
+inline std::pmr::string vformat(std::pmr::memory_resource* mr,
+                                const char* fmt, FormatListRef list)
+{
+    return vformat(std::pmr::polymorphic_allocator<char>(mr), fmt, list);
+}
+
+/// Format list of arguments according to a pre-parsed format and return the
+/// result as a string allocated from the memory resource mr.
+inline std::pmr::string vformat(std::pmr::memory_resource* mr,
+                                const CompiledFormat& fmt, FormatListRef list)
+{
+    return vformat(std::pmr::polymorphic_allocator<char>(mr), fmt, list);
+}
+#endif
+
+/// Format list of arguments into the n character array at buf, returning
+/// the length of the full output.
+///
+/// At most n characters are written, and no terminating null is added.  If
+/// the return value is larger than n the output was truncated.
+TINYFORMAT_FUNC std::size_t vformat_to(char* buf, std::size_t n, const char* fmt,
+                                       FormatListRef list);
+
+/// Format list of arguments to the output iterator it, returning the
+/// iterator one past the end of the output.
+template<typename OutputIt>
+OutputIt vformat_to(OutputIt it, const char* fmt, FormatListRef list)
+{
+    detail::OutputIteratorStreambuf<OutputIt> sbuf(it);
+    std::ostream out(&sbuf);
+    vformat(out, fmt, list);
+    return sbuf.finish();
+}
+
+/// Return the number of characters which formatting the list of arguments
+/// would produce, without storing the output.
+inline std::size_t vformatted_size(const char* fmt, FormatListRef list)
+{
+    return vformat_to(static_cast<char*>(NULL), 0, fmt, list);
+}
+
+#ifdef TINYFORMAT_USE_CONSTEXPR_PARSER
+/// Format list of arguments to the stream according to a format string which
+/// was parsed at compile time.
+template<typename FmtT>
+void vformat(std::ostream& out, StaticFormat<FmtT>, FormatListRef list)
+{
+    typedef typename StaticFormat<FmtT>::Data Data;
+    detail::StreamStateSaver saved(out);
+#ifdef TINYFORMAT_STATS
+    detail::StatsScope stats(out, FmtT::str());
+#endif
+    detail::formatStaticImpl<FmtT>(out,
+        typename detail::MakeIntSequence<Data::numSegments>::type(),
+        list.m_args, list.m_N);
+}
+#endif
+
+
+/// Reusable formatting context, for repeated formatting by a single thread.
+///
+/// A Formatter owns an output string and a stream which are kept between
+/// calls, so that formatting doesn't need to construct a stream or save and
+/// restore its state each time, and only those parts of the stream state
+/// which differ from the previous conversion are changed.  The string keeps
+/// its capacity when cleared, so steady state formatting doesn't allocate:
+///
+///   tfm::Formatter fmt;  // eg, one per worker thread
+///   // ...
+///   const std::string& line = fmt.format("%s %d\n", path, status);
+///
+/// The stream is imbued with the global locale at construction.  A Formatter
+/// may not be used by several threads at once.
+class Formatter
+{
+    public:
+        Formatter()
+            : m_buf(m_str),
+            m_stream(&m_buf)
+        { }
+
+        /// Formatted output, valid until the next call which modifies it.
+        const std::string& str() const { return m_str; }
+        const char* data() const { return m_str.data(); }
+        std::size_t size() const { return m_str.size(); }
+
+        /// Discard the output, keeping the storage for reuse.
+        void clear() { m_str.clear(); }
+
+        /// Discard the output after the first n characters.
+        void truncate(std::size_t n)
+        {
+            if (n < m_str.size())
+                m_str.resize(n);
+        }
+
+        /// Append the list of arguments formatted according to fmt to the
+        /// output.
+        void vappend(const char* fmt, FormatListRef list)
+        {
+            resetStream();
+            detail::formatImpl(m_stream, fmt, list.m_args, list.m_N);
+        }
+
+        void vappend(const CompiledFormat& fmt, FormatListRef list)
+        {
+            resetStream();
+            detail::formatSegmentsImpl(m_stream, fmt.m_fmt.c_str(),
+                                       fmt.m_segments.empty() ? NULL : &fmt.m_segments[0],
+                                       static_cast<int>(fmt.m_segments.size()),
+                                       fmt.m_tailBegin, static_cast<int>(fmt.m_fmt.size()),
+                                       fmt.m_positionalMode, list.m_args, list.m_N);
+        }
+
+        /// Replace the output with the list of arguments formatted according
+        /// to fmt, returning the output.
+        const std::string& vformat(const char* fmt, FormatListRef list)
+        {
+            clear();
+            vappend(fmt, list);
+            return m_str;
+        }
+
+        const std::string& vformat(const CompiledFormat& fmt, FormatListRef list)
+        {
+            clear();
+            vappend(fmt, list);
+            return m_str;
+        }
+
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+        template<typename... Args>
+        const std::string& format(const char* fmt, const Args&... args)
+        {
+            return vformat(fmt, makeFormatList(args...));
+        }
+
+        template<typename... Args>
+        const std::string& format(const CompiledFormat& fmt, const Args&... args)
+        {
+            return vformat(fmt, makeFormatList(args...));
+        }
+
+        template<typename... Args>
+        void append(const char* fmt, const Args&... args)
+        {
+            vappend(fmt, makeFormatList(args...));
+        }
+
+        template<typename... Args>
+        void append(const CompiledFormat& fmt, const Args&... args)
+        {
+            vappend(fmt, makeFormatList(args...));
+        }
+#else // C++98 version
+        const std::string& format(const char* fmt)
+        {
+            return vformat(fmt, makeFormatList());
+        }
+
+        const std::string& format(const CompiledFormat& fmt)
+        {
+            return vformat(fmt, makeFormatList());
+        }
+
+        void append(const char* fmt)
+        {
+            vappend(fmt, makeFormatList());
+        }
+
+        void append(const CompiledFormat& fmt)
+        {
+            vappend(fmt, makeFormatList());
+        }
+
+#       define TINYFORMAT_MAKE_FORMATTER_FUNCS(n)                                     \
+                                                                                      \
+        template<TINYFORMAT_ARGTYPES(n)>                                              \
+        const std::string& format(const char* fmt, TINYFORMAT_VARARGS(n))             \
+        {                                                                             \
+            return vformat(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));              \
+        }                                                                             \
+                                                                                      \
+        template<TINYFORMAT_ARGTYPES(n)>                                              \
+        const std::string& format(const CompiledFormat& fmt, TINYFORMAT_VARARGS(n))   \
+        {                                                                             \
+            return vformat(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));              \
+        }                                                                             \
+                                                                                      \
+        template<TINYFORMAT_ARGTYPES(n)>                                              \
+        void append(const char* fmt, TINYFORMAT_VARARGS(n))                           \
+        {                                                                             \
+            vappend(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));                     \
+        }                                                                             \
+                                                                                      \
+        template<TINYFORMAT_ARGTYPES(n)>                                              \
+        void append(const CompiledFormat& fmt, TINYFORMAT_VARARGS(n))                 \
+        {                                                                             \
+            vappend(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));                     \
+        }
+
+        TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_FORMATTER_FUNCS)
+#       undef TINYFORMAT_MAKE_FORMATTER_FUNCS
+#endif
+
+    private:
+        // Not copyable
+        Formatter(const Formatter&);
+        Formatter& operator=(const Formatter&);
+
+        // Clear any error state left by a user defined operator<< in a
+        // previous call, which would otherwise suppress all further output.
+        void resetStream()
+        {
+            if (!m_stream.good())
+                m_stream.clear();
+        }
+
+        std::string m_str;
+        detail::StringAppendStreambuf m_buf;
+        std::ostream m_stream;
+};
+
+
+namespace detail {
+
+// Formats rows of a batch into a buffer with a single pre-parsed format,
+// passing the output on to the destination stream in large chunks.  With no
+// destination stream, the output is left in the buffer.
+class BatchWriter
+{
+    public:
+        BatchWriter(std::ostream* out, const CompiledFormat& fmt,
+                    const std::locale& loc)
+            : m_out(out),
+            m_fmt(fmt),
+            m_buf(m_str),
+            m_stream(&m_buf)
+        {
+            if (m_out)
+                m_str.reserve(chunkSize + chunkSize/4);
+            // Format with the destination locale, without copying the rest
+            // of its state: every spec sets all of the state it uses.
+            if (loc != m_stream.getloc())
+                m_stream.imbue(loc);
+        }
+
+        void write(const FormatList& row)
+        {
+            formatSegmentsImpl(m_stream, m_fmt.m_fmt.c_str(),
+                               m_fmt.m_segments.empty() ? NULL : &m_fmt.m_segments[0],
+                               static_cast<int>(m_fmt.m_segments.size()),
+                               m_fmt.m_tailBegin, static_cast<int>(m_fmt.m_fmt.size()),
+                               m_fmt.m_positionalMode, row.m_args, row.m_N);
+            if (m_out && m_str.size() >= chunkSize)
+                writeChunk();
+        }
+
+        // Write any buffered output, and flush the destination.
+        void finish()
+        {
+            writeChunk();
+            m_out->flush();
+        }
+
+        std::string& str() { return m_str; }
+
+    private:
+        BatchWriter(const BatchWriter&);
+        BatchWriter& operator=(const BatchWriter&);
+
+        static const std::size_t chunkSize = 65536;
+
+        void writeChunk()
+        {
+            if (!m_str.empty())
+                m_out->write(m_str.data(), static_cast<std::streamsize>(m_str.size()));
+            m_str.clear();
+        }
+
+        std::ostream* m_out;
+        const CompiledFormat& m_fmt;
+        std::string m_str;
+        StringAppendStreambuf m_buf;
+        std::ostream m_stream;
+};
+
+inline void writeBatchRow(BatchWriter& writer, const FormatList& row)
+{
+    writer.write(row);
+}
+
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+template<typename Tuple, int... Is>
+void writeTupleRow(BatchWriter& writer, const Tuple& row, IntSequence<Is...>)
+{
+    writer.write(FormatListN<sizeof...(Is)>(std::get<Is>(row)...));
+}
+
+template<typename... Args>
+void writeBatchRow(BatchWriter& writer, const std::tuple<Args...>& row)
+{
+    writeTupleRow(writer, row, typename MakeIntSequence<sizeof...(Args)>::type());
+}
+#endif
+
+} // namespace detail
+
+
+/// Format each row in [first,last) with the same format, writing the output
+/// to the stream.
+///
+/// Rows may be FormatArgStore or other FormatList objects, or with C++11,
+/// std::tuple's of the arguments.  The format is parsed once and the output
+/// is collected in a buffer which is written to the stream in large chunks,
+/// with a single flush at the end.  This is much faster than calling
+/// format() for each row when writing large tables:
+///
+///   std::vector<std::tuple<std::string, int, double>> rows = /*...*/;
+///   tfm::format_batch(csvFile, "%s,%d,%.3f\n", rows);
+template<typename InputIt>
+void format_batch(std::ostream& out, const CompiledFormat& fmt,
+                  InputIt first, InputIt last)
+{
+    detail::BatchWriter writer(&out, fmt, out.getloc());
+    for (; first != last; ++first)
+        detail::writeBatchRow(writer, *first);
+    writer.finish();
+}
+
+template<typename InputIt>
+void format_batch(std::ostream& out, const char* fmt, InputIt first, InputIt last)
+{
+    format_batch(out, CompiledFormat(fmt), first, last);
+}
+
+/// Format each row of a container such as a std::vector, as above.
+template<typename Range>
+void format_batch(std::ostream& out, const CompiledFormat& fmt, const Range& rows)
+{
+    format_batch(out, fmt, rows.begin(), rows.end());
+}
+
+template<typename Range>
+void format_batch(std::ostream& out, const char* fmt, const Range& rows)
+{
+    format_batch(out, CompiledFormat(fmt), rows.begin(), rows.end());
+}
+
+
+#ifdef TINYFORMAT_USE_PARALLEL_BATCH
+
+namespace detail {
+
+// Shared state for format_batch_parallel(): rows are formatted in chunks by
+// worker threads, and the chunks written to the stream in order by the
+// calling thread.  At most `window` chunks are held in memory at once.
+class ParallelBatch
+{
+    public:
+        static const std::size_t rowsPerChunk = 1024;
+
+        ParallelBatch(std::size_t numRows, std::size_t window)
+            : m_numChunks((numRows + rowsPerChunk - 1) / rowsPerChunk),
+            m_window(window),
+            m_chunks(m_numChunks),
+            m_ready(m_numChunks, false),
+            m_nextChunk(0),
+            m_written(0),
+            m_failed(false)
+        { }
+
+        std::size_t numChunks() const { return m_numChunks; }
+
+        // Claim the next chunk to format, waiting if too far ahead of the
+        // writer.  Returns false when there is no more work.
+        bool claim(std::size_t& chunk)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] {
+                return m_failed || m_nextChunk >= m_numChunks ||
+                       m_nextChunk < m_written + m_window;
+            });
+            if (m_failed || m_nextChunk >= m_numChunks)
+                return false;
+            chunk = m_nextChunk++;
+            return true;
+        }
+
+        void complete(std::size_t chunk, std::string& output)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_chunks[chunk].swap(output);
+            m_ready[chunk] = true;
+            m_cond.notify_all();
+        }
+
+        void fail(std::exception_ptr error)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_failed)
+                m_error = error;
+            m_failed = true;
+            m_cond.notify_all();
+        }
+
+        // Write chunks to out in order as they become ready.
+        void writeAll(std::ostream& out)
+        {
+            for (std::size_t i = 0; i < m_numChunks; ++i) {
+                std::string chunk;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cond.wait(lock, [this, i] { return m_failed || m_ready[i]; });
+                    if (m_failed)
+                        return;
+                    chunk.swap(m_chunks[i]);
+                    m_written = i + 1;
+                    m_cond.notify_all();
+                }
+                out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            }
+        }
+
+        std::exception_ptr error() const { return m_error; }
+
+    private:
+        const std::size_t m_numChunks;
+        const std::size_t m_window;
+        std::vector<std::string> m_chunks;
+        std::vector<bool> m_ready;
+        std::size_t m_nextChunk;
+        std::size_t m_written;
+        bool m_failed;
+        std::exception_ptr m_error;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+};
+
+template<typename RandomIt>
+void formatBatchChunks(ParallelBatch& batch, const CompiledFormat& fmt,
+                       const std::locale& loc, RandomIt first, RandomIt last)
+{
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+    try {
+#endif
+        BatchWriter writer(NULL, fmt, loc);
+        std::size_t chunk = 0;
+        while (batch.claim(chunk)) {
+            RandomIt begin = first + chunk*ParallelBatch::rowsPerChunk;
+            RandomIt end = (static_cast<std::size_t>(last - begin) > ParallelBatch::rowsPerChunk) ?
+                           begin + ParallelBatch::rowsPerChunk : last;
+            for (RandomIt row = begin; row != end; ++row)
+                writeBatchRow(writer, *row);
+            batch.complete(chunk, writer.str());
+            writer.str().clear();
+        }
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+    }
+    catch (...) {
+        batch.fail(std::current_exception());
+    }
+#endif
+}
+
+} // namespace detail
+
+
+/// Format each row in [first,last) as for format_batch(), using numThreads
+/// worker threads.
+///
+/// The rows are split into chunks which are formatted concurrently into
+/// separate buffers, and then written to the stream in order, so the output
+/// is identical to that of format_batch().  With numThreads zero, one thread
+/// per hardware thread is used.  Batches too small to split are formatted on
+/// the calling thread.
+///
+/// If TINYFORMAT_ERROR throws on a worker thread, formatting stops and the
+/// exception is rethrown here; the output is then incomplete.
+template<typename RandomIt>
+void format_batch_parallel(std::ostream& out, const CompiledFormat& fmt,
+                           RandomIt first, RandomIt last,
+                           unsigned numThreads = 0)
+{
+    if (numThreads == 0)
+        numThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+    const std::size_t numRows = static_cast<std::size_t>(last - first);
+    if (numThreads < 2 || numRows <= detail::ParallelBatch::rowsPerChunk) {
+        format_batch(out, fmt, first, last);
+        return;
+    }
+    detail::ParallelBatch batch(numRows, 4*numThreads);
+    numThreads = static_cast<unsigned>((std::min)(static_cast<std::size_t>(numThreads),
+                                                  batch.numChunks()));
+    const std::locale loc = out.getloc();
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < numThreads; ++i) {
+        workers.push_back(std::thread(&detail::formatBatchChunks<RandomIt>,
+                                      std::ref(batch), std::cref(fmt),
+                                      std::cref(loc), first, last));
+    }
+    batch.writeAll(out);
+    for (unsigned i = 0; i < numThreads; ++i)
+        workers[i].join();
+    if (batch.error())
+        std::rethrow_exception(batch.error());
+    out.flush();
+}
+
+template<typename RandomIt>
+void format_batch_parallel(std::ostream& out, const char* fmt,
+                           RandomIt first, RandomIt last,
+                           unsigned numThreads = 0)
+{
+    format_batch_parallel(out, CompiledFormat(fmt), first, last, numThreads);
+}
+
+/// Format each row of a container such as a std::vector in parallel, as
+/// above.
+template<typename Range>
+void format_batch_parallel(std::ostream& out, const CompiledFormat& fmt,
+                           const Range& rows, unsigned numThreads = 0)
+{
+    format_batch_parallel(out, fmt, rows.begin(), rows.end(), numThreads);
+}
+
+template<typename Range>
+void format_batch_parallel(std::ostream& out, const char* fmt,
+                           const Range& rows, unsigned numThreads = 0)
+{
+    format_batch_parallel(out, CompiledFormat(fmt), rows.begin(), rows.end(), numThreads);
+}
+
+#endif // TINYFORMAT_USE_PARALLEL_BATCH
+
+
+#ifdef TINYFORMAT_USE_ASYNC_SINK
+
+/// Sink which formats and writes messages on a background thread.
+///
+/// format() copies the format string pointer and the arguments into a
+/// bounded lock free queue and returns, so the calling thread pays only for
+/// copying the arguments.  A background thread formats the queued messages
+/// and writes them to the stream in batches:
+///
+///   static tfm::AsyncSink sink(std::cerr, tfm::AsyncSink::Drop);
+///   // ...
+///   sink.format("order %d filled at %.2f\n", id, price);
+///
+/// Any number of threads may call format() concurrently.  The format string
+/// isn't copied, so must outlive the sink - a string literal is typical.
+/// Arguments are copied or moved as for FormatArgStore::push_back(); if that
+/// throws, nothing is queued and the exception passes to the caller.  The
+/// stream must not be used by other code until the sink is destroyed, which
+/// writes any messages still queued.
+///
+/// Errors in the format string or arguments are reported via
+/// TINYFORMAT_ERROR on the background thread.  When exceptions are enabled,
+/// an exception thrown while formatting a message, such as from a throwing
+/// TINYFORMAT_ERROR, is caught there: the message is left out of the output
+/// and counted by failedCount(), and the sink carries on with the next one.
+class AsyncSink
+{
+    public:
+        /// Action taken by format() when the queue is full.
+        enum FullPolicy
+        {
+            Block,     ///< Wait for the background thread to make space
+            Drop,      ///< Discard the new message
+            Overwrite  ///< Discard the oldest queued message.  Its arguments
+                       ///< are destroyed by the calling thread.
+        };
+
+        /// Create a sink writing to `out` with a queue of at least
+        /// `capacity` messages.
+        explicit AsyncSink(std::ostream& out, FullPolicy policy = Block,
+                           std::size_t capacity = 1024)
+            : m_out(out),
+            m_policy(policy),
+            m_mask(queueSize(capacity) - 1),
+            m_cells(new Cell[m_mask + 1]),
+            m_enqueuePos(0),
+            m_dequeuePos(0),
+            m_completed(0),
+            m_dropped(0),
+            m_failed(0),
+            m_consumerWaiting(false),
+            m_stop(false)
+        {
+            for (std::size_t i = 0; i <= m_mask; ++i)
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            m_thread = std::thread(&AsyncSink::run, this);
+        }
+
+        ~AsyncSink()
+        {
+            m_stop.store(true);
+            wakeConsumer(true);
+            m_thread.join();
+        }
+
+        AsyncSink(const AsyncSink&) = delete;
+        AsyncSink& operator=(const AsyncSink&) = delete;
+
+        /// Queue the arguments for formatting according to fmt.  Returns
+        /// false if the message was dropped because the queue was full.
+        /// Temporaries are moved into the queue rather than copied.
+        template<typename... Args>
+        bool format(const char* fmt, Args&&... args)
+        {
+            return enqueue(fmt, [&](FormatArgStore& store) {
+                int expand[] = { 0, (store.push_back(std::forward<Args>(args)), 0)... };
+                (void)expand;
+                (void)store;
+            });
+        }
+
+        /// Queue a copy of a stored argument list for formatting.
+        bool vformat(const char* fmt, const FormatArgStore& args)
+        {
+            return enqueue(fmt, [&](FormatArgStore& store) { store = args; });
+        }
+
+        /// Queue a stored argument list for formatting, moving the arguments
+        /// out of args.
+        bool vformat(const char* fmt, FormatArgStore&& args)
+        {
+            return enqueue(fmt, [&](FormatArgStore& store) { store = std::move(args); });
+        }
+
+        /// Wait until all messages queued before the call have been written
+        /// to the stream and the stream flushed.
+        void flush()
+        {
+            const std::size_t target = m_enqueuePos.load();
+            wakeConsumer(true);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (m_completed.load() < target)
+                m_flushed.wait_for(lock, std::chrono::milliseconds(1));
+        }
+
+        /// Number of messages discarded because the queue was full.
+        std::size_t droppedCount() const { return m_dropped.load(); }
+
+        /// Number of messages left out of the output because formatting
+        /// them threw an exception.
+        std::size_t failedCount() const { return m_failed.load(); }
+
+    private:
+        // Queue entry.  `sequence` tracks the state of the cell, as in
+        // Dmitry Vyukov's bounded MPMC queue: it's equal to the enqueue
+        // position when the cell is free, and one more than that once the
+        // message is published.  A null `fmt` marks an empty message.
+        struct Cell
+        {
+            std::atomic<std::size_t> sequence;
+            const char* fmt;
+            FormatArgStore args;
+        };
+
+        // Counter padded to a typical cache line size, to avoid false
+        // sharing between threads updating neighbouring counters.
+        struct Counter : std::atomic<std::size_t>
+        {
+            explicit Counter(std::size_t n) : std::atomic<std::size_t>(n) { }
+            char padding[64 - sizeof(std::atomic<std::size_t>)];
+        };
+
+        static std::size_t queueSize(std::size_t capacity)
+        {
+            std::size_t n = 2;
+            while (n < capacity)
+                n *= 2;
+            return n;
+        }
+
+        Cell* tryClaimFree(std::size_t& pos)
+        {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& cell = m_cells[pos & m_mask];
+                std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+                if (seq == pos) {
+                    if (m_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                           std::memory_order_relaxed))
+                        return &cell;
+                }
+                else if (seq < pos) {
+                    return NULL;  // full
+                }
+                else {
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        Cell* tryClaimQueued(std::size_t& pos)
+        {
+            pos = m_dequeuePos.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& cell = m_cells[pos & m_mask];
+                std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+                if (seq == pos + 1) {
+                    if (m_dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                                           std::memory_order_relaxed))
+                        return &cell;
+                }
+                else if (seq < pos + 1) {
+                    return NULL;  // empty
+                }
+                else {
+                    pos = m_dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Return a cell claimed at the enqueue position `pos`, applying the
+        // full queue policy if necessary.
+        Cell* claimFreeCell(std::size_t& pos)
+        {
+            for (;;) {
+                Cell* cell = tryClaimFree(pos);
+                if (cell)
+                    return cell;
+                switch (m_policy) {
+                    case Drop:
+                        ++m_dropped;
+                        return NULL;
+                    case Overwrite: {
+                        std::size_t oldPos = 0;
+                        Cell* old = tryClaimQueued(oldPos);
+                        if (old) {
+                            release(old, oldPos);
+                            ++m_dropped;
+                            ++m_completed;
+                        }
+                        else {
+                            std::this_thread::yield();
+                        }
+                        break;
+                    }
+                    case Block:
+                        wakeConsumer(false);
+                        std::this_thread::yield();
+                        break;
+                }
+            }
+        }
+
+        // Claim a cell, fill in the message with fill(cell->args), and
+        // publish it.
+        template<typename Fill>
+        bool enqueue(const char* fmt, const Fill& fill)
+        {
+            std::size_t pos = 0;
+            Cell* cell = claimFreeCell(pos);
+            if (!cell)
+                return false;
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+            try {
+#endif
+                cell->fmt = fmt;
+                fill(cell->args);
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+            }
+            catch (...) {
+                // No other thread touches the cell until it's published, so
+                // publish it as an empty message rather than leave a gap
+                // which would stop the queue for good.
+                cell->args.clear();
+                cell->fmt = NULL;
+                publish(cell, pos);
+                throw;
+            }
+#endif
+            publish(cell, pos);
+            return true;
+        }
+
+        void publish(Cell* cell, std::size_t pos)
+        {
+            // Sequentially consistent, as for m_consumerWaiting in run(), so
+            // that either the consumer sees the message or the producer sees
+            // the consumer waiting.
+            cell->sequence.store(pos + 1);
+            wakeConsumer(false);
+        }
+
+        void release(Cell* cell, std::size_t pos)
+        {
+            cell->args.clear();
+            cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        }
+
+        bool hasQueued() const
+        {
+            std::size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+            return m_cells[pos & m_mask].sequence.load() == pos + 1;
+        }
+
+        // Wake the background thread if it's waiting, or unconditionally if
+        // `always` is set.
+        void wakeConsumer(bool always)
+        {
+            if (always || m_consumerWaiting.load()) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wake.notify_one();
+            }
+        }
+
+        // Append a message to the output.  Any partial output of a message
+        // which throws is discarded.
+        void formatMessage(Formatter& formatter, const Cell& cell)
+        {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+            const std::size_t size = formatter.size();
+            try {
+#endif
+                formatter.vappend(cell.fmt, cell.args);
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+            }
+            catch (...) {
+                formatter.truncate(size);
+                ++m_failed;
+            }
+#endif
+        }
+
+        void run()
+        {
+            // Write in batches of roughly this many characters.
+            const std::size_t batchSize = 16384;
+            Formatter formatter;
+            for (;;) {
+                std::size_t count = 0;
+                std::size_t pos = 0;
+                while (formatter.size() < batchSize) {
+                    Cell* cell = tryClaimQueued(pos);
+                    if (!cell)
+                        break;
+                    if (cell->fmt)
+                        formatMessage(formatter, *cell);
+                    release(cell, pos);
+                    ++count;
+                }
+                if (count > 0) {
+                    m_out.write(formatter.data(), static_cast<std::streamsize>(formatter.size()));
+                    m_out.flush();
+                    formatter.clear();
+                    m_completed += count;
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_flushed.notify_all();
+                    continue;
+                }
+                if (m_stop.load())
+                    break;
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_consumerWaiting.store(true);
+                if (!hasQueued() && !m_stop.load())
+                    m_wake.wait_for(lock, std::chrono::milliseconds(10));
+                m_consumerWaiting.store(false, std::memory_order_relaxed);
+            }
+        }
+
+        std::ostream& m_out;
+        const FullPolicy m_policy;
+        const std::size_t m_mask;
+        std::unique_ptr<Cell[]> m_cells;
+        // Producer and consumer positions on separate cache lines
+        Counter m_enqueuePos;
+        Counter m_dequeuePos;
+        Counter m_completed;
+        std::atomic<std::size_t> m_dropped;
+        std::atomic<std::size_t> m_failed;
+        std::atomic<bool> m_consumerWaiting;
+        std::atomic<bool> m_stop;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_flushed;
+        std::thread m_thread;
+};
+
+#endif // TINYFORMAT_USE_ASYNC_SINK
+
+
+#ifdef TINYFORMAT_USE_SHARDED_SINK
+
+/// Sink which collects the output of many threads in shards and writes it
+/// to a stream in batches.
+///
+/// Each call to format() formats its output in memory owned by the calling
+/// thread, then appends it to one of a fixed number of shards.  Threads are
+/// spread evenly over the shards, so they seldom wait for each other.  A
+/// shard is written to the stream with a single write once it holds
+/// flushSize characters, and all shards are written by flush() and when the
+/// sink is destroyed:
+///
+///   static tfm::ShardedSink sink(std::cout);
+///   // ... on any thread
+///   sink.format("%s: %d items\n", name, count);
+///
+/// The output of a call is always written contiguously, and the output of
+/// each thread in order, but the output of different threads is only
+/// ordered by batch.  The stream must not be used by other code while the
+/// sink holds unwritten output.  Errors in the format string or arguments
+/// are reported via TINYFORMAT_ERROR on the calling thread, and the output
+/// of the failed call is discarded.
+class ShardedSink
+{
+    public:
+        explicit ShardedSink(std::ostream& out, std::size_t numShards = 16,
+                             std::size_t flushSize = 65536)
+            : m_out(out),
+            m_flushSize(flushSize)
+        {
+            for (std::size_t i = 0; i < (std::max)(numShards, std::size_t(1)); ++i)
+                m_shards.emplace_back(new Shard());
+        }
+
+        ~ShardedSink() { flush(); }
+
+        ShardedSink(const ShardedSink&) = delete;
+        ShardedSink& operator=(const ShardedSink&) = delete;
+
+        /// Format the list of arguments according to fmt.
+        void vformat(const char* fmt, FormatListRef list)
+        {
+            detail::formatLine(Append(*this), m_out.getloc(), fmt, list, false);
+        }
+
+        void vformat(const CompiledFormat& fmt, FormatListRef list)
+        {
+            detail::formatLine(Append(*this), m_out.getloc(), fmt, list, false);
+        }
+
+        template<typename... Args>
+        void format(const char* fmt, const Args&... args)
+        {
+            vformat(fmt, makeFormatList(args...));
+        }
+
+        template<typename... Args>
+        void format(const CompiledFormat& fmt, const Args&... args)
+        {
+            vformat(fmt, makeFormatList(args...));
+        }
+
+        /// Write the output collected so far by all shards, and flush the
+        /// stream.
+        void flush()
+        {
+            for (std::size_t i = 0; i < m_shards.size(); ++i)
+                writeShard(*m_shards[i]);
+            std::lock_guard<std::mutex> lock(m_outMutex);
+            m_out.flush();
+        }
+
+    private:
+        struct Shard
+        {
+            std::mutex mutex;         // Guards pending
+            std::string pending;
+            std::mutex writeMutex;    // Held while writing, guards batch
+            std::string batch;
+        };
+
+        struct Append
+        {
+            explicit Append(ShardedSink& sink) : sink(sink) { }
+            void operator()(const char* s, std::size_t n) const { sink.append(s, n); }
+            ShardedSink& sink;
+        };
+
+        // Shard index of the calling thread.  Threads are numbered as they
+        // first use a sink, which spreads them more evenly than hashing
+        // their ids would.
+        std::size_t shardIndex() const
+        {
+            static std::atomic<std::size_t> numThreads(0);
+            static thread_local std::size_t thread =
+                numThreads.fetch_add(1, std::memory_order_relaxed);
+            return thread % m_shards.size();
+        }
+
+        void append(const char* s, std::size_t n)
+        {
+            Shard& shard = *m_shards[shardIndex()];
+            bool full = false;
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.pending.append(s, n);
+                full = shard.pending.size() >= m_flushSize;
+            }
+            if (full)
+                writeShard(shard);
+        }
+
+        // Write out the pending output of the shard.  Other threads may
+        // append to the shard while the batch is being written.
+        void writeShard(Shard& shard)
+        {
+            std::lock_guard<std::mutex> writeLock(shard.writeMutex);
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.pending.swap(shard.batch);
+            }
+            if (shard.batch.empty())
+                return;
+            {
+                std::lock_guard<std::mutex> lock(m_outMutex);
+                m_out.write(shard.batch.data(),
+                            static_cast<std::streamsize>(shard.batch.size()));
+            }
+            shard.batch.clear();
+        }
+
+        std::ostream& m_out;
+        const std::size_t m_flushSize;
+        std::vector<std::unique_ptr<Shard> > m_shards;
+        std::mutex m_outMutex;
+};
+
+#endif // TINYFORMAT_USE_SHARDED_SINK
+
+
+#ifdef TINYFORMAT_USE_FD_SINK
+
+namespace detail {
+
+// Stream buffer which writes to a file descriptor through a page aligned
+// buffer.  Writes too large for the buffer go straight to the descriptor
+// together with the buffered output, using writev() rather than copying.
+class FdStreambuf : public std::streambuf
+{
+    public:
+        FdStreambuf(int fd, std::size_t bufferSize)
+            : m_fd(fd),
+            m_failed(false),
+            m_writes(0)
+        {
+            const std::size_t page = 4096;
+            bufferSize = (bufferSize + page - 1) / page * page;
+            if (bufferSize == 0)
+                bufferSize = page;
+            m_storage = new char[bufferSize + page - 1];
+            std::size_t offset = reinterpret_cast<std::size_t>(m_storage) % page;
+            char* buf = m_storage + (offset ? page - offset : 0);
+            setp(buf, buf + bufferSize);
+        }
+
+        ~FdStreambuf()
+        {
+            flushBuffer();
+            delete[] m_storage;
+        }
+
+        // Write the buffered output, returning false if a write failed now
+        // or at any previous time.
+        bool flushBuffer()
+        {
+            if (pptr() != pbase())
+                writeAll(NULL, 0);
+            return !m_failed;
+        }
+
+        const char* pending() const { return pbase(); }
+        std::size_t pendingSize() const { return static_cast<std::size_t>(pptr() - pbase()); }
+        // Number of times output has been written to the descriptor
+        unsigned long writes() const { return m_writes; }
+        bool failed() const { return m_failed; }
+        int fd() const { return m_fd; }
+
+    protected:
+        virtual int_type overflow(int_type c)
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof()))
+                return traits_type::not_eof(c);
+            if (!writeAll(NULL, 0))
+                return traits_type::eof();
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+            return c;
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize n)
+        {
+            if (n > epptr() - pptr()) {
+                if (n >= epptr() - pbase())
+                    return writeAll(s, static_cast<std::size_t>(n)) ? n : 0;
+                if (!writeAll(NULL, 0))
+                    return 0;
+            }
+            traits_type::copy(pptr(), s, static_cast<std::size_t>(n));
+            pbump(static_cast<int>(n));
+            return n;
+        }
+
+        virtual int sync()
+        {
+            return flushBuffer() ? 0 : -1;
+        }
+
+    private:
+        // Not copyable
+        FdStreambuf(const FdStreambuf&);
+        FdStreambuf& operator=(const FdStreambuf&);
+
+        // Write the buffered output followed by the n characters at s,
+        // emptying the buffer.  On error the output is discarded.
+        bool writeAll(const char* s, std::size_t n)
+        {
+            struct iovec iov[2];
+            int count = 0;
+            if (pptr() != pbase()) {
+                iov[count].iov_base = pbase();
+                iov[count].iov_len = pendingSize();
+                ++count;
+            }
+            if (n > 0) {
+                iov[count].iov_base = const_cast<char*>(s);
+                iov[count].iov_len = n;
+                ++count;
+            }
+            setp(pbase(), epptr());
+            ++m_writes;
+            struct iovec* next = iov;
+            while (count > 0) {
+                ssize_t written = ::writev(m_fd, next, count);
+                if (written < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    m_failed = true;
+                    return false;
+                }
+                std::size_t w = static_cast<std::size_t>(written);
+                while (count > 0 && w >= next->iov_len) {
+                    w -= next->iov_len;
+                    ++next;
+                    --count;
+                }
+                if (count > 0) {
+                    next->iov_base = static_cast<char*>(next->iov_base) + w;
+                    next->iov_len -= w;
+                }
+            }
+            return true;
+        }
+
+        int m_fd;
+        bool m_failed;
+        unsigned long m_writes;
+        char* m_storage;
+};
+
+} // namespace detail
+
+
+/// Sink which formats into a buffer and writes it to a POSIX file
+/// descriptor, bypassing iostreams and stdio entirely.
+///
+/// Output is buffered until bufferSize characters have accumulated, or in
+/// LineBuffered mode until a call writes a newline, and is then written to
+/// the descriptor with a single write.  Arguments which are larger than the
+/// buffer, such as long strings, are passed to writev() along with the
+/// buffered output rather than being copied:
+///
+///   tfm::FdSink out(STDOUT_FILENO);
+///   for (...)
+///       out.format("%s\t%d\n", name, count);
+///
+/// The descriptor is not closed by the sink, and remaining output is written
+/// when the sink is destroyed.  A FdSink may not be used by several threads
+/// at once.
+class FdSink
+{
+    public:
+        enum BufferMode
+        {
+            FullyBuffered,  ///< Write when the buffer is full
+            LineBuffered    ///< Also write after each call containing '\n'
+        };
+
+        explicit FdSink(int fd, BufferMode mode = FullyBuffered,
+                        std::size_t bufferSize = 65536)
+            : m_mode(mode),
+            m_buf(fd, bufferSize),
+            m_stream(&m_buf)
+        { }
+
+        /// Format the list of arguments according to fmt.  Returns false if
+        /// writing to the descriptor has failed.
+        bool vformat(const char* fmt, FormatListRef list)
+        {
+            Mark mark = begin();
+            tinyformat::vformat(m_stream, fmt, list);
+            return end(mark);
+        }
+
+        bool vformat(const CompiledFormat& fmt, FormatListRef list)
+        {
+            Mark mark = begin();
+            tinyformat::vformat(m_stream, fmt, list);
+            return end(mark);
+        }
+
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+        template<typename... Args>
+        bool format(const char* fmt, const Args&... args)
+        {
+            return vformat(fmt, makeFormatList(args...));
+        }
+
+        template<typename... Args>
+        bool format(const CompiledFormat& fmt, const Args&... args)
+        {
+            return vformat(fmt, makeFormatList(args...));
+        }
+#else // C++98 version
+        bool format(const char* fmt)
+        {
+            return vformat(fmt, makeFormatList());
+        }
+
+        bool format(const CompiledFormat& fmt)
+        {
+            return vformat(fmt, makeFormatList());
+        }
+
+#       define TINYFORMAT_MAKE_FDSINK_FUNCS(n)                                        \
+                                                                                      \
+        template<TINYFORMAT_ARGTYPES(n)>                                              \
+        bool format(const char* fmt, TINYFORMAT_VARARGS(n))                           \
+        {                                                                             \
+            return vformat(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));              \
+        }                                                                             \
+                                                                                      \
+        template<TINYFORMAT_ARGTYPES(n)>                                              \
+        bool format(const CompiledFormat& fmt, TINYFORMAT_VARARGS(n))                 \
+        {                                                                             \
+            return vformat(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));              \
+        }
+
+        TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_FDSINK_FUNCS)
+#       undef TINYFORMAT_MAKE_FDSINK_FUNCS
+#endif
+
+        /// Write any buffered output.  Returns false if writing to the
+        /// descriptor has failed.
+        bool flush() { return m_buf.flushBuffer(); }
+
+        /// Return false if writing to the descriptor has failed.
+        bool good() const { return !m_buf.failed(); }
+
+        int fd() const { return m_buf.fd(); }
+
+    private:
+        // Not copyable
+        FdSink(const FdSink&);
+        FdSink& operator=(const FdSink&);
+
+        // Position in the output at the start of a call, to find the
+        // output of the call in LineBuffered mode.
+        struct Mark
+        {
+            unsigned long writes;
+            std::size_t pending;
+        };
+
+        Mark begin()
+        {
+            // Clear any error state left by a user defined operator<<
+            if (!m_stream.good())
+                m_stream.clear();
+            Mark mark = { m_buf.writes(), m_buf.pendingSize() };
+            return mark;
+        }
+
+        bool end(const Mark& mark)
+        {
+            if (m_mode == LineBuffered) {
+                std::size_t start = (m_buf.writes() == mark.writes) ? mark.pending : 0;
+                if (std::memchr(m_buf.pending() + start, '\n',
+                                m_buf.pendingSize() - start))
+                    return m_buf.flushBuffer();
+            }
+            return good();
+        }
+
+        BufferMode m_mode;
+        detail::FdStreambuf m_buf;
+        std::ostream m_stream;
+};
+
+#endif // TINYFORMAT_USE_FD_SINK
+
+
+#ifdef TINYFORMAT_USE_MMAP_SINK
+
+namespace detail {
+
+// Stream buffer which writes into a window of a memory mapped file.  When
+// the window fills up, it's unmapped and the next window mapped after
+// extending the file, so the cost of moving on doesn't depend on the amount
+// written so far.
+class MmapStreambuf : public std::streambuf
+{
+    public:
+        MmapStreambuf(const char* path, std::size_t windowSize)
+            : m_fd(::open(path, O_RDWR | O_CREAT | O_TRUNC, 0666)),
+            m_failed(m_fd < 0),
+            m_map(NULL),
+            m_mapOffset(0),
+            m_mapSize(0),
+            m_fileSize(0),
+            m_pageSize(static_cast<std::size_t>(::sysconf(_SC_PAGESIZE))),
+            m_windowSize((std::max)(m_pageSize, roundUp(windowSize, m_pageSize)))
+        {
+            setp(NULL, NULL);
+        }
+
+        ~MmapStreambuf() { close(); }
+
+        // Offset of the next character written in the file
+        std::size_t position() const
+        {
+            return m_mapOffset + static_cast<std::size_t>(pptr() - m_map);
+        }
+
+        bool failed() const { return m_failed; }
+
+        // Map at least n characters for writing from the current position.
+        bool reserve(std::size_t n)
+        {
+            if (static_cast<std::size_t>(epptr() - pptr()) >= n)
+                return !m_failed;
+            return remap(n);
+        }
+
+        // Unmap the file, truncate it to the output written and close it.
+        bool close()
+        {
+            if (m_fd < 0)
+                return !m_failed;
+            std::size_t size = position();
+            unmap();
+            if (::ftruncate(m_fd, static_cast<off_t>(size)) != 0)
+                m_failed = true;
+            if (::close(m_fd) != 0)
+                m_failed = true;
+            m_fd = -1;
+            return !m_failed;
+        }
+
+    protected:
+        virtual int_type overflow(int_type c)
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof()))
+                return traits_type::not_eof(c);
+            if (!remap(1))
+                return traits_type::eof();
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+            return c;
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize n)
+        {
+            std::size_t remaining = static_cast<std::size_t>(n);
+            while (remaining > 0) {
+                std::size_t avail = static_cast<std::size_t>(epptr() - pptr());
+                if (avail == 0) {
+                    if (!remap(remaining))
+                        break;
+                    avail = static_cast<std::size_t>(epptr() - pptr());
+                }
+                std::size_t k = (std::min)(avail, remaining);
+                traits_type::copy(pptr(), s, k);
+                // Advance with setp() rather than pbump(), which takes an int
+                setp(pptr() + k, epptr());
+                s += k;
+                remaining -= k;
+            }
+            return n - static_cast<std::streamsize>(remaining);
+        }
+
+    private:
+        // Not copyable
+        MmapStreambuf(const MmapStreambuf&);
+        MmapStreambuf& operator=(const MmapStreambuf&);
+
+        static std::size_t roundUp(std::size_t n, std::size_t multiple)
+        {
+            return (n + multiple - 1) / multiple * multiple;
+        }
+
+        void unmap()
+        {
+            if (m_map)
+                ::munmap(m_map, m_mapSize);
+            m_map = NULL;
+            setp(NULL, NULL);
+        }
+
+        // Map a window starting at the current position with space for at
+        // least n characters, extending the file to cover it.
+        bool remap(std::size_t n)
+        {
+            if (m_failed)
+                return false;
+            std::size_t pos = position();
+            std::size_t offset = pos / m_pageSize * m_pageSize;
+            std::size_t size = (std::max)(m_windowSize,
+                                          roundUp(pos - offset + n, m_pageSize));
+            unmap();
+            m_mapOffset = pos;  // position() stays correct if mapping fails
+            if (offset + size > m_fileSize) {
+                if (::ftruncate(m_fd, static_cast<off_t>(offset + size)) != 0) {
+                    m_failed = true;
+                    return false;
+                }
+                m_fileSize = offset + size;
+            }
+            void* map = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                               m_fd, static_cast<off_t>(offset));
+            if (map == MAP_FAILED) {
+                m_failed = true;
+                return false;
+            }
+            m_map = static_cast<char*>(map);
+            m_mapOffset = offset;
+            m_mapSize = size;
+            setp(m_map + (pos - offset), m_map + size);
+            return true;
+        }
+
+        int m_fd;
+        bool m_failed;
+        char* m_map;
+        std::size_t m_mapOffset;
+        std::size_t m_mapSize;
+        std::size_t m_fileSize;
+        std::size_t m_pageSize;
+        std::size_t m_windowSize;
+};
+
+} // namespace detail
+
+
+/// Sink which formats directly into a memory mapped file.
+///
+/// The file is created (or truncated) at construction and mapped in windows
+/// of windowSize bytes, so output is written into the page cache without a
+/// copy through write().  close() or the destructor truncates the file to
+/// the size of the output.  For predictable remapping, reserve() can map
+/// enough space for a known amount of output in advance, using
+/// formatted_size() to estimate it.  stream() is an ordinary std::ostream,
+/// which pairs with format_batch():
+///
+///   tfm::MmapSink sink("export.csv");
+///   sink.reserve(rows.size() * tfm::formatted_size(rowFmt, 0, 0.0, "name"));
+///   tfm::format_batch(sink.stream(), rowFmt, rows);
+///   if (!sink.close())
+///       // handle error
+///
+/// As with any shared file mapping, running out of disk space while writing
+/// raises SIGBUS rather than returning an error.  A MmapSink may not be used
+/// by several threads at once.
+class MmapSink
+{
+    public:
+        explicit MmapSink(const char* path,
+                          std::size_t windowSize = 64*1024*1024)
+            : m_buf(path, windowSize),
+            m_stream(&m_buf)
+        {
+            if (m_buf.failed())
+                m_stream.setstate(std::ios::badbit);
+        }
+
+        /// Format the list of arguments according to fmt.  Returns false if
+        /// creating or mapping the file has failed.
+        bool vformat(const char* fmt, FormatListRef list)
+        {
+            resetStream();
+            tinyformat::vformat(m_stream, fmt, list);
+            return good();
+        }
+
+        bool vformat(const CompiledFormat& fmt, FormatListRef list)
+        {
+            resetStream();
+            tinyformat::vformat(m_stream, fmt, list);
+            return good();
+        }
+
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+        template<typename... Args>
+        bool format(const char* fmt, const Args&... args)
+        {
+            return vformat(fmt, makeFormatList(args...));
+        }
+
+        template<typename... Args>
+        bool format(const CompiledFormat& fmt, const Args&... args)
+        {
+            return vformat(fmt, makeFormatList(args...));
+        }
+#else // C++98 version
+        bool format(const char* fmt)
+        {
+            return vformat(fmt, makeFormatList());
+        }
+
+        bool format(const CompiledFormat& fmt)
+        {
+            return vformat(fmt, makeFormatList());
+        }
+
+#       define TINYFORMAT_MAKE_MMAPSINK_FUNCS(n)                                      \
+                                                                                      \
+        template<TINYFORMAT_ARGTYPES(n)>                                              \
+        bool format(const char* fmt, TINYFORMAT_VARARGS(n))                           \
+        {                                                                             \
+            return vformat(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));              \
+        }                                                                             \
+                                                                                      \
+        template<TINYFORMAT_ARGTYPES(n)>                                              \
+        bool format(const CompiledFormat& fmt, TINYFORMAT_VARARGS(n))                 \
+        {                                                                             \
+            return vformat(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));              \
+        }
+
+        TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_MMAPSINK_FUNCS)
+#       undef TINYFORMAT_MAKE_MMAPSINK_FUNCS
+#endif
+
+        /// Stream writing into the file, for use with format_batch() and
+        /// other functions taking a std::ostream.
+        std::ostream& stream() { return m_stream; }
+
+        /// Map space for at least n more characters of output.
+        bool reserve(std::size_t n) { return m_buf.reserve(n); }
+
+        /// Number of characters written so far.
+        std::size_t size() const { return m_buf.position(); }
+
+        /// Return false if creating, mapping or closing the file has failed.
+        bool good() const { return !m_buf.failed(); }
+
+        /// Finish writing, truncating the file to the size of the output.
+        /// Returns false if any operation on the file failed.
+        bool close() { return m_buf.close(); }
+
+    private:
+        // Not copyable
+        MmapSink(const MmapSink&);
+        MmapSink& operator=(const MmapSink&);
+
+        // Clear any error state left by a user defined operator<<
+        void resetStream()
+        {
+            if (!m_stream.good() && !m_buf.failed())
+                m_stream.clear();
+        }
+
+        detail::MmapStreambuf m_buf;
+        std::ostream m_stream;
+};
+
+#endif // TINYFORMAT_USE_MMAP_SINK
+
+
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+
+/// Format list of arguments to the stream according to given format string.
+template<typename... Args>
+void format(std::ostream& out, const char* fmt, const Args&... args)
+{
+    vformat(out, fmt, makeFormatList(args...));
+}
+
+/// Format list of arguments according to the given format string and return
+/// the result as a string.
+template<typename... Args>
+std::string format(const char* fmt, const Args&... args)
+{
+    return vformat(fmt, makeFormatList(args...));
+}
+
+/// Format list of arguments to the stream according to a pre-parsed format.
+template<typename... Args>
+void format(std::ostream& out, const CompiledFormat& fmt, const Args&... args)
+{
+    vformat(out, fmt, makeFormatList(args...));
+}
+
+/// Format list of arguments according to a pre-parsed format and return the
+/// result as a string.
+template<typename... Args>
+std::string format(const CompiledFormat& fmt, const Args&... args)
+{
+    return vformat(fmt, makeFormatList(args...));
+}
+
+/// Format list of arguments according to the given format string and return
+/// the result as a string which allocates its storage with alloc.
+template<typename Alloc, typename... Args>
+typename detail::AllocatorString<Alloc>::type
+format(const Alloc& alloc, const char* fmt, const Args&... args)
+{
+    return vformat(alloc, fmt, makeFormatList(args...));
+}
+
+template<typename Alloc, typename... Args>
+typename detail::AllocatorString<Alloc>::type
+format(const Alloc& alloc, const CompiledFormat& fmt, const Args&... args)
+{
+    return vformat(alloc, fmt, makeFormatList(args...));
+}
+
+#ifdef TINYFORMAT_HAS_PMR
+/// Format list of arguments according to the given format string and return
+/// the result as a string allocated from the memory resource mr.
+template<typename... Args>
+std::pmr::string format(std::pmr::memory_resource* mr, const char* fmt,
+                        const Args&... args)
+{
+    return vformat(mr, fmt, makeFormatList(args...));
+}
+
+template<typename... Args>
+std::pmr::string format(std::pmr::memory_resource* mr,
+                        const CompiledFormat& fmt, const Args&... args)
+{
+    return vformat(mr, fmt, makeFormatList(args...));
+}
+#endif
+
+/// Format list of arguments to std::cout, according to the given format
+/// string.  With TINYFORMAT_ATOMIC_PRINTF the output of each call, including
+/// the newline of printfln(), is passed to std::cout with a single write.
+template<typename... Args>
+void printf(const char* fmt, const Args&... args)
+{
+    detail::printImpl(fmt, makeFormatList(args...), false);
+}
+
+template<typename... Args>
+void printfln(const char* fmt, const Args&... args)
+{
+    detail::printImpl(fmt, makeFormatList(args...), true);
+}
+
+/// Format list of arguments to the C stream file.  See vfprintf().
+template<typename... Args>
+void fprintf(std::FILE* file, const char* fmt, const Args&... args)
+{
+    detail::fprintfImpl(file, fmt, makeFormatList(args...), false);
+}
+
+template<typename... Args>
+void fprintfln(std::FILE* file, const char* fmt, const Args&... args)
+{
+    detail::fprintfImpl(file, fmt, makeFormatList(args...), true);
+}
+
+/// Format list of arguments into the n character array at buf.  See
+/// vformat_to().
+template<typename... Args>
+std::size_t format_to(char* buf, std::size_t n, const char* fmt, const Args&... args)
+{
+    return vformat_to(buf, n, fmt, makeFormatList(args...));
+}
+
+/// Format list of arguments to an output iterator.  See vformat_to().
+template<typename OutputIt, typename... Args>
+OutputIt format_to(OutputIt it, const char* fmt, const Args&... args)
+{
+    return vformat_to(it, fmt, makeFormatList(args...));
+}
+
+/// Return the length of the formatted output without storing it.
+template<typename... Args>
+std::size_t formatted_size(const char* fmt, const Args&... args)
+{
+    return vformatted_size(fmt, makeFormatList(args...));
+}
+
+/// Format list of arguments according to the given format string, appending
+/// the result to str.
+template<typename... Args>
+void append_format(std::string& str, const char* fmt, const Args&... args)
+{
+    vappend_format(str, fmt, makeFormatList(args...));
+}
+
+/// Format list of arguments according to the given format string, appending
+/// the result to buf.
+template<typename... Args>
+void append_format(Buffer& buf, const char* fmt, const Args&... args)
+{
+    vappend_format(buf, fmt, makeFormatList(args...));
+}
+
+/// Append a binary record of the format string id and arguments to out.
+/// See vserialize_format().
+template<typename... Args>
+void serialize_format(Buffer& out, std::size_t id, const Args&... args)
+{
+    vserialize_format(out, id, makeFormatList(args...));
+}
+
+#ifdef TINYFORMAT_USE_CONSTEXPR_PARSER
+
+namespace detail {
+template<typename FmtT>
+void printStaticImpl(StaticFormat<FmtT> fmt, FormatListRef list, bool newline)
+{
+#ifdef TINYFORMAT_ATOMIC_PRINTF
+    formatLine(StreamWrite(std::cout), std::cout.getloc(), fmt, list, newline);
+#else
+    vformat(std::cout, fmt, list);
+    if (newline)
+        std::cout << '\n';
+#endif
+}
+} // namespace detail
+
+/// Format list of arguments to the stream according to a format string which
+/// was parsed at compile time.
+template<typename FmtT, typename... Args>
+void format(std::ostream& out, StaticFormat<FmtT>, const Args&... args)
+{
+    detail::checkStaticFormatArgs<FmtT, sizeof...(Args)>();
+    vformat(out, StaticFormat<FmtT>(), makeFormatList(args...));
+}
+
+template<typename FmtT, typename... Args>
+std::string format(StaticFormat<FmtT> fmt, const Args&... args)
+{
+    detail::StackStreambuf sbuf;
+    std::ostream out(&sbuf);
+    format(out, fmt, args...);
+    return sbuf.str();
+}
+
+template<typename FmtT, typename... Args>
+void printf(StaticFormat<FmtT> fmt, const Args&... args)
+{
+    detail::checkStaticFormatArgs<FmtT, sizeof...(Args)>();
+    detail::printStaticImpl(fmt, makeFormatList(args...), false);
+}
+
+template<typename FmtT, typename... Args>
+void printfln(StaticFormat<FmtT> fmt, const Args&... args)
+{
+    detail::checkStaticFormatArgs<FmtT, sizeof...(Args)>();
+    detail::printStaticImpl(fmt, makeFormatList(args...), true);
+}
+
+#endif // TINYFORMAT_USE_CONSTEXPR_PARSER
+
+
+#else // C++98 version
+
+inline void format(std::ostream& out, const char* fmt)
+{
+    vformat(out, fmt, makeFormatList());
+}
+
+inline std::string format(const char* fmt)
+{
+    return vformat(fmt, makeFormatList());
+}
+
+inline void format(std::ostream& out, const CompiledFormat& fmt)
+{
+    vformat(out, fmt, makeFormatList());
+}
+
+inline std::string format(const CompiledFormat& fmt)
+{
+    return vformat(fmt, makeFormatList());
+}
+
+template<typename Alloc>
+typename detail::AllocatorString<Alloc>::type
+format(const Alloc& alloc, const char* fmt)
+{
+    return vformat(alloc, fmt, makeFormatList());
+}
 
-#define TINYFORMAT_FOREACH_ARGNUM(m) \
-    m(1) m(2) m(3) m(4) m(5) m(6) m(7) m(8) m(9) m(10) m(11) m(12) m(13) m(14) m(15) m(16)
-//[[[end]]]
+template<typename Alloc>
+typename detail::AllocatorString<Alloc>::type
+format(const Alloc& alloc, const CompiledFormat& fmt)
+{
+    return vformat(alloc, fmt, makeFormatList());
+}
 
+inline void printf(const char* fmt)
+{
+    detail::printImpl(fmt, makeFormatList(), false);
+}
 
+inline void printfln(const char* fmt)
+{
+    detail::printImpl(fmt, makeFormatList(), true);
+}
 
-namespace detail {
+inline void fprintf(std::FILE* file, const char* fmt)
+{
+    detail::fprintfImpl(file, fmt, makeFormatList(), false);
+}
 
-// Type-opaque holder for an argument to format(), with associated actions on
-// the type held as explicit function pointers.  This allows FormatArg's for
-// each argument to be allocated as a homogeneous array inside FormatList
-// whereas a naive implementation based on inheritance does not.
-class FormatArg
+inline void fprintfln(std::FILE* file, const char* fmt)
 {
-    public:
-        FormatArg()
-            : m_value(NULL),
-            m_formatImpl(NULL),
-            m_toIntImpl(NULL)
-        { }
+    detail::fprintfImpl(file, fmt, makeFormatList(), true);
+}
 
-        template<typename T>
-        FormatArg(const T& value)
-            // C-style cast here allows us to also remove volatile; we put it
-            // back in the *Impl functions before dereferencing to avoid UB.
-            : m_value((const void*)(&value)),
-            m_formatImpl(&formatImpl<T>),
-            m_toIntImpl(&toIntImpl<T>)
-        { }
+inline std::size_t format_to(char* buf, std::size_t n, const char* fmt)
+{
+    return vformat_to(buf, n, fmt, makeFormatList());
+}
 
-        void format(std::ostream& out, const char* fmtBegin,
-                    const char* fmtEnd, int ntrunc) const
-        {
-            TINYFORMAT_ASSERT(m_value);
-            TINYFORMAT_ASSERT(m_formatImpl);
-            m_formatImpl(out, fmtBegin, fmtEnd, ntrunc, m_value);
-        }
+template<typename OutputIt>
+OutputIt format_to(OutputIt it, const char* fmt)
+{
+    return vformat_to(it, fmt, makeFormatList());
+}
 
-        int toInt() const
-        {
-            TINYFORMAT_ASSERT(m_value);
-            TINYFORMAT_ASSERT(m_toIntImpl);
-            return m_toIntImpl(m_value);
-        }
+inline std::size_t formatted_size(const char* fmt)
+{
+    return vformatted_size(fmt, makeFormatList());
+}
 
-    private:
-        template<typename T>
-        TINYFORMAT_HIDDEN static void formatImpl(std::ostream& out, const char* fmtBegin,
-                        const char* fmtEnd, int ntrunc, const void* value)
-        {
-            formatValue(out, fmtBegin, fmtEnd, ntrunc, *static_cast<const T*>(value));
-        }
+inline void append_format(std::string& str, const char* fmt)
+{
+    vappend_format(str, fmt, makeFormatList());
+}
 
-        template<typename T>
-        TINYFORMAT_HIDDEN static int toIntImpl(const void* value)
-        {
-            return convertToInt<T>::invoke(*static_cast<const T*>(value));
-        }
+inline void append_format(Buffer& buf, const char* fmt)
+{
+    vappend_format(buf, fmt, makeFormatList());
+}
 
-        const void* m_value;
-        void (*m_formatImpl)(std::ostream& out, const char* fmtBegin,
-                             const char* fmtEnd, int ntrunc, const void* value);
-        int (*m_toIntImpl)(const void* value);
-};
+inline void serialize_format(Buffer& out, std::size_t id)
+{
+    vserialize_format(out, id, makeFormatList());
+}
+
+#define TINYFORMAT_MAKE_FORMAT_FUNCS(n)                                   \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+void format(std::ostream& out, const char* fmt, TINYFORMAT_VARARGS(n))    \
+{                                                                         \
+    vformat(out, fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));            \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+std::string format(const char* fmt, TINYFORMAT_VARARGS(n))                \
+{                                                                         \
+    return vformat(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));          \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+void format(std::ostream& out, const CompiledFormat& fmt,                 \
+            TINYFORMAT_VARARGS(n))                                        \
+{                                                                         \
+    vformat(out, fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));            \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+std::string format(const CompiledFormat& fmt, TINYFORMAT_VARARGS(n))      \
+{                                                                         \
+    return vformat(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));          \
+}                                                                         \
+                                                                          \
+template<class Alloc, TINYFORMAT_ARGTYPES(n)>                             \
+typename detail::AllocatorString<Alloc>::type                             \
+format(const Alloc& alloc, const char* fmt, TINYFORMAT_VARARGS(n))        \
+{                                                                         \
+    return vformat(alloc, fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));   \
+}                                                                         \
+                                                                          \
+template<class Alloc, TINYFORMAT_ARGTYPES(n)>                             \
+typename detail::AllocatorString<Alloc>::type                             \
+format(const Alloc& alloc, const CompiledFormat& fmt,                     \
+       TINYFORMAT_VARARGS(n))                                             \
+{                                                                         \
+    return vformat(alloc, fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));   \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+void printf(const char* fmt, TINYFORMAT_VARARGS(n))                       \
+{                                                                         \
+    detail::printImpl(fmt,                                                \
+                      makeFormatList(TINYFORMAT_PASSARGS(n)), false);     \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+void printfln(const char* fmt, TINYFORMAT_VARARGS(n))                     \
+{                                                                         \
+    detail::printImpl(fmt,                                                \
+                      makeFormatList(TINYFORMAT_PASSARGS(n)), true);      \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+void fprintf(std::FILE* file, const char* fmt, TINYFORMAT_VARARGS(n))     \
+{                                                                         \
+    detail::fprintfImpl(file, fmt,                                        \
+                        makeFormatList(TINYFORMAT_PASSARGS(n)), false);   \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+void fprintfln(std::FILE* file, const char* fmt, TINYFORMAT_VARARGS(n))   \
+{                                                                         \
+    detail::fprintfImpl(file, fmt,                                        \
+                        makeFormatList(TINYFORMAT_PASSARGS(n)), true);    \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+std::size_t format_to(char* buf, std::size_t bufSize, const char* fmt,    \
+                      TINYFORMAT_VARARGS(n))                              \
+{                                                                         \
+    return vformat_to(buf, bufSize, fmt,                                  \
+                      makeFormatList(TINYFORMAT_PASSARGS(n)));            \
+}                                                                         \
+                                                                          \
+template<class OutputIt, TINYFORMAT_ARGTYPES(n)>                          \
+OutputIt format_to(OutputIt it, const char* fmt, TINYFORMAT_VARARGS(n))   \
+{                                                                         \
+    return vformat_to(it, fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));   \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+std::size_t formatted_size(const char* fmt, TINYFORMAT_VARARGS(n))        \
+{                                                                         \
+    return vformatted_size(fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));  \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+void append_format(std::string& str, const char* fmt,                     \
+                   TINYFORMAT_VARARGS(n))                                 \
+{                                                                         \
+    vappend_format(str, fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));     \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+void append_format(Buffer& buf, const char* fmt, TINYFORMAT_VARARGS(n))   \
+{                                                                         \
+    vappend_format(buf, fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));     \
+}                                                                         \
+                                                                          \
+template<TINYFORMAT_ARGTYPES(n)>                                          \
+void serialize_format(Buffer& out, std::size_t id, TINYFORMAT_VARARGS(n)) \
+{                                                                         \
+    vserialize_format(out, id, makeFormatList(TINYFORMAT_PASSARGS(n)));   \
+}
 
+TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_FORMAT_FUNCS)
+#undef TINYFORMAT_MAKE_FORMAT_FUNCS
 
-// Parse and return an integer from the string c, as atoi()
-// On return, c is set to one past the end of the integer.
-inline int parseIntAndAdvance(const char*& c)
+#endif
+
+//------------------------------------------------------------------------------
+// Definitions of the functions declared with TINYFORMAT_FUNC.  These are
+// compiled only into tinyformat.cpp when using separate compilation.
+#if !defined(TINYFORMAT_SEPARATE_COMPILATION) || defined(TINYFORMAT_IMPLEMENTATION)
+
+namespace detail {
+
+#if defined(TINYFORMAT_SIMD_AVX2) || defined(TINYFORMAT_SIMD_SSE2)
+// Index of the lowest set bit of the nonzero mask
+inline int lowestSetBit(unsigned mask)
 {
-    int i = 0;
-    for (;*c >= '0' && *c <= '9'; ++c)
-        i = 10*i + (*c - '0');
-    return i;
+#   ifdef _MSC_VER
+    unsigned long i = 0;
+    _BitScanForward(&i, mask);
+    return static_cast<int>(i);
+#   else
+    return __builtin_ctz(mask);
+#   endif
 }
+#elif defined(TINYFORMAT_SIMD_NEON)
+inline int lowestSetBit(uint64_t mask)
+{
+#   ifdef _MSC_VER
+    unsigned long i = 0;
+    _BitScanForward64(&i, mask);
+    return static_cast<int>(i);
+#   else
+    return __builtin_ctzll(mask);
+#   endif
+}
+#endif
 
-// Parse width or precision `n` from format string pointer `c`, and advance it
-// to the next character. If an indirection is requested with `*`, the argument
-// is read from `args[argIndex]` and `argIndex` is incremented (or read
-// from `args[n]` in positional mode). Returns true if one or more
-// characters were read.
-inline bool parseWidthOrPrecision(int& n, const char*& c, bool positionalMode,
-                                  const detail::FormatArg* args,
-                                  int& argIndex, int numArgs)
+TINYFORMAT_FUNC const char* findPercentOrNul(const char* c)
 {
-    if (*c >= '0' && *c <= '9') {
-        n = parseIntAndAdvance(c);
+#if defined(TINYFORMAT_SIMD_AVX2) || defined(TINYFORMAT_SIMD_SSE2) || \
+    defined(TINYFORMAT_SIMD_NEON)
+#   ifdef TINYFORMAT_SIMD_AVX2
+    const std::size_t blockSize = 32;
+#   else
+    const std::size_t blockSize = 16;
+#   endif
+    // Scan bytes up to a block boundary, after which aligned loads can't
+    // cross into an unmapped page.
+    for (; reinterpret_cast<std::size_t>(c) % blockSize != 0; ++c) {
+        if (*c == '\0' || *c == '%')
+            return c;
     }
-    else if (*c == '*') {
-        ++c;
-        n = 0;
-        if (positionalMode) {
-            int pos = parseIntAndAdvance(c) - 1;
-            if (*c != '$')
-                TINYFORMAT_ERROR("tinyformat: Non-positional argument used after a positional one");
-            if (pos >= 0 && pos < numArgs)
-                n = args[pos].toInt();
-            else
-                TINYFORMAT_ERROR("tinyformat: Positional argument out of range");
-            ++c;
-        }
-        else {
-            if (argIndex < numArgs)
-                n = args[argIndex++].toInt();
-            else
-                TINYFORMAT_ERROR("tinyformat: Not enough arguments to read variable width or precision");
-        }
+#   if defined(TINYFORMAT_SIMD_AVX2)
+    const __m256i percent = _mm256_set1_epi8('%');
+    const __m256i zero = _mm256_setzero_si256();
+    for (;; c += blockSize) {
+        const __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(c));
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, percent), _mm256_cmpeq_epi8(v, zero))));
+        if (mask)
+            return c + lowestSetBit(mask);
     }
-    else {
-        return false;
+#   elif defined(TINYFORMAT_SIMD_SSE2)
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i zero = _mm_setzero_si128();
+    for (;; c += blockSize) {
+        const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(c));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, percent), _mm_cmpeq_epi8(v, zero))));
+        if (mask)
+            return c + lowestSetBit(mask);
     }
-    return true;
+#   else
+    const uint8x16_t percent = vdupq_n_u8('%');
+    const uint8x16_t zero = vdupq_n_u8(0);
+    for (;; c += blockSize) {
+        const uint8x16_t v = vld1q_u8(reinterpret_cast<const unsigned char*>(c));
+        const uint8x16_t hits = vorrq_u8(vceqq_u8(v, percent), vceqq_u8(v, zero));
+        // Narrow to four mask bits per byte, as NEON has no movemask
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+        if (mask)
+            return c + lowestSetBit(mask)/4;
+    }
+#   endif
+#else
+    while (*c != '\0' && *c != '%')
+        ++c;
+    return c;
+#endif
 }
 
-// Print literal part of format string and return next format spec position.
-//
-// Skips over any occurrences of '%%', printing a literal '%' to the output.
-// The position of the first % character of the next nontrivial format spec is
-// returned, or the end of string.
-inline const char* printFormatStringLiteral(std::ostream& out, const char* fmt)
+TINYFORMAT_FUNC const char* printFormatStringLiteral(std::ostream& out, const char* fmt)
 {
     const char* c = fmt;
-    for (;; ++c) {
-        if (*c == '\0') {
-            out.write(fmt, c - fmt);
+    for (;;) {
+        c = findPercentOrNul(c);
+        out.write(fmt, c - fmt);
+        if (*c == '\0' || *(c+1) != '%')
             return c;
-        }
-        else if (*c == '%') {
-            out.write(fmt, c - fmt);
-            if (*(c+1) != '%')
-                return c;
-            // for "%%", tack trailing % onto next literal section.
-            fmt = ++c;
-        }
+        // for "%%", tack trailing % onto next literal section.
+        fmt = ++c;
+        ++c;
     }
 }
 
-
-// Parse a format string and set the stream state accordingly.
-//
-// The format mini-language recognized here is meant to be the one from C99,
-// with the form "%[flags][width][.precision][length]type" with POSIX
-// positional arguments extension.
-//
-// POSIX positional arguments extension:
-// Conversions can be applied to the nth argument after the format in
-// the argument list, rather than to the next unused argument. In this case,
-// the conversion specifier character % (see below) is replaced by the sequence
-// "%n$", where n is a decimal integer in the range [1,{NL_ARGMAX}],
-// giving the position of the argument in the argument list. This feature
-// provides for the definition of format strings that select arguments
-// in an order appropriate to specific languages.
-//
-// The format can contain either numbered argument conversion specifications
-// (that is, "%n$" and "*m$"), or unnumbered argument conversion specifications
-// (that is, % and * ), but not both. The only exception to this is that %%
-// can be mixed with the "%n$" form. The results of mixing numbered and
-// unnumbered argument specifications in a format string are undefined.
-// When numbered argument specifications are used, specifying the Nth argument
-// requires that all the leading arguments, from the first to the (N-1)th,
-// are specified in the format string.
-//
-// In format strings containing the "%n$" form of conversion specification,
-// numbered arguments in the argument list can be referenced from the format
-// string as many times as required.
-//
-// Formatting options which can't be natively represented using the ostream
-// state are returned in spacePadPositive (for space padded positive numbers)
-// and ntrunc (for truncating conversions).  argIndex is incremented if
-// necessary to pull out variable width and precision.  The function returns a
-// pointer to the character after the end of the current format spec.
-inline const char* streamStateFromFormat(std::ostream& out, bool& positionalMode,
-                                         bool& spacePadPositive,
-                                         int& ntrunc, const char* fmtStart,
-                                         const detail::FormatArg* args,
-                                         int& argIndex, int numArgs)
+TINYFORMAT_FUNC bool resolveWidthOrPrecision(int& n, int argRef,
+                                             const detail::FormatArg* args,
+                                             int& argIndex, int numArgs)
 {
-    TINYFORMAT_ASSERT(*fmtStart == '%');
-    // Reset stream state to defaults.
-    out.width(0);
-    out.precision(6);
-    out.fill(' ');
-    // Reset most flags; ignore irrelevant unitbuf & skipws.
-    out.unsetf(std::ios::adjustfield | std::ios::basefield |
-               std::ios::floatfield | std::ios::showbase | std::ios::boolalpha |
-               std::ios::showpoint | std::ios::showpos | std::ios::uppercase);
-    bool precisionSet = false;
-    bool widthSet = false;
-    int widthExtra = 0;
-    const char* c = fmtStart + 1;
-
-    // 1) Parse an argument index (if followed by '$') or a width possibly
-    // preceded with '0' flag.
-    if (*c >= '0' && *c <= '9') {
-        const char tmpc = *c;
-        int value = parseIntAndAdvance(c);
-        if (*c == '$') {
-            // value is an argument index
-            if (value > 0 && value <= numArgs)
-                argIndex = value - 1;
-            else
-                TINYFORMAT_ERROR("tinyformat: Positional argument out of range");
-            ++c;
-            positionalMode = true;
+    if (argRef >= 0) {
+        if (argRef < numArgs) {
+            n = args[argRef].toInt();
+            return true;
         }
-        else if (positionalMode) {
-            TINYFORMAT_ERROR("tinyformat: Non-positional argument used after a positional one");
+        TINYFORMAT_RAISE_ERROR("tinyformat: Positional argument out of range");
+    }
+    else {
+        if (argIndex < numArgs) {
+            n = args[argIndex++].toInt();
+            return true;
         }
-        else {
-            if (tmpc == '0') {
-                // Use internal padding so that numeric values are
-                // formatted correctly, eg -00010 rather than 000-10
-                out.fill('0');
-                out.setf(std::ios::internal, std::ios::adjustfield);
-            }
-            if (value != 0) {
-                // Nonzero value means that we parsed width.
-                widthSet = true;
-                out.width(value);
-            }
+        TINYFORMAT_RAISE_ERROR("tinyformat: Not enough arguments to read variable width or precision");
+    }
+    n = 0;
+    return false;
+}
+
+TINYFORMAT_FUNC bool streamStateFromSpec(std::ostream& out, bool& spacePadPositive,
+                                         int& ntrunc, const FormatSpec& spec,
+                                         const detail::FormatArg* args,
+                                         int& argIndex, int numArgs)
+{
+    const unsigned flags = spec.flags;
+    // Build the new stream state from the defaults, and only apply it to the
+    // stream at the end where it differs from the current state.  Most
+    // flags are reset; irrelevant unitbuf & skipws are left alone.
+    std::ios::fmtflags f = out.flags() &
+        ~(std::ios::adjustfield | std::ios::basefield |
+          std::ios::floatfield | std::ios::showbase | std::ios::boolalpha |
+          std::ios::showpoint | std::ios::showpos | std::ios::uppercase);
+    std::streamsize width = 0;
+    std::streamsize precision = 6;
+    char fill = ' ';
+    if (spec.argIndex >= 0) {
+        if (spec.argIndex >= numArgs) {
+            TINYFORMAT_RAISE_ERROR("tinyformat: Positional argument out of range");
+            return false;
         }
+        argIndex = spec.argIndex;
     }
-    else if (positionalMode) {
-        TINYFORMAT_ERROR("tinyformat: Non-positional argument used after a positional one");
-    }
-    // 2) Parse flags and width if we did not do it in previous step.
-    if (!widthSet) {
-        // Parse flags
-        for (;; ++c) {
-            switch (*c) {
-                case '#':
-                    out.setf(std::ios::showpoint | std::ios::showbase);
-                    continue;
-                case '0':
-                    // overridden by left alignment ('-' flag)
-                    if (!(out.flags() & std::ios::left)) {
-                        // Use internal padding so that numeric values are
-                        // formatted correctly, eg -00010 rather than 000-10
-                        out.fill('0');
-                        out.setf(std::ios::internal, std::ios::adjustfield);
-                    }
-                    continue;
-                case '-':
-                    out.fill(' ');
-                    out.setf(std::ios::left, std::ios::adjustfield);
-                    continue;
-                case ' ':
-                    // overridden by show positive sign, '+' flag.
-                    if (!(out.flags() & std::ios::showpos))
-                        spacePadPositive = true;
-                    continue;
-                case '+':
-                    out.setf(std::ios::showpos);
-                    spacePadPositive = false;
-                    widthExtra = 1;
-                    continue;
-                default:
-                    break;
-            }
-            break;
-        }
-        // Parse width
-        int width = 0;
-        widthSet = parseWidthOrPrecision(width, c, positionalMode,
-                                         args, argIndex, numArgs);
-        if (widthSet) {
-            if (width < 0) {
-                // negative widths correspond to '-' flag set
-                out.fill(' ');
-                out.setf(std::ios::left, std::ios::adjustfield);
-                width = -width;
-            }
-            out.width(width);
+    bool leftAlign = (flags & FormatSpec::Flag_Left) != 0;
+    if (flags & FormatSpec::Flag_Alt)
+        f |= std::ios::showpoint | std::ios::showbase;
+    // '+' overrides ' '
+    if (flags & FormatSpec::Flag_Plus)
+        f |= std::ios::showpos;
+    else if (flags & FormatSpec::Flag_Space)
+        spacePadPositive = true;
+    const bool widthSet = (flags & FormatSpec::Flag_WidthSet) != 0;
+    if (widthSet) {
+        int w = spec.width;
+        if ((flags & FormatSpec::Flag_WidthArg) &&
+            !resolveWidthOrPrecision(w, spec.widthArg, args, argIndex, numArgs))
+            return false;
+        if (w < 0) {
+            // negative widths correspond to '-' flag set
+            leftAlign = true;
+            w = -w;
         }
+        width = w;
     }
-    // 3) Parse precision
-    if (*c == '.') {
-        ++c;
-        int precision = 0;
-        parseWidthOrPrecision(precision, c, positionalMode,
-                              args, argIndex, numArgs);
+    if (leftAlign) {
+        // '-' overrides '0'
+        f |= std::ios::left;
+    }
+    else if (flags & FormatSpec::Flag_Zero) {
+        // Use internal padding so that numeric values are
+        // formatted correctly, eg -00010 rather than 000-10
+        fill = '0';
+        f |= std::ios::internal;
+    }
+    bool precisionSet = false;
+    if (flags & FormatSpec::Flag_PrecisionSet) {
+        int p = spec.precision;
+        if ((flags & FormatSpec::Flag_PrecisionArg) &&
+            !resolveWidthOrPrecision(p, spec.precisionArg, args, argIndex, numArgs))
+            return false;
         // Presence of `.` indicates precision set, unless the inferred value
         // was negative in which case the default is used.
-        precisionSet = precision >= 0;
+        precisionSet = p >= 0;
         if (precisionSet)
-            out.precision(precision);
-    }
-    // 4) Ignore any C99 length modifier
-    while (*c == 'l' || *c == 'h' || *c == 'L' ||
-           *c == 'j' || *c == 'z' || *c == 't') {
-        ++c;
+            precision = p;
     }
-    // 5) We're up to the conversion specifier character.
     // Set stream flags based on conversion specifier (thanks to the
     // boost::format class for forging the way here).
     bool intConversion = false;
-    switch (*c) {
+    switch (spec.conversion) {
         case 'u': case 'd': case 'i':
-            out.setf(std::ios::dec, std::ios::basefield);
+            f |= std::ios::dec;
             intConversion = true;
             break;
         case 'o':
-            out.setf(std::ios::oct, std::ios::basefield);
+            f |= std::ios::oct;
             intConversion = true;
             break;
         case 'X':
-            out.setf(std::ios::uppercase);
+            f |= std::ios::uppercase;
             // Falls through
         case 'x': case 'p':
-            out.setf(std::ios::hex, std::ios::basefield);
+            f |= std::ios::hex;
             intConversion = true;
             break;
         case 'E':
-            out.setf(std::ios::uppercase);
+            f |= std::ios::uppercase;
             // Falls through
         case 'e':
-            out.setf(std::ios::scientific, std::ios::floatfield);
-            out.setf(std::ios::dec, std::ios::basefield);
+            f |= std::ios::scientific | std::ios::dec;
             break;
         case 'F':
-            out.setf(std::ios::uppercase);
+            f |= std::ios::uppercase;
             // Falls through
         case 'f':
-            out.setf(std::ios::fixed, std::ios::floatfield);
+            f |= std::ios::fixed;
             break;
         case 'A':
-            out.setf(std::ios::uppercase);
+            f |= std::ios::uppercase;
             // Falls through
         case 'a':
 #           ifdef _MSC_VER
             // Workaround https://developercommunity.visualstudio.com/content/problem/520472/hexfloat-stream-output-does-not-ignore-precision-a.html
             // by always setting maximum precision on MSVC to avoid precision
             // loss for doubles.
-            out.precision(13);
+            precision = 13;
 #           endif
-            out.setf(std::ios::fixed | std::ios::scientific, std::ios::floatfield);
+            f |= std::ios::fixed | std::ios::scientific;
             break;
-        case 'G':
-            out.setf(std::ios::uppercase);
+        case 'G': case 'R':
+            f |= std::ios::uppercase;
             // Falls through
-        case 'g':
-            out.setf(std::ios::dec, std::ios::basefield);
+        case 'g': case 'r':
             // As in boost::format, let stream decide float format.
-            out.flags(out.flags() & ~std::ios::floatfield);
+            f |= std::ios::dec;
             break;
         case 'c':
             // Handled as special case inside formatValue()
             break;
         case 's':
             if (precisionSet)
-                ntrunc = static_cast<int>(out.precision());
+                ntrunc = static_cast<int>(precision);
             // Make %s print Booleans as "true" and "false"
-            out.setf(std::ios::boolalpha);
+            f |= std::ios::boolalpha;
             break;
-        case 'n':
-            // Not supported - will cause problems!
-            TINYFORMAT_ERROR("tinyformat: %n conversion spec not supported");
-            break;
-        case '\0':
-            TINYFORMAT_ERROR("tinyformat: Conversion spec incorrectly "
-                             "terminated by end of string");
-            return c;
         default:
             break;
     }
@@ -853,294 +7094,433 @@ inline const char* streamStateFromFormat(std::ostream& out, bool& positionalMode
         // padded with zeros on the left).  This isn't really supported by the
         // iostreams, but we can approximately simulate it with the width if
         // the width isn't otherwise used.
-        out.width(out.precision() + widthExtra);
-        out.setf(std::ios::internal, std::ios::adjustfield);
-        out.fill('0');
+        width = precision + ((flags & FormatSpec::Flag_Plus) ? 1 : 0);
+        f = (f & ~std::ios::adjustfield) | std::ios::internal;
+        fill = '0';
     }
-    return c+1;
+    if (f != out.flags())
+        out.flags(f);
+    if (width != out.width())
+        out.width(width);
+    if (precision != out.precision())
+        out.precision(precision);
+    if (fill != out.fill())
+        out.fill(fill);
+    return true;
 }
 
-
-//------------------------------------------------------------------------------
-inline void formatImpl(std::ostream& out, const char* fmt,
-                       const detail::FormatArg* args,
-                       int numArgs)
+TINYFORMAT_FUNC bool formatSpecArg(std::ostream& out, const FormatSpec& spec,
+                                   const char* fmtBegin, const char* fmtEnd,
+                                   const detail::FormatArg* args,
+                                   int& argIndex, int numArgs)
 {
-    // Saved stream state
-    std::streamsize origWidth = out.width();
-    std::streamsize origPrecision = out.precision();
-    std::ios::fmtflags origFlags = out.flags();
-    char origFill = out.fill();
+    bool spacePadPositive = false;
+    int ntrunc = -1;
+    if (!streamStateFromSpec(out, spacePadPositive, ntrunc, spec,
+                             args, argIndex, numArgs))
+        return false;
+    // NB: argIndex may be incremented by reading variable width/precision
+    // in `streamStateFromSpec`, so do the bounds check here.
+    if (argIndex >= numArgs) {
+        TINYFORMAT_RAISE_ERROR("tinyformat: Too many conversion specifiers in format string");
+        return false;
+    }
+    const FormatArg& arg = args[argIndex];
+    // Format the arg into the stream.
+    if (!spacePadPositive) {
+        arg.format(out, fmtBegin, fmtEnd, ntrunc);
+    }
+    else {
+        // The following is a special case with no direct correspondence
+        // between stream formatting and the printf() behaviour.  Simulate
+        // it crudely by formatting into a scratch buffer on the stack and
+        // munging the result.
+#ifdef TINYFORMAT_STATS
+        threadStats().spacePadded.add(1);
+#endif
+        StackStreambuf buf;
+        std::ostream tmpStream(&buf);
+        tmpStream.copyfmt(out);
+        tmpStream.setf(std::ios::showpos);
+        arg.formatGeneric(tmpStream, fmtBegin, fmtEnd, ntrunc);
+        std::replace(buf.data(), buf.data() + buf.size(), '+', ' ');
+        writePadded(out, buf.data(), static_cast<std::streamsize>(buf.size()));
+    }
+    if (spec.argIndex < 0)
+        ++argIndex;
+    return true;
+}
 
+TINYFORMAT_FUNC void formatImpl(std::ostream& out, const char* fmt,
+                                const detail::FormatArg* args,
+                                int numArgs)
+{
+#ifdef TINYFORMAT_STATS
+    StatsScope stats(out, fmt);
+#endif
     // "Positional mode" means all format specs should be of the form "%n$..."
-    // with `n` an integer. We detect this in `streamStateFromFormat`.
+    // with `n` an integer. We detect this in `parseFormatSpec`.
     bool positionalMode = false;
     int argIndex = 0;
     while (true) {
         fmt = printFormatStringLiteral(out, fmt);
         if (*fmt == '\0') {
             if (!positionalMode && argIndex < numArgs) {
-                TINYFORMAT_ERROR("tinyformat: Not enough conversion specifiers in format string");
+                TINYFORMAT_RAISE_ERROR("tinyformat: Not enough conversion specifiers in format string");
             }
             break;
         }
-        bool spacePadPositive = false;
-        int ntrunc = -1;
-        const char* fmtEnd = streamStateFromFormat(out, positionalMode, spacePadPositive, ntrunc, fmt,
-                                                   args, argIndex, numArgs);
-        // NB: argIndex may be incremented by reading variable width/precision
-        // in `streamStateFromFormat`, so do the bounds check here.
-        if (argIndex >= numArgs) {
-            TINYFORMAT_ERROR("tinyformat: Too many conversion specifiers in format string");
-            return;
-        }
-        const FormatArg& arg = args[argIndex];
-        // Format the arg into the stream.
-        if (!spacePadPositive) {
-            arg.format(out, fmt, fmtEnd, ntrunc);
-        }
-        else {
-            // The following is a special case with no direct correspondence
-            // between stream formatting and the printf() behaviour.  Simulate
-            // it crudely by formatting into a temporary string stream and
-            // munging the resulting string.
-            std::ostringstream tmpStream;
-            tmpStream.copyfmt(out);
-            tmpStream.setf(std::ios::showpos);
-            arg.format(tmpStream, fmt, fmtEnd, ntrunc);
-            std::string result = tmpStream.str(); // allocates... yuck.
-            for (size_t i = 0, iend = result.size(); i < iend; ++i) {
-                if (result[i] == '+')
-                    result[i] = ' ';
-            }
-            out << result;
-        }
-        if (!positionalMode)
-            ++argIndex;
+        FormatSpec spec;
+        const char* fmtEnd = parseFormatSpec(spec, positionalMode, fmt);
+        if (!formatSpecArg(out, spec, fmt, fmtEnd, args, argIndex, numArgs))
+            break;
         fmt = fmtEnd;
     }
-
-    // Restore stream state
-    out.width(origWidth);
-    out.precision(origPrecision);
-    out.flags(origFlags);
-    out.fill(origFill);
 }
 
-} // namespace detail
-
+TINYFORMAT_FUNC void formatSegmentsImpl(std::ostream& out, const char* fmt,
+                                        const FormatSegment* segments, int numSegments,
+                                        int tailBegin, int tailEnd, bool positionalMode,
+                                        const detail::FormatArg* args, int numArgs)
+{
+#ifdef TINYFORMAT_STATS
+    StatsScope stats(out, fmt);
+#endif
+    int argIndex = 0;
+    bool ok = true;
+    for (int i = 0; i < numSegments; ++i) {
+        const FormatSegment& seg = segments[i];
+        out.write(fmt + seg.literalBegin, seg.literalEnd - seg.literalBegin);
+        if (seg.spec.conversion == '%')
+            continue;
+        if (!formatSpecArg(out, seg.spec, fmt + seg.literalEnd, fmt + seg.specEnd,
+                           args, argIndex, numArgs)) {
+            ok = false;
+            break;
+        }
+    }
+    if (ok) {
+        out.write(fmt + tailBegin, tailEnd - tailBegin);
+        if (!positionalMode && argIndex < numArgs)
+            TINYFORMAT_RAISE_ERROR("tinyformat: Not enough conversion specifiers in format string");
+    }
+}
 
-/// List of template arguments format(), held in a type-opaque way.
-///
-/// A const reference to FormatList (typedef'd as FormatListRef) may be
-/// conveniently used to pass arguments to non-template functions: All type
-/// information has been stripped from the arguments, leaving just enough of a
-/// common interface to perform formatting as required.
-class FormatList
+#ifdef TINYFORMAT_USE_FLOAT_ENGINE
+TINYFORMAT_FUNC void writeFloat(std::ostream& out, double value)
 {
-    public:
-        FormatList(detail::FormatArg* args, int N)
-            : m_args(args), m_N(N) { }
+    char buf[64];
+    std::streamsize prefixLen = 0;
+    const int len = hasClassicLocale(out) ? formatFloat(buf, value, out, prefixLen) : -1;
+    if (len < 0)
+        streamFloat(out, value);
+    else
+        writePadded(out, buf, len, prefixLen);
+}
+#endif
 
-        friend void vformat(std::ostream& out, const char* fmt,
-                            const FormatList& list);
+TINYFORMAT_FUNC void fprintfImpl(std::FILE* file, const char* fmt, FormatListRef list,
+                                 bool newline)
+{
+    formatLine(FileWrite(file), std::locale(), fmt, list, newline);
+}
 
-    private:
-        const detail::FormatArg* m_args;
-        int m_N;
-};
+TINYFORMAT_FUNC void printImpl(const char* fmt, FormatListRef list, bool newline)
+{
+#ifdef TINYFORMAT_ATOMIC_PRINTF
+    formatLine(StreamWrite(std::cout), std::cout.getloc(), fmt, list, newline);
+#else
+    vformat(std::cout, fmt, list);
+    if (newline)
+        std::cout << '\n';
+#endif
+}
 
-/// Reference to type-opaque format list for passing to vformat()
-typedef const FormatList& FormatListRef;
+// Append v to out as an unsigned LEB128 varint
+inline void serializeVarint(Buffer& out, std::size_t v)
+{
+    char buf[(8*sizeof(std::size_t) + 6)/7];
+    std::size_t n = 0;
+    for (; v >= 0x80; v >>= 7)
+        buf[n++] = static_cast<char>((v & 0x7f) | 0x80);
+    buf[n++] = static_cast<char>(v);
+    out.append(buf, n);
+}
 
+template<typename T>
+inline void serializeValue(Buffer& out, FormatArgType tag, const T& value)
+{
+    char rec[1 + sizeof(T)];
+    rec[0] = static_cast<char>(tag);
+    std::memcpy(rec + 1, &value, sizeof(T));
+    out.append(rec, sizeof(rec));
+}
 
-namespace detail {
+inline void serializeString(Buffer& out, const char* s, std::size_t n)
+{
+    out.push_back(static_cast<char>(ArgString));
+    serializeVarint(out, n);
+    out.append(s, n);
+}
 
-// Format list subclass with fixed storage to avoid dynamic allocation
-template<std::size_t N>
-class FormatListN : public FormatList
+// A null C string is written as the tag ArgConstCharPtr with no value.
+inline void serializeCString(Buffer& out, const char* s)
 {
-    public:
-#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
-        template<typename... Args>
-        FormatListN(const Args&... args)
-            : FormatList(&m_formatterStore[0], N),
-            m_formatterStore { FormatArg(args)... }
-        { static_assert(sizeof...(args) == N, "Number of args must be N"); }
-#else // C++98 version
-        void init(int) {}
-#       define TINYFORMAT_MAKE_FORMATLIST_CONSTRUCTOR(n)                \
-                                                                        \
-        template<TINYFORMAT_ARGTYPES(n)>                                \
-        FormatListN(TINYFORMAT_VARARGS(n))                              \
-            : FormatList(&m_formatterStore[0], n)                       \
-        { TINYFORMAT_ASSERT(n == N); init(0, TINYFORMAT_PASSARGS(n)); } \
-                                                                        \
-        template<TINYFORMAT_ARGTYPES(n)>                                \
-        void init(int i, TINYFORMAT_VARARGS(n))                         \
-        {                                                               \
-            m_formatterStore[i] = FormatArg(v1);                        \
-            init(i+1 TINYFORMAT_PASSARGS_TAIL(n));                      \
-        }
+    if (!s)
+        out.push_back(static_cast<char>(ArgConstCharPtr));
+    else
+        serializeString(out, s, std::strlen(s));
+}
 
-        TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_FORMATLIST_CONSTRUCTOR)
-#       undef TINYFORMAT_MAKE_FORMATLIST_CONSTRUCTOR
+TINYFORMAT_FUNC void FormatArg::serialize(Buffer& out) const
+{
+    TINYFORMAT_ASSERT(m_value);
+    TINYFORMAT_ASSERT(m_actions);
+    switch (m_actions->type) {
+        case ArgBool:             serializeValue(out, ArgBool, static_cast<unsigned char>(get<bool>())); return;
+        case ArgChar:             serializeValue(out, ArgChar, get<char>()); return;
+        case ArgSignedChar:       serializeValue(out, ArgSignedChar, get<signed char>()); return;
+        case ArgUnsignedChar:     serializeValue(out, ArgUnsignedChar, get<unsigned char>()); return;
+        case ArgShort:            serializeValue(out, ArgShort, get<short>()); return;
+        case ArgUnsignedShort:    serializeValue(out, ArgUnsignedShort, get<unsigned short>()); return;
+        case ArgInt:              serializeValue(out, ArgInt, get<int>()); return;
+        case ArgUnsigned:         serializeValue(out, ArgUnsigned, get<unsigned int>()); return;
+        case ArgLong:             serializeValue(out, ArgLong, get<long>()); return;
+        case ArgUnsignedLong:     serializeValue(out, ArgUnsignedLong, get<unsigned long>()); return;
+#ifdef TINYFORMAT_HAS_LONG_LONG
+        case ArgLongLong:         serializeValue(out, ArgLongLong, get<long long>()); return;
+        case ArgUnsignedLongLong: serializeValue(out, ArgUnsignedLongLong, get<unsigned long long>()); return;
 #endif
-        FormatListN(const FormatListN& other)
-            : FormatList(&m_formatterStore[0], N)
-        { std::copy(&other.m_formatterStore[0], &other.m_formatterStore[N],
-                    &m_formatterStore[0]); }
-
-    private:
-        FormatArg m_formatterStore[N];
-};
+        case ArgFloat:            serializeValue(out, ArgFloat, get<float>()); return;
+        case ArgDouble:           serializeValue(out, ArgDouble, get<double>()); return;
+        case ArgLongDouble:       serializeValue(out, ArgLongDouble, get<long double>()); return;
+        case ArgConstVoidPtr:     serializeValue(out, ArgConstVoidPtr, get<const void*>()); return;
+        case ArgVoidPtr:          serializeValue(out, ArgVoidPtr, get<void*>()); return;
+        case ArgConstCharPtr:     serializeCString(out, get<const char*>()); return;
+        case ArgCharPtr:          serializeCString(out, get<char*>()); return;
+        case ArgCharArray:        serializeCString(out, static_cast<const char*>(m_value)); return;
+        case ArgString:           serializeString(out, get<std::string>().data(),
+                                                  get<std::string>().size()); return;
+#ifdef TINYFORMAT_HAS_STRING_VIEW
+        case ArgStringView:       serializeString(out, get<std::string_view>().data(),
+                                                  get<std::string_view>().size()); return;
+#endif
+        default: {
+            // Anything else is serialized as its text
+            static const char spec[] = "%s";
+            StackStreambuf sbuf;
+            std::ostream text(&sbuf);
+            m_actions->format(text, spec, spec + 2, -1, m_value);
+            serializeString(out, sbuf.data(), sbuf.size());
+            return;
+        }
+    }
+}
 
-// Special 0-arg version - MSVC says zero-sized C array in struct is nonstandard
-template<> class FormatListN<0> : public FormatList
+enum DecodeStatus
 {
-    public: FormatListN() : FormatList(0, 0) {}
+    DecodeOk,
+    DecodeIncomplete,
+    DecodeBad
 };
 
-} // namespace detail
-
-
-//------------------------------------------------------------------------------
-// Primary API functions
+// Read a varint written by serializeVarint() from the data at p, advancing p
+inline DecodeStatus decodeVarint(std::size_t& v, const char*& p, const char* end)
+{
+    v = 0;
+    for (std::size_t shift = 0; p != end; shift += 7) {
+        if (shift >= 8*sizeof(std::size_t))
+            return DecodeBad;
+        const unsigned char b = static_cast<unsigned char>(*p++);
+        v |= static_cast<std::size_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return DecodeOk;
+    }
+    return DecodeIncomplete;
+}
 
-#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+template<typename T>
+inline DecodeStatus decodeValue(FormatArgStore& args, const char*& p, const char* end)
+{
+    if (static_cast<std::size_t>(end - p) < sizeof(T))
+        return DecodeIncomplete;
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    args.push_back(value);
+    return DecodeOk;
+}
 
-/// Make type-agnostic format list from list of template arguments.
-///
-/// The exact return type of this function is an implementation detail and
-/// shouldn't be relied upon.  Instead it should be stored as a FormatListRef:
-///
-///   FormatListRef formatList = makeFormatList( /*...*/ );
-template<typename... Args>
-detail::FormatListN<sizeof...(Args)> makeFormatList(const Args&... args)
+// Read a tagged value written by FormatArg::serialize() from the data at p,
+// advancing p, and append it to args.
+inline DecodeStatus decodeArg(FormatArgStore& args, const char*& p, const char* end)
 {
-    return detail::FormatListN<sizeof...(args)>(args...);
+    if (p == end)
+        return DecodeIncomplete;
+    switch (static_cast<unsigned char>(*p++)) {
+        case ArgBool:
+            if (p == end)
+                return DecodeIncomplete;
+            args.push_back(*p++ != 0);
+            return DecodeOk;
+        case ArgChar:             return decodeValue<char>(args, p, end);
+        case ArgSignedChar:       return decodeValue<signed char>(args, p, end);
+        case ArgUnsignedChar:     return decodeValue<unsigned char>(args, p, end);
+        case ArgShort:            return decodeValue<short>(args, p, end);
+        case ArgUnsignedShort:    return decodeValue<unsigned short>(args, p, end);
+        case ArgInt:              return decodeValue<int>(args, p, end);
+        case ArgUnsigned:         return decodeValue<unsigned int>(args, p, end);
+        case ArgLong:             return decodeValue<long>(args, p, end);
+        case ArgUnsignedLong:     return decodeValue<unsigned long>(args, p, end);
+#ifdef TINYFORMAT_HAS_LONG_LONG
+        case ArgLongLong:         return decodeValue<long long>(args, p, end);
+        case ArgUnsignedLongLong: return decodeValue<unsigned long long>(args, p, end);
+#endif
+        case ArgFloat:            return decodeValue<float>(args, p, end);
+        case ArgDouble:           return decodeValue<double>(args, p, end);
+        case ArgLongDouble:       return decodeValue<long double>(args, p, end);
+        case ArgConstVoidPtr:     return decodeValue<const void*>(args, p, end);
+        case ArgVoidPtr:          return decodeValue<void*>(args, p, end);
+        case ArgConstCharPtr:
+            args.push_back(static_cast<const char*>(NULL));
+            return DecodeOk;
+        case ArgString: {
+            std::size_t n = 0;
+            const DecodeStatus status = decodeVarint(n, p, end);
+            if (status != DecodeOk)
+                return status;
+            if (static_cast<std::size_t>(end - p) < n)
+                return DecodeIncomplete;
+            args.push_back(std::string(p, n));
+            p += n;
+            return DecodeOk;
+        }
+        default:
+            return DecodeBad;
+    }
 }
 
-#else // C++98 version
+} // namespace detail
 
-inline detail::FormatListN<0> makeFormatList()
+TINYFORMAT_FUNC void CompiledFormat::parse(const detail::ArgNames* names)
 {
-    return detail::FormatListN<0>();
-}
-#define TINYFORMAT_MAKE_MAKEFORMATLIST(n)                     \
-template<TINYFORMAT_ARGTYPES(n)>                              \
-detail::FormatListN<n> makeFormatList(TINYFORMAT_VARARGS(n))  \
-{                                                             \
-    return detail::FormatListN<n>(TINYFORMAT_PASSARGS(n));    \
+    const char* fmt = m_fmt.c_str();
+    const char* c = fmt;
+    detail::FormatSegment seg;
+    for (;;) {
+        const char* literal = c;
+        c = detail::findPercentOrNul(c);
+        if (!detail::parseFormatSegmentAt(seg, m_positionalMode, fmt, literal, c, names))
+            break;
+        detail::countSegmentArgs(m_numArgs, seg, m_positionalMode);
+        m_segments.push_back(seg);
+        seg = detail::FormatSegment();
+    }
+    m_tailBegin = static_cast<int>(c - fmt);
 }
-TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_MAKEFORMATLIST)
-#undef TINYFORMAT_MAKE_MAKEFORMATLIST
 
-#endif
-
-/// Format list of arguments to the stream according to the given format string.
-///
-/// The name vformat() is chosen for the semantic similarity to vprintf(): the
-/// list of format arguments is held in a single function argument.
-inline void vformat(std::ostream& out, const char* fmt, FormatListRef list)
+TINYFORMAT_FUNC void vformat(std::ostream& out, const char* fmt, FormatListRef list)
 {
+    detail::StreamStateSaver saved(out);
     detail::formatImpl(out, fmt, list.m_args, list.m_N);
 }
 
-
-#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
-
-/// Format list of arguments to the stream according to given format string.
-template<typename... Args>
-void format(std::ostream& out, const char* fmt, const Args&... args)
+TINYFORMAT_FUNC void vformat(std::ostream& out, const CompiledFormat& fmt, FormatListRef list)
 {
-    vformat(out, fmt, makeFormatList(args...));
+    detail::StreamStateSaver saved(out);
+    detail::formatSegmentsImpl(out, fmt.m_fmt.c_str(),
+                               fmt.m_segments.empty() ? NULL : &fmt.m_segments[0],
+                               static_cast<int>(fmt.m_segments.size()),
+                               fmt.m_tailBegin, static_cast<int>(fmt.m_fmt.size()),
+                               fmt.m_positionalMode, list.m_args, list.m_N);
 }
 
-/// Format list of arguments according to the given format string and return
-/// the result as a string.
-template<typename... Args>
-std::string format(const char* fmt, const Args&... args)
+TINYFORMAT_FUNC std::string vformat(const char* fmt, FormatListRef list)
 {
-    std::ostringstream oss;
-    format(oss, fmt, args...);
-    return oss.str();
+    detail::StackStreambuf sbuf;
+    std::ostream out(&sbuf);
+    vformat(out, fmt, list);
+    return sbuf.str();
 }
 
-/// Format list of arguments to std::cout, according to the given format string
-template<typename... Args>
-void printf(const char* fmt, const Args&... args)
+TINYFORMAT_FUNC std::string vformat(const CompiledFormat& fmt, FormatListRef list)
 {
-    format(std::cout, fmt, args...);
+    detail::StackStreambuf sbuf;
+    std::ostream out(&sbuf);
+    vformat(out, fmt, list);
+    return sbuf.str();
 }
 
-template<typename... Args>
-void printfln(const char* fmt, const Args&... args)
+TINYFORMAT_FUNC void vappend_format(std::string& str, const char* fmt, FormatListRef list)
 {
-    format(std::cout, fmt, args...);
-    std::cout << '\n';
+    detail::StringAppendStreambuf sbuf(str);
+    std::ostream out(&sbuf);
+    vformat(out, fmt, list);
 }
 
-
-#else // C++98 version
-
-inline void format(std::ostream& out, const char* fmt)
+TINYFORMAT_FUNC void vappend_format(Buffer& buf, const char* fmt, FormatListRef list)
 {
-    vformat(out, fmt, makeFormatList());
+    detail::BufferAppendStreambuf sbuf(buf);
+    std::ostream out(&sbuf);
+    vformat(out, fmt, list);
 }
 
-inline std::string format(const char* fmt)
+TINYFORMAT_FUNC std::size_t vformat_to(char* buf, std::size_t n, const char* fmt,
+                                       FormatListRef list)
 {
-    std::ostringstream oss;
-    format(oss, fmt);
-    return oss.str();
+    detail::ArrayStreambuf sbuf(buf, n);
+    std::ostream out(&sbuf);
+    vformat(out, fmt, list);
+    return sbuf.size();
 }
 
-inline void printf(const char* fmt)
+TINYFORMAT_FUNC void vserialize_format(Buffer& out, std::size_t id, FormatListRef list)
 {
-    format(std::cout, fmt);
+    detail::serializeVarint(out, id);
+    detail::serializeVarint(out, static_cast<std::size_t>(list.m_N));
+    for (int i = 0; i < list.m_N; ++i)
+        list.m_args[i].serialize(out);
 }
 
-inline void printfln(const char* fmt)
+TINYFORMAT_FUNC void BinaryDecoder::add_format(std::size_t id, const char* fmt)
 {
-    format(std::cout, fmt);
-    std::cout << '\n';
+    std::vector<Entry>::iterator i = std::lower_bound(m_formats.begin(), m_formats.end(),
+                                                      id, IdLess());
+    if (i != m_formats.end() && i->first == id)
+        i->second = CompiledFormat(fmt);
+    else
+        m_formats.insert(i, Entry(id, CompiledFormat(fmt)));
 }
 
-#define TINYFORMAT_MAKE_FORMAT_FUNCS(n)                                   \
-                                                                          \
-template<TINYFORMAT_ARGTYPES(n)>                                          \
-void format(std::ostream& out, const char* fmt, TINYFORMAT_VARARGS(n))    \
-{                                                                         \
-    vformat(out, fmt, makeFormatList(TINYFORMAT_PASSARGS(n)));            \
-}                                                                         \
-                                                                          \
-template<TINYFORMAT_ARGTYPES(n)>                                          \
-std::string format(const char* fmt, TINYFORMAT_VARARGS(n))                \
-{                                                                         \
-    std::ostringstream oss;                                               \
-    format(oss, fmt, TINYFORMAT_PASSARGS(n));                             \
-    return oss.str();                                                     \
-}                                                                         \
-                                                                          \
-template<TINYFORMAT_ARGTYPES(n)>                                          \
-void printf(const char* fmt, TINYFORMAT_VARARGS(n))                       \
-{                                                                         \
-    format(std::cout, fmt, TINYFORMAT_PASSARGS(n));                       \
-}                                                                         \
-                                                                          \
-template<TINYFORMAT_ARGTYPES(n)>                                          \
-void printfln(const char* fmt, TINYFORMAT_VARARGS(n))                     \
-{                                                                         \
-    format(std::cout, fmt, TINYFORMAT_PASSARGS(n));                       \
-    std::cout << '\n';                                                    \
+TINYFORMAT_FUNC std::size_t BinaryDecoder::decode(std::ostream& out, const char* data,
+                                                  std::size_t size) const
+{
+    const char* p = data;
+    const char* end = data + size;
+    std::size_t id = 0;
+    std::size_t numArgs = 0;
+    FormatArgStore args;
+    detail::DecodeStatus status = detail::decodeVarint(id, p, end);
+    if (status == detail::DecodeOk)
+        status = detail::decodeVarint(numArgs, p, end);
+    for (std::size_t i = 0; status == detail::DecodeOk && i < numArgs; ++i)
+        status = detail::decodeArg(args, p, end);
+    if (status == detail::DecodeIncomplete)
+        return 0;
+    if (status == detail::DecodeBad) {
+        TINYFORMAT_RAISE_ERROR("tinyformat: Malformed binary record");
+        return size;
+    }
+    std::vector<Entry>::const_iterator i = std::lower_bound(m_formats.begin(), m_formats.end(),
+                                                            id, IdLess());
+    if (i != m_formats.end() && i->first == id)
+        vformat(out, i->second, args);
+    else
+        TINYFORMAT_RAISE_ERROR("tinyformat: Unknown format id in binary record");
+    return static_cast<std::size_t>(p - data);
 }
 
-TINYFORMAT_FOREACH_ARGNUM(TINYFORMAT_MAKE_FORMAT_FUNCS)
-#undef TINYFORMAT_MAKE_FORMAT_FUNCS
-
-#endif
-
+#endif // !TINYFORMAT_SEPARATE_COMPILATION || TINYFORMAT_IMPLEMENTATION
 
 } // namespace tinyformat
 
@@ -0,0 +1,331 @@
+// Microbenchmarks for tinyformat, using Google Benchmark.
+//
+// Cases are grouped by name prefix:
+//
+//   conv/   Single conversions formatted into a reused string, with the
+//           format string parsed on each call ("fmt") or pre-parsed ("compiled")
+//           to separate parsing from conversion cost.
+//   parse/  Parsing format strings into a CompiledFormat.
+//   sink/   One fixed format sent to each kind of output, or serialized as a
+//           binary record and decoded later.
+//   nargs/  The same conversion repeated for increasing argument counts, up
+//           to the 16 arguments supported in C++98 mode.
+//   base/   The same format with snprintf, iostreams and boost::format.
+//
+// Run with --benchmark_out=file.json --benchmark_out_format=json to record
+// results for comparison between releases (see the Makefile bench target).
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#define TINYFORMAT_USE_FD_SINK
+#define TINYFORMAT_USE_SHARDED_SINK
+#include "tinyformat.h"
+
+#if defined(__has_include)
+#   if __has_include(<boost/format.hpp>)
+#       define HAVE_BOOST_FORMAT
+#       include <boost/format.hpp>
+#   endif
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// The format used by tinyformat_speed_test.cpp, and its arguments
+#define SPEED_TEST_FMT "%0.10f:%04d:%+g:%s:%p:%c:%%\n"
+#define SPEED_TEST_ARGS 1.234, 42, 3.13, "str", (void*)1000, (int)'X'
+
+const std::string g_longString(64, 's');
+const std::wstring g_longWideString(64, L's');
+
+
+//------------------------------------------------------------------------------
+// Single conversions
+
+template<typename T>
+void convCase(benchmark::State& state, const char* fmt, const T& value)
+{
+    tfm::Formatter formatter;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(formatter.format(fmt, value).data());
+}
+
+template<typename T>
+void convCompiledCase(benchmark::State& state, const char* fmt, const T& value)
+{
+    const tfm::CompiledFormat compiled(fmt);
+    tfm::Formatter formatter;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(formatter.format(compiled, value).data());
+}
+
+#define CONV_CASE(name, fmt, value)                                            \
+    BENCHMARK_CAPTURE(convCase, name, fmt, value)->Name("conv/" #name "/fmt"); \
+    BENCHMARK_CAPTURE(convCompiledCase, name, fmt, value)->Name("conv/" #name "/compiled");
+
+CONV_CASE(int,       "%d",     123456789)
+CONV_CASE(int_width, "%08x",   0xbeef)
+CONV_CASE(long_long, "%lld",   1234567890123LL)
+CONV_CASE(float,     "%.3f",   3.14159265)
+CONV_CASE(double_e,  "%.10e",  6.02214076e23)
+CONV_CASE(double_g,  "%g",     0.000123)
+CONV_CASE(cstring,   "%s",     "a C string")
+CONV_CASE(string,    "%s",     g_longString)
+CONV_CASE(truncated, "%.10s",  g_longString)
+CONV_CASE(wstring,   "%ls",    g_longWideString)
+CONV_CASE(space_pad, "% d",    42)
+CONV_CASE(char,      "%c",     'x')
+CONV_CASE(pointer,   "%p",     (void*)0x1234)
+
+void convPositional(benchmark::State& state)
+{
+    tfm::Formatter formatter;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(formatter.format("%3$s %1$d %2$.2f", 42, 2.5, "str").data());
+}
+BENCHMARK(convPositional)->Name("conv/positional/fmt");
+
+void convStarWidth(benchmark::State& state)
+{
+    tfm::Formatter formatter;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(formatter.format("%*.*f", 12, 3, 2.5).data());
+}
+BENCHMARK(convStarWidth)->Name("conv/star_width/fmt");
+
+void convLiteral(benchmark::State& state)
+{
+    tfm::Formatter formatter;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(formatter.format(
+            "{\"status\": \"ok\", \"message\": \"literal text with no conversions\"}").data());
+}
+BENCHMARK(convLiteral)->Name("conv/literal/fmt");
+
+
+//------------------------------------------------------------------------------
+// Parsing
+
+void parseCase(benchmark::State& state, const char* fmt)
+{
+    for (auto _ : state) {
+        tfm::CompiledFormat compiled(fmt);
+        benchmark::DoNotOptimize(compiled.numArgs());
+    }
+}
+BENCHMARK_CAPTURE(parseCase, speed_test, SPEED_TEST_FMT)->Name("parse/speed_test");
+BENCHMARK_CAPTURE(parseCase, positional, "%3$s %1$*4$d %2$.2f")->Name("parse/positional");
+BENCHMARK_CAPTURE(parseCase, long_literal,
+    "{\"id\": %d, \"name\": \"%s\", \"tags\": [\"alpha\", \"beta\", \"gamma\"], "
+    "\"description\": \"a longer run of literal text between conversions\", "
+    "\"score\": %.2f}")->Name("parse/long_literal");
+
+
+//------------------------------------------------------------------------------
+// Sinks, all formatting the speed test format
+
+void sinkOstringstream(benchmark::State& state)
+{
+    std::ostringstream out;
+    for (auto _ : state) {
+        out.str(std::string());
+        tfm::format(out, SPEED_TEST_FMT, SPEED_TEST_ARGS);
+    }
+}
+BENCHMARK(sinkOstringstream)->Name("sink/ostringstream");
+
+void sinkCout(benchmark::State& state)
+{
+    // std::cout, with its buffer replaced so the output goes to /dev/null
+    std::filebuf devNull;
+    devNull.open("/dev/null", std::ios::out);
+    std::streambuf* orig = std::cout.rdbuf(&devNull);
+    for (auto _ : state)
+        tfm::printf(SPEED_TEST_FMT, SPEED_TEST_ARGS);
+    std::cout.rdbuf(orig);
+}
+BENCHMARK(sinkCout)->Name("sink/cout");
+
+void sinkString(benchmark::State& state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(tfm::format(SPEED_TEST_FMT, SPEED_TEST_ARGS).data());
+}
+BENCHMARK(sinkString)->Name("sink/string");
+
+void sinkFormatter(benchmark::State& state)
+{
+    tfm::Formatter formatter;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(formatter.format(SPEED_TEST_FMT, SPEED_TEST_ARGS).data());
+}
+BENCHMARK(sinkFormatter)->Name("sink/formatter");
+
+void sinkBuffer(benchmark::State& state)
+{
+    tfm::Buffer buf;
+    for (auto _ : state) {
+        buf.clear();
+        tfm::append_format(buf, SPEED_TEST_FMT, SPEED_TEST_ARGS);
+        benchmark::DoNotOptimize(buf.data());
+    }
+}
+BENCHMARK(sinkBuffer)->Name("sink/buffer");
+
+// Binary records, with the text formatted later by decodeBinary
+void sinkSerialize(benchmark::State& state)
+{
+    tfm::Buffer buf;
+    for (auto _ : state) {
+        buf.clear();
+        tfm::serialize_format(buf, 1, SPEED_TEST_ARGS);
+        benchmark::DoNotOptimize(buf.data());
+    }
+}
+BENCHMARK(sinkSerialize)->Name("sink/serialize");
+
+void decodeBinary(benchmark::State& state)
+{
+    tfm::Buffer buf;
+    tfm::serialize_format(buf, 1, SPEED_TEST_ARGS);
+    tfm::BinaryDecoder decoder;
+    decoder.add_format(1, SPEED_TEST_FMT);
+    std::ostringstream out;
+    for (auto _ : state) {
+        out.str(std::string());
+        decoder.decode(out, buf.data(), buf.size());
+    }
+}
+BENCHMARK(decodeBinary)->Name("sink/decode");
+
+void sinkCharArray(benchmark::State& state)
+{
+    char buf[128];
+    for (auto _ : state) {
+        tfm::format_to(buf, sizeof(buf), SPEED_TEST_FMT, SPEED_TEST_ARGS);
+        benchmark::DoNotOptimize(buf);
+    }
+}
+BENCHMARK(sinkCharArray)->Name("sink/char_array");
+
+void sinkFile(benchmark::State& state)
+{
+    std::FILE* file = std::fopen("/dev/null", "w");
+    for (auto _ : state)
+        tfm::fprintf(file, SPEED_TEST_FMT, SPEED_TEST_ARGS);
+    std::fclose(file);
+}
+BENCHMARK(sinkFile)->Name("sink/file");
+
+void sinkFd(benchmark::State& state)
+{
+    int fd = open("/dev/null", O_WRONLY);
+    {
+        tfm::FdSink sink(fd);
+        for (auto _ : state)
+            sink.format(SPEED_TEST_FMT, SPEED_TEST_ARGS);
+    }
+    close(fd);
+}
+BENCHMARK(sinkFd)->Name("sink/fd");
+
+// Whole lines from each of several threads, collected in batches
+void sinkSharded(benchmark::State& state)
+{
+    static std::ofstream devNull("/dev/null");
+    static tfm::ShardedSink sink(devNull);
+    for (auto _ : state)
+        sink.format(SPEED_TEST_FMT, SPEED_TEST_ARGS);
+}
+BENCHMARK(sinkSharded)->Name("sink/sharded")->Threads(1)->Threads(8);
+
+
+//------------------------------------------------------------------------------
+// Argument counts
+
+template<int... Is>
+void formatInts(tfm::Formatter& formatter, const char* fmt, tfm::detail::IntSequence<Is...>)
+{
+    benchmark::DoNotOptimize(formatter.format(fmt, (Is + 1000)...).data());
+}
+
+template<int N>
+void nargsCase(benchmark::State& state)
+{
+    std::string fmt;
+    for (int i = 0; i < N; ++i)
+        fmt += "%d ";
+    tfm::Formatter formatter;
+    for (auto _ : state)
+        formatInts(formatter, fmt.c_str(), typename tfm::detail::MakeIntSequence<N>::type());
+    state.SetItemsProcessed(state.iterations() * N);
+}
+BENCHMARK_TEMPLATE(nargsCase, 1)->Name("nargs/1");
+BENCHMARK_TEMPLATE(nargsCase, 2)->Name("nargs/2");
+BENCHMARK_TEMPLATE(nargsCase, 4)->Name("nargs/4");
+BENCHMARK_TEMPLATE(nargsCase, 8)->Name("nargs/8");
+BENCHMARK_TEMPLATE(nargsCase, 16)->Name("nargs/16");
+
+
+//------------------------------------------------------------------------------
+// Baselines for the speed test format
+
+void baseTinyformat(benchmark::State& state)
+{
+    std::ostringstream out;
+    for (auto _ : state) {
+        out.seekp(0);
+        tfm::format(out, SPEED_TEST_FMT, SPEED_TEST_ARGS);
+    }
+}
+BENCHMARK(baseTinyformat)->Name("base/tinyformat");
+
+void baseSnprintf(benchmark::State& state)
+{
+    char buf[128];
+    for (auto _ : state) {
+        std::snprintf(buf, sizeof(buf), SPEED_TEST_FMT, SPEED_TEST_ARGS);
+        benchmark::DoNotOptimize(buf);
+    }
+}
+BENCHMARK(baseSnprintf)->Name("base/snprintf");
+
+void baseIostreams(benchmark::State& state)
+{
+    std::ostringstream out;
+    for (auto _ : state) {
+        out.seekp(0);
+        out << std::setprecision(10) << std::fixed << 1.234
+            << std::resetiosflags(std::ios::floatfield) << ":"
+            << std::setw(4) << std::setfill('0') << 42 << std::setfill(' ') << ":"
+            << std::setiosflags(std::ios::showpos) << 3.13
+            << std::resetiosflags(std::ios::showpos) << ":"
+            << "str" << ":" << (void*)1000 << ":" << 'X' << ":%\n";
+    }
+}
+BENCHMARK(baseIostreams)->Name("base/iostreams");
+
+#ifdef HAVE_BOOST_FORMAT
+void baseBoost(benchmark::State& state)
+{
+    std::ostringstream out;
+    for (auto _ : state) {
+        out.seekp(0);
+        out << boost::format(SPEED_TEST_FMT)
+            % 1.234 % 42 % 3.13 % "str" % (void*)1000 % (int)'X';
+    }
+}
+BENCHMARK(baseBoost)->Name("base/boost");
+#endif
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -42,6 +42,13 @@ void speedTest(const std::string& which)
             tfm::printf("%0.10f:%04d:%+g:%s:%p:%c:%%\n",
                         1.234, 42, 3.13, "str", (void*)1000, (int)'X');
     }
+    else if(which == "tinyformat_fprintf")
+    {
+        // tinyformat writing to stdio rather than std::cout
+        for(long i = 0; i < maxIter; ++i)
+            tfm::fprintf(stdout, "%0.10f:%04d:%+g:%s:%p:%c:%%\n",
+                         1.234, 42, 3.13, "str", (void*)1000, (int)'X');
+    }
     else if(which == "boost")
     {
         // boost::format version
@@ -12,6 +12,7 @@ namespace std { class type_info; }
 #include <stdexcept>
 #include <climits>
 #include <cfloat>
+#include <limits>
 #include <cstddef>
 
 // Throw instead of abort() so we can test error conditions.
@@ -20,6 +21,11 @@ namespace std { class type_info; }
 
 #include "tinyformat.h"
 #include <cassert>
+#include <iterator>
+#if defined(TINYFORMAT_USE_ASYNC_SINK) || defined(TINYFORMAT_STATS) || \
+    defined(TINYFORMAT_USE_SHARDED_SINK)
+#   include <thread>
+#endif
 
 #if 0
 // Compare result of tfm::format() to C's sprintf().
@@ -59,9 +65,24 @@ if (!((a) == (b)))                                         \
 
 
 // Test wrapping to create our own function which calls through to tfm::format
+#if defined(TINYFORMAT_VARIADIC_ONLY) && (defined(TINYFORMAT_ARGTYPES) || \
+                                        defined(TINYFORMAT_FOREACH_ARGNUM))
+#   error "TINYFORMAT_VARIADIC_ONLY should leave out the C++98 macros"
+#endif
+
 struct TestWrap
 {
     std::ostringstream m_oss;
+#ifdef TINYFORMAT_VARIADIC_ONLY
+    template<typename... Args>
+    std::string error(int code, const char* fmt, const Args&... args)
+    {
+        m_oss.clear();
+        m_oss << code << ": ";
+        tfm::format(m_oss, fmt, args...);
+        return m_oss.str();
+    }
+#else
     // template<typename... Args>
     // std::string error(int code, const char* fmt, const Args&... args);
 #   define MAKE_ERROR_FUNC(n)                                            \
@@ -74,17 +95,25 @@ struct TestWrap
         return m_oss.str();                                              \
     }
     TINYFORMAT_FOREACH_ARGNUM(MAKE_ERROR_FUNC)
+#endif
 };
 
 
 struct TestExceptionDef : public std::runtime_error
 {
+#ifdef TINYFORMAT_VARIADIC_ONLY
+    template<typename... Args>
+    TestExceptionDef(const char* fmt, const Args&... args)
+        : std::runtime_error(tfm::format(fmt, args...))
+    { }
+#else
 #   define MAKE_CONSTRUCTOR(n)                                          \
     template<TINYFORMAT_ARGTYPES(n)>                                    \
     TestExceptionDef(const char* fmt, TINYFORMAT_VARARGS(n))            \
         : std::runtime_error(tfm::format(fmt, TINYFORMAT_PASSARGS(n)))  \
     { }
     TINYFORMAT_FOREACH_ARGNUM(MAKE_CONSTRUCTOR)
+#endif
 };
 
 
@@ -102,6 +131,182 @@ std::ostream& operator<<(std::ostream& os, const MyInt& obj) {
 }
 
 
+// String type with CharRangeTraits, printed in brackets by operator<< so
+// that direct truncation can be told apart from truncating the stream
+// output.
+struct BracketString {
+    BracketString(const char* s) : str(s) {}
+    std::string str;
+};
+
+std::ostream& operator<<(std::ostream& os, const BracketString& s) {
+    return os << '[' << s.str << ']';
+}
+
+namespace tinyformat {
+template<>
+struct CharRangeTraits<BracketString>
+{
+    static const bool isCharRange = true;
+    static const char* data(const BracketString& s) { return s.str.data(); }
+    static std::size_t size(const BracketString& s) { return s.str.size(); }
+};
+}
+
+
+// Type with long stream output, counting how much of it was written.
+struct LongOutput {};
+int g_longOutputWritten = 0;
+
+std::ostream& operator<<(std::ostream& os, const LongOutput&) {
+    g_longOutputWritten = 0;
+    for (int i = 0; i < 1000 && (os << i % 10); ++i)
+        ++g_longOutputWritten;
+    return os;
+}
+
+
+// Type which leaves the stream in a modified state after output.
+struct StickyHex {};
+
+std::ostream& operator<<(std::ostream& os, const StickyHex&) {
+    os.fill('*');
+    os.width(4);
+    return os << std::hex << std::uppercase << 255;
+}
+
+
+// Type which sets the stream into a failed state.
+struct FailingOutput {};
+
+std::ostream& operator<<(std::ostream& os, const FailingOutput&) {
+    os.setstate(std::ios::failbit);
+    return os;
+}
+
+
+// Type too large to be stored inline in a FormatArgStore, counting live
+// instances to check that copies are destroyed.
+struct BigValue {
+    BigValue(int v) : value(v) { ++liveCount; }
+    BigValue(const BigValue& other) : value(other.value) { ++liveCount; }
+    ~BigValue() { --liveCount; }
+    int value;
+    char padding[64];
+    static int liveCount;
+};
+int BigValue::liveCount = 0;
+
+std::ostream& operator<<(std::ostream& os, const BigValue& v) {
+    return os << "big" << v.value;
+}
+
+// Type whose copy constructor throws when armed, to check that a
+// FormatArgStore is unchanged when growing it fails.
+struct ThrowingCopy {
+    ThrowingCopy(int v) : value(v) {}
+    ThrowingCopy(const ThrowingCopy& other) : value(other.value) {
+        if (armed)
+            throw std::runtime_error("copy");
+    }
+    int value;
+    static bool armed;
+};
+bool ThrowingCopy::armed = false;
+
+std::ostream& operator<<(std::ostream& os, const ThrowingCopy& v) {
+    return os << v.value;
+}
+
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+// Type counting its copies, to check that temporaries are moved into a
+// FormatArgStore.
+struct CopyCounter {
+    CopyCounter(int v) : value(v) {}
+    CopyCounter(const CopyCounter& other) : value(other.value) { ++copies; }
+    CopyCounter(CopyCounter&& other) noexcept : value(other.value) {}
+    int value;
+    static int copies;
+};
+int CopyCounter::copies = 0;
+
+std::ostream& operator<<(std::ostream& os, const CopyCounter& v) {
+    return os << v.value;
+}
+#endif
+
+
+// Allocator counting the allocations made through it.
+template<typename T>
+struct CountingAllocator {
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    template<typename U> struct rebind { typedef CountingAllocator<U> other; };
+
+    CountingAllocator() {}
+    template<typename U> CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(std::size_t n, const void* = 0) {
+        ++count;
+        return static_cast<T*>(::operator new(n*sizeof(T)));
+    }
+    void deallocate(T* p, std::size_t) { ::operator delete(p); }
+    void construct(T* p, const T& value) { new(p) T(value); }
+    void destroy(T* p) { p->~T(); }
+    T* address(T& x) const { return &x; }
+    const T* address(const T& x) const { return &x; }
+    std::size_t max_size() const { return std::size_t(-1)/sizeof(T); }
+
+    static int count;
+};
+template<typename T> int CountingAllocator<T>::count = 0;
+
+template<typename T, typename U>
+bool operator==(const CountingAllocator<T>&, const CountingAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const CountingAllocator<T>&, const CountingAllocator<U>&) { return false; }
+
+
+// Entire contents of a file, read from the start
+std::string fileContents(std::FILE* file) {
+    std::fflush(file);
+    std::rewind(file);
+    std::string contents;
+    char buf[1024];
+    std::size_t n = 0;
+    while ((n = std::fread(buf, 1, sizeof(buf), file)) > 0)
+        contents.append(buf, n);
+    return contents;
+}
+
+
+// Type whose output prints to another file, as logging from within an
+// operator<< might.
+struct NestedPrint {
+    std::FILE* file;
+};
+
+std::ostream& operator<<(std::ostream& os, const NestedPrint& v) {
+    tfm::fprintf(v.file, "inner %d;", 1);
+    return os << "outer";
+}
+
+
+// Numeric punctuation with thousands grouping, to check that formatting
+// respects a non-classic stream locale.
+struct GroupedNumpunct : public std::numpunct<char>
+{
+    char do_thousands_sep() const { return ','; }
+    std::string do_grouping() const { return "\3"; }
+    std::string do_truename() const { return "yes"; }
+};
+
+
 int unitTests()
 {
     int nfailed = 0;
@@ -124,7 +329,7 @@ int unitTests()
     CHECK_EQUAL(tfm::format("%E", -1.23456E10), "-1.234560E+10");
     CHECK_EQUAL(tfm::format("%f", -9.8765), "-9.876500");
     CHECK_EQUAL(tfm::format("%F", 9.8765), "9.876500");
-#   ifndef _MSC_VER
+#   if !defined(_MSC_VER) || defined(TINYFORMAT_USE_FLOAT_ENGINE)
     CHECK_EQUAL(tfm::format("%a", -1.671111047267913818359375), "-0x1.abcdefp+0");
     CHECK_EQUAL(tfm::format("%A",  1.671111047267913818359375),  "0X1.ABCDEFP+0");
 #   else
@@ -172,6 +377,14 @@ int unitTests()
     // Bools with string format spec are printed as "true" or "false".
     CHECK_EQUAL(tfm::format("%s", true), "true");
     CHECK_EQUAL(tfm::format("%d", true), "1");
+    // Built in types formatted without dispatching through formatValue()
+    // still respect the %c and truncation special cases
+    {
+        char mutableStr[] = "mut";
+        CHECK_EQUAL(tfm::format("%c%lc|%.2s|%.1s|%5s|%-4s|%+d|%#x|%r", 66u, 67ul, "xyz",
+                                std::string("ab"), std::string("cd"), mutableStr, 5, 255L, 3),
+                    "BC|xy|a|   cd|mut |+5|0xff|3");
+    }
 
     //------------------------------------------------------------
     // Simple tests of posix positional arguments
@@ -191,7 +404,7 @@ int unitTests()
     CHECK_EQUAL(tfm::format("%.f", 10.1), "10");
     // Per C++ spec, iostreams ignore the precision for "%a" to avoid precision
     // loss. This is a printf incompatibility.
-#   ifndef _MSC_VER
+#   if !defined(_MSC_VER) || defined(TINYFORMAT_USE_FLOAT_ENGINE)
     CHECK_EQUAL(tfm::format("%.1a", 1.13671875), "0x1.23p+0");
     CHECK_EQUAL(tfm::format("%14a", 1.671111047267913818359375), " 0x1.abcdefp+0");
 #   else
@@ -199,8 +412,32 @@ int unitTests()
     CHECK_EQUAL(tfm::format("%.1a", 1.13671875), "0x1.2300000000000p+0");
     CHECK_EQUAL(tfm::format("%21a", 1.671111047267913818359375), " 0x1.abcdef0000000p+0");
 #   endif
+    // Float rounding is exact, with ties to even
+    CHECK_EQUAL(tfm::format("%.2f|%.0f|%.0f|%.1f", 0.125, 2.5, 3.5, 0.05), "0.12|2|4|0.1");
+    CHECK_EQUAL(tfm::format("%.3e|%.1e", 2.0/3, 0.125), "6.667e-01|1.2e-01");
+    CHECK_EQUAL(tfm::format("%.17g|%.3g|%#g", 0.1, 1e-5, 1.5), "0.10000000000000001|1e-05|1.50000");
+    CHECK_EQUAL(tfm::format("%f|%e", 1e-300, 1e300), "0.000000|1.000000e+300");
+    CHECK_EQUAL(tfm::format("%.20f", 1.0/3), "0.33333333333333331483");
+    CHECK_EQUAL(tfm::format("%.1f", 1e22), "10000000000000000000000.0");
+    CHECK_EQUAL(tfm::format("%+09.2f|%-8.1e|%08g", -1.5, 1.0f, -0.0), "-00001.50|1.0e+00 |-0000000");
+    CHECK_EQUAL(tfm::format("%a|%a", 0.0, 5e-324), "0x0p+0|0x0.0000000000001p-1022");
+    // %r gives the shortest digits which read back as the same value
+    CHECK_EQUAL(tfm::format("%r|%r|%r", 0.1 + 0.2, 1.0/3, 0.1f), "0.30000000000000004|0.3333333333333333|0.1");
+    CHECK_EQUAL(tfm::format("%r|%r|%R|%r", 100000.0, 1e16, 1e-7, 5e-324), "100000|1e+16|1E-07|5e-324");
+    CHECK_EQUAL(tfm::format("%8.3r|%-6r|%+r|%#r", 2.5, 0.0, 1.0, 1.5), "     2.5|0     |+1|1.50000");
+    CHECK_EQUAL(tfm::format("%r|%r", 42, "str"), "42|str");
     CHECK_EQUAL(tfm::format("%.2s", "asdf"), "as"); // strings truncate to precision
     CHECK_EQUAL(tfm::format("%.2s", std::string("asdf")), "as");
+#ifdef TINYFORMAT_HAS_STRING_VIEW
+    CHECK_EQUAL(tfm::format("%.3s|%.9s", std::string_view("asdf"), std::string_view("xy")), "asd|xy");
+#endif
+    CHECK_EQUAL(tfm::format("%s|%.3s", BracketString("asdf"), BracketString("asdf")), "[asdf]|asd");
+    CHECK_EQUAL(tfm::format("%.4s", LongOutput()), "0123");
+#ifdef TINYFORMAT_STREAMING_TRUNCATION
+    CHECK_EQUAL(g_longOutputWritten, 4);
+#else
+    CHECK_EQUAL(g_longOutputWritten, 1000);
+#endif
     // Test variable precision & width
     CHECK_EQUAL(tfm::format("%*.4f", 10, 1234.1234567890), " 1234.1235");
     CHECK_EQUAL(tfm::format("%10.*f", 4, 1234.1234567890), " 1234.1235");
@@ -224,8 +461,18 @@ int unitTests()
     CHECK_EQUAL(tfm::format("%010d", 100), "0000000100");
     CHECK_EQUAL(tfm::format("%010d", -10), "-000000010"); // sign should extend
     CHECK_EQUAL(tfm::format("%#010X", 0xBEEF), "0X0000BEEF");
+    CHECK_EQUAL(tfm::format("%#x|%#o", 0, 0), "0|0");
+    CHECK_EQUAL(tfm::format("%+u|%+x", 3u, 255), "3|ff");
+    CHECK_EQUAL(tfm::format("%x|%hx", -1, (short)-1), "ffffffff|ffff");
+    CHECK_EQUAL(tfm::format("%d|%u", LONG_MIN, ULONG_MAX),
+                tfm::format("%s|%s", LONG_MIN, ULONG_MAX));
+    CHECK_EQUAL(tfm::format("%d|%d|%hd|%d", (short)SHRT_MIN, (short)-1234, (short)-7, (short)SHRT_MAX),
+                "-32768|-1234|-7|32767");
+    CHECK_EQUAL(tfm::format("%hu|%u", (unsigned short)USHRT_MAX, (unsigned short)0), "65535|0");
     CHECK_EQUAL(tfm::format("% d",  10), " 10");
     CHECK_EQUAL(tfm::format("% d", -10), "-10");
+    CHECK_EQUAL(tfm::format("% .2f|% 6.1f|%- 6d|% 06.1f", 1.5, -2.0, 42, 2.25), " 1.50|  -2.0| 42   | 002.2");
+    CHECK_EQUAL(tfm::format("% 300d", 1), std::string(299, ' ') + "1");
     // Test flags with variable precision & width
     CHECK_EQUAL(tfm::format("%+.2d", 3), "+03");
     CHECK_EQUAL(tfm::format("%+.2d", -3), "-03");
@@ -284,14 +531,780 @@ int unitTests()
     // Unhandled C99 format spec
     EXPECT_ERROR( tfm::format("%n", 10) )
 
+    //------------------------------------------------------------
+    // Padding of strings and chars written directly to the stream buffer
+    CHECK_EQUAL(tfm::format("%6s|%-6s|", "ab", std::string("cd")), "    ab|cd    |");
+    CHECK_EQUAL(tfm::format("%3c|%-3c|", 'x', 'y'), "  x|y  |");
+    CHECK_EQUAL(tfm::format("%s", (char*)"mutable"), "mutable");
+
+    //------------------------------------------------------------
+    // Formatting into memory without a user supplied stream
+    {
+        char buf[16];
+        CHECK_EQUAL(tfm::format_to(buf, sizeof(buf), "%s=%d", "x", 42), 4u);
+        CHECK_EQUAL(std::string(buf, 4), "x=42");
+        // Output is truncated but the full length returned
+        CHECK_EQUAL(tfm::format_to(buf, 3, "%s-%05d", "ab", 7), 8u);
+        CHECK_EQUAL(std::string(buf, 3), "ab-");
+        CHECK_EQUAL(tfm::format_to(buf, sizeof(buf), "100%%"), 4u);
+        CHECK_EQUAL(tfm::formatted_size("%10.3f|%s", 1.5, "abc"), 14u);
+        CHECK_EQUAL(tfm::formatted_size(""), 0u);
+        std::string str;
+        tfm::format_to(std::back_inserter(str), "%s:%+d", "it", 5);
+        CHECK_EQUAL(str, "it:+5");
+        std::string longStr(300, 'z');
+        str.clear();
+        tfm::format_to(std::back_inserter(str), "[%s]", longStr);
+        CHECK_EQUAL(str, "[" + longStr + "]");
+        std::vector<char> vec(8, '.');
+        std::vector<char>::iterator vecEnd = tfm::format_to(vec.begin(), "%d", 123);
+        CHECK_EQUAL(vecEnd - vec.begin(), 3);
+        CHECK_EQUAL(std::string(vec.begin(), vec.end()), "123.....");
+    }
+
+    // String results larger than the internal stack buffer
+    {
+        std::string longStr(1000, 'q');
+        CHECK_EQUAL(tfm::format("<%s>%d", longStr, 7), "<" + longStr + ">7");
+        CHECK_EQUAL(tfm::format("%600d", 1).size(), 600u);
+    }
+    // Literal text of all lengths and alignments, for the vector scan
+    {
+        const std::string text = "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ!?";
+        char buf[256];
+        for (std::size_t len = 0; len <= text.size(); ++len) {
+            const std::string head = text.substr(0, len);
+            const std::string fmt = head + "%%" + text.substr(len) + "%d" + head;
+            const std::string expected = head + "%" + text.substr(len) + "7" + head;
+            for (std::size_t offset = 0; offset < 32; ++offset) {
+                std::copy(fmt.c_str(), fmt.c_str() + fmt.size() + 1, buf + offset);
+                CHECK_EQUAL(tfm::format(buf + offset, 7), expected);
+                CHECK_EQUAL(tfm::format(tfm::CompiledFormat(buf + offset), 7), expected);
+            }
+        }
+    }
+    // Appending to an existing string
+    {
+        std::string str = "log: ";
+        tfm::append_format(str, "%s=%d", "a", 1);
+        tfm::append_format(str, ", %s=%d", "b", 2);
+        tfm::append_format(str, "%%");
+        CHECK_EQUAL(str, "log: a=1, b=2%");
+        str.clear();
+        tfm::append_format(str, "x%d", 3);
+        CHECK_EQUAL(str, "x3");
+    }
+    // Appending to a reusable Buffer
+    {
+        tfm::Buffer buf;
+        CHECK_EQUAL(buf.capacity(), tfm::Buffer::inlineCapacity);
+        tfm::append_format(buf, "%s=%d", "a", 1);
+        tfm::append_format(buf, ", %s=%d%%", "b", 2);
+        CHECK_EQUAL(buf.str(), "a=1, b=2%");
+        CHECK_EQUAL(std::string(buf.data(), buf.size()), "a=1, b=2%");
+        std::string longStr(1000, 'x');
+        tfm::append_format(buf, "%s|%5d", longStr, 42);
+        CHECK_EQUAL(buf.str(), "a=1, b=2%" + longStr + "|   42");
+        std::size_t capacity = buf.capacity();
+        CHECK_EQUAL(capacity >= buf.size(), true);
+        buf.clear();
+        CHECK_EQUAL(buf.size(), 0u);
+        CHECK_EQUAL(buf.capacity(), capacity);
+        tfm::append_format(buf, "%d", 7);
+        CHECK_EQUAL(buf.str(), "7");
+        CHECK_EQUAL(buf.capacity(), capacity);
+        EXPECT_ERROR( tfm::append_format(buf, "%d %d", 1) )
+    }
+    // Strings using a custom allocator
+    {
+        typedef std::basic_string<char, std::char_traits<char>,
+                                  CountingAllocator<char> > CountedString;
+        CountingAllocator<char> alloc;
+        int count = CountingAllocator<char>::count;
+        CountedString s = tfm::format(alloc, "%s-%04d", std::string(40, 'y'), 12);
+        CHECK_EQUAL(std::string(s.c_str()), std::string(40, 'y') + "-0012");
+        CHECK_EQUAL(CountingAllocator<char>::count, count + 1);
+        CHECK_EQUAL(std::string(tfm::format(alloc, "100%%").c_str()), "100%");
+        CHECK_EQUAL(std::string(tfm::format(alloc, tfm::CompiledFormat("%x"), 255).c_str()), "ff");
+        // Streams are not mistaken for allocators
+        std::ostringstream oss;
+        tfm::format(oss, "%d", 5);
+        CHECK_EQUAL(oss.str(), "5");
+    }
+#ifdef TINYFORMAT_HAS_PMR
+    {
+        char arena[1024];
+        std::pmr::monotonic_buffer_resource mr(arena, sizeof(arena),
+                                               std::pmr::null_memory_resource());
+        std::pmr::string s = tfm::format(&mr, "%s %d", std::string(50, 'z'), 3);
+        CHECK_EQUAL(std::string(s), std::string(50, 'z') + " 3");
+        CHECK_EQUAL(s.get_allocator().resource() == &mr, true);
+        CHECK_EQUAL(s.data() >= arena && s.data() < arena + sizeof(arena), true);
+    }
+#endif
+
+    //------------------------------------------------------------
+    // Pre-parsed format strings
+    tfm::CompiledFormat compiledFmt("%s:%04d:%+.2f:%%:%x");
+    CHECK_EQUAL(compiledFmt.numArgs(), 4);
+    CHECK_EQUAL(tfm::format(compiledFmt, "a", 42, 3.14159, 255), "a:0042:+3.14:%:ff");
+    CHECK_EQUAL(tfm::format(compiledFmt, "bb", -7, -1.0, 16), "bb:-007:-1.00:%:10");
+    tfm::CompiledFormat compiledPosFmt("%2$s %1$*3$d|");
+    CHECK_EQUAL(compiledPosFmt.numArgs(), 3);
+    CHECK_EQUAL(tfm::format(compiledPosFmt, 10, "x", 5), "x    10|");
+    CHECK_EQUAL(tfm::format(tfm::CompiledFormat("%*.*f% d%%"), 8, 2, 1.5, 3), "    1.50 3%");
+    CHECK_EQUAL(tfm::format(tfm::CompiledFormat("100%%")), "100%");
+    {
+        std::ostringstream compiledOut;
+        tfm::vformat(compiledOut, compiledFmt, tfm::makeFormatList("c", 1, 2.0, 3));
+        CHECK_EQUAL(compiledOut.str(), "c:0001:+2.00:%:3");
+    }
+    // Errors in the format string are found at construction
+    EXPECT_ERROR( tfm::CompiledFormat("%123") )
+    EXPECT_ERROR( tfm::CompiledFormat("%n") )
+    EXPECT_ERROR( tfm::CompiledFormat("%1$d %d") )
+    // Argument mismatches are found when formatting
+    EXPECT_ERROR( tfm::format(compiledFmt, "a", 1, 2.0) )
+    EXPECT_ERROR( tfm::format(compiledFmt, "a", 1, 2.0, 3, 4) )
+    EXPECT_ERROR( tfm::format(compiledPosFmt, 1, "x") )
+    // Named arguments are resolved to positions at construction
+    {
+        static const char* const names[] = { "user", "count", "width" };
+        tfm::CompiledFormat en("%(user)s has %(count)d new message%(count)s", names);
+        CHECK_EQUAL(tfm::format(en, "ann", 3), "ann has 3 new message3");
+        tfm::CompiledFormat reordered("[%(count)*(width)d] %(user)-5s|%2$d", names);
+        CHECK_EQUAL(reordered.numArgs(), 3);
+        CHECK_EQUAL(tfm::format(reordered, "bob", 12, 4), "[  12] bob  |12");
+        CHECK_EQUAL(tfm::format(tfm::CompiledFormat("%(count)s%(count)s", names + 1, 1), "x"), "xx");
+        EXPECT_ERROR( tfm::CompiledFormat("%(nobody)s", names) )
+        EXPECT_ERROR( tfm::CompiledFormat("%(user", names) )
+        EXPECT_ERROR( tfm::CompiledFormat("%(user)s %d", names) )
+        EXPECT_ERROR( tfm::format("%(user)s", "ann") )
+    }
+
+    //------------------------------------------------------------
+    // Reusable formatting context
+    {
+        tfm::Formatter formatter;
+        CHECK_EQUAL(formatter.format("%#x|%-5s|%08.3f", 255, "ab", -1.5), "0xff|ab   |-001.500");
+        // No state leaks from one call or conversion into the next
+        CHECK_EQUAL(formatter.format("%d|%s|%.2f", 255, true, 2.0), "255|true|2.00");
+        CHECK_EQUAL(formatter.format("%s %d %5d", StickyHex(), 255, 1), "**FF 255     1");
+        CHECK_EQUAL(formatter.format("%s|%d", FailingOutput(), 1), "");
+        CHECK_EQUAL(formatter.format("%d", 2), "2");
+        formatter.append("+%s", "x");
+        formatter.append(compiledFmt, "a", 42, 3.14159, 255);
+        CHECK_EQUAL(formatter.str(), "2+xa:0042:+3.14:%:ff");
+        CHECK_EQUAL(formatter.size(), formatter.str().size());
+        formatter.clear();
+        CHECK_EQUAL(formatter.str(), "");
+        CHECK_EQUAL(formatter.format(compiledPosFmt, 10, "x", 5), "x    10|");
+        CHECK_EQUAL(formatter.vformat("%s-%s", tfm::makeFormatList(1, 2)), "1-2");
+        EXPECT_ERROR( formatter.format("%d %d", 1) )
+        CHECK_EQUAL(formatter.format("%o", 8), "10");
+    }
+
+    //------------------------------------------------------------
+    // Format lists owning copies of their arguments
+    {
+        tfm::FormatArgStore store;
+        {
+            char buf[] = "abc";
+            std::string shortStr = "short";
+            std::string longStr(40, 'L');
+            store = tfm::makeFormatArgStore(buf, shortStr, longStr, 5, 2.5, MyInt(7), BigValue(9));
+            buf[0] = 'X';
+            shortStr = "gone";
+            longStr = "gone";
+        }
+        CHECK_EQUAL(store.size(), 7);
+        CHECK_EQUAL(BigValue::liveCount, 1);
+        const char* fmt = "%s|%.2s|%.3s|%*.1f|%d|%s";
+        CHECK_EQUAL(tfm::vformat(fmt, store), "abc|sh|LLL|  2.5|7|big9");
+        tfm::FormatArgStore copy(store);
+        store.clear();
+        CHECK_EQUAL(BigValue::liveCount, 1);
+        CHECK_EQUAL(tfm::vformat(fmt, copy), "abc|sh|LLL|  2.5|7|big9");
+        // Grow beyond the inline arguments, keeping the ones already held
+        for (int n = 0; n < 20; ++n)
+            store.push_back(n);
+        store.push_back(std::string(1000, 'z'));
+        CHECK_EQUAL(store.size(), 21);
+        CHECK_EQUAL(tfm::vformat("%2$d %20$d %21$.3s", store), "1 19 zzz");
+        CHECK_EQUAL(tfm::vformat(compiledFmt, tfm::makeFormatArgStore("a", 42, 3.14159, 255)),
+                    "a:0042:+3.14:%:ff");
+        EXPECT_ERROR( tfm::vformat("%d", tfm::makeFormatArgStore()) )
+        // The store is unchanged if copying an argument fails as it grows
+        tfm::FormatArgStore throwingStore;
+        for (int n = 0; n < tfm::FormatArgStore::inlineCapacity; ++n)
+            throwingStore.push_back(ThrowingCopy(n));
+        ThrowingCopy::armed = true;
+        EXPECT_ERROR( throwingStore.push_back(1) )
+        ThrowingCopy::armed = false;
+        CHECK_EQUAL(throwingStore.size(), tfm::FormatArgStore::inlineCapacity);
+        CHECK_EQUAL(tfm::vformat("%d%d%d%d%d%d%d%d", throwingStore), "01234567");
+    }
+    CHECK_EQUAL(BigValue::liveCount, 0);
+#ifdef TINYFORMAT_HAS_RVALUE_REFS
+    {
+        // Temporaries are moved into a store, including when it grows
+        tfm::FormatArgStore store;
+        CopyCounter lvalue(1);
+        store.push_back(lvalue);
+        CHECK_EQUAL(CopyCounter::copies, 1);
+        store.push_back(CopyCounter(2));
+        std::string longStr(100, 'm');
+        store.push_back(std::move(longStr));
+        for (int n = 0; n < 20; ++n)
+            store.push_back(CopyCounter(n));
+        CHECK_EQUAL(CopyCounter::copies, 1);
+        const char* fmt = "%d %d %.3s %23$d";
+        CHECK_EQUAL(tfm::vformat(fmt, store), "1 2 mmm 19");
+        tfm::FormatArgStore moved(std::move(store));
+        CHECK_EQUAL(store.size(), 0);
+        CHECK_EQUAL(tfm::vformat(fmt, moved), "1 2 mmm 19");
+        store = tfm::makeFormatArgStore(CopyCounter(5), std::string(40, 'z'), BigValue(3));
+        moved = std::move(store);
+        CHECK_EQUAL(store.size(), 0);
+        CHECK_EQUAL(tfm::vformat("%d %.2s %s", moved), "5 zz big3");
+        CHECK_EQUAL(CopyCounter::copies, 1);
+        tfm::FormatArgStore copy(moved);
+        CHECK_EQUAL(CopyCounter::copies, 2);
+        CHECK_EQUAL(tfm::vformat("%d %.2s %s", copy), "5 zz big3");
+    }
+    CHECK_EQUAL(BigValue::liveCount, 0);
+#endif
+
+    //------------------------------------------------------------
+    // Binary records, formatted later by a BinaryDecoder
+    {
+        tfm::Buffer records;
+        char buf[] = "arr";
+        std::string longStr(300, 's');
+        const char* nullStr = NULL;
+        const char* fmt = "%c|%s|%+d|%x|%ld|%hd|%u|%.2f|%g|%p|%s|%s|%.3s|%3d\n";
+        tfm::serialize_format(records, 1, 'c', true, -42, 255u, -7L, (short)3,
+                              (unsigned char)200, 2.5, 1.25f, (void*)0x10, "lit", buf,
+                              longStr, MyInt(7));
+        const std::size_t firstSize = records.size();
+        tfm::serialize_format(records, 1000, 12);
+        tfm::serialize_format(records, 3);
+        tfm::BinaryDecoder decoder;
+        decoder.add_format(1, fmt);
+        decoder.add_format(1000, "%d\n");
+        decoder.add_format(1000, "%05d\n");
+        decoder.add_format(2, "[%s]");
+        decoder.add_format(3, "end\n");
+        std::ostringstream out;
+        const char* data = records.data();
+        std::size_t size = records.size();
+        while (std::size_t n = decoder.decode(out, data, size)) {
+            data += n;
+            size -= n;
+        }
+        CHECK_EQUAL(size, 0);
+        CHECK_EQUAL(out.str(), tfm::format(fmt, 'c', true, -42, 255u, -7L, (short)3,
+                                           (unsigned char)200, 2.5, 1.25f, (void*)0x10,
+                                           "lit", buf, longStr, MyInt(7)) + "00012\nend\n");
+        // Partial records aren't consumed
+        for (std::size_t n = 0; n < firstSize; ++n)
+            CHECK_EQUAL(decoder.decode(out, records.data(), n), 0);
+        // A null C string fails the stream, as when formatting it directly
+        records.clear();
+        tfm::serialize_format(records, 2, nullStr);
+        std::ostringstream nullOut;
+        std::ostringstream decodedNullOut;
+        tfm::format(nullOut, "[%s]", nullStr);
+        CHECK_EQUAL(decoder.decode(decodedNullOut, records.data(), records.size()), records.size());
+        CHECK_EQUAL(decodedNullOut.str(), nullOut.str());
+        CHECK_EQUAL(decodedNullOut.bad(), nullOut.bad());
+        records.clear();
+        tfm::serialize_format(records, 99, 1);
+        EXPECT_ERROR( decoder.decode(out, records.data(), records.size()) )
+        const char badTag[] = { 1, 1, 127 };
+        EXPECT_ERROR( decoder.decode(out, badTag, sizeof(badTag)) )
+    }
+
+    //------------------------------------------------------------
+    // Format lists of containers, with a length known only at run time
+    {
+        std::vector<int> row;
+        std::string rowFmt;
+        std::string expected;
+        for (int i = 0; i < 40; ++i) {
+            row.push_back(i);
+            rowFmt += "%d,";
+            expected += tfm::format("%d,", i);
+        }
+        tfm::DynamicFormatList list(row);
+        CHECK_EQUAL(list.size(), 40);
+        CHECK_EQUAL(tfm::vformat(rowFmt.c_str(), list), expected);
+        CHECK_EQUAL(tfm::vformat("%40$d %1$03d", list), "39 000");
+        const std::string words[] = { "one", "two" };
+        tfm::DynamicFormatList wordList(words);
+        CHECK_EQUAL(tfm::vformat("%s-%.2s", wordList), "one-tw");
+        tfm::DynamicFormatList copy(list);
+        list = wordList;
+        CHECK_EQUAL(list.size(), 2);
+        CHECK_EQUAL(tfm::vformat(rowFmt.c_str(), copy), expected);
+        copy = tfm::DynamicFormatList(row.begin() + 38, row.end());
+        CHECK_EQUAL(tfm::vformat("%d %d", copy), "38 39");
+        EXPECT_ERROR( tfm::vformat("%d %d %d", copy) )
+        std::vector<tfm::DynamicFormatList> rows;
+        rows.push_back(tfm::DynamicFormatList(row.begin(), row.begin() + 2));
+        rows.push_back(tfm::DynamicFormatList(row.begin() + 5, row.end()));
+        std::ostringstream batchOut;
+        tfm::format_batch(batchOut, "%1$d;", rows);
+        CHECK_EQUAL(batchOut.str(), "0;5;");
+        CHECK_EQUAL(tfm::vformat("x", tfm::DynamicFormatList(row.begin(), row.begin())), "x");
+    }
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+    // No limit on the number of arguments
+    CHECK_EQUAL(tfm::format("%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d",
+                            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9),
+                "01234567890123456789");
+    CHECK_EQUAL(tfm::vformat("%20$s", tfm::makeFormatArgStore(
+                    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, "last")), "last");
+#endif
+
+    //------------------------------------------------------------
+    // Formatting many rows with the same format
+    {
+        std::vector<tfm::FormatArgStore> rows;
+        std::string expected;
+        for (int n = 0; n < 5000; ++n) {
+            rows.push_back(tfm::makeFormatArgStore(n, "row", n*0.25));
+            expected += tfm::format("%d,%s,%.2f\n", n, "row", n*0.25);
+        }
+        std::ostringstream batchOut;
+        batchOut.width(10);
+        batchOut.fill('*');
+        tfm::format_batch(batchOut, "%d,%s,%.2f\n", rows);
+        CHECK_EQUAL(batchOut.str(), expected);
+        CHECK_EQUAL(batchOut.width(), 10);
+        CHECK_EQUAL(batchOut.fill(), '*');
+        std::ostringstream batchOut2;
+        tfm::format_batch(batchOut2, tfm::CompiledFormat("<%2$s %1$d>"), rows.begin(), rows.begin() + 2);
+        CHECK_EQUAL(batchOut2.str(), "<row 0><row 1>");
+        // The destination locale is used
+        std::ostringstream locBatchOut;
+        locBatchOut.imbue(std::locale(std::locale::classic(), new GroupedNumpunct));
+        tfm::format_batch(locBatchOut, "%1$d;", rows.begin() + 1000, rows.begin() + 1002);
+#ifdef TINYFORMAT_C_LOCALE
+        CHECK_EQUAL(locBatchOut.str(), "1000;1001;");
+#else
+        CHECK_EQUAL(locBatchOut.str(), "1,000;1,001;");
+#endif
+        EXPECT_ERROR( tfm::format_batch(batchOut2, "%d", rows) )
+    }
+#ifdef TINYFORMAT_USE_VARIADIC_TEMPLATES
+    {
+        std::vector<std::tuple<std::string, int>> rows;
+        rows.emplace_back("a", 1);
+        rows.emplace_back("bb", 22);
+        std::ostringstream batchOut;
+        tfm::format_batch(batchOut, "%-3s|%3d\n", rows);
+        CHECK_EQUAL(batchOut.str(), "a  |  1\nbb | 22\n");
+    }
+#endif
+
+#ifdef TINYFORMAT_USE_PARALLEL_BATCH
+    {
+        std::vector<std::tuple<int, std::string, double>> rows;
+        for (int n = 0; n < 20000; ++n)
+            rows.emplace_back(n, std::string(n % 13, 'c'), n/7.0);
+        const char* rowFmt = "%06d|%-12s|%.4f\n";
+        std::ostringstream serialOut;
+        tfm::format_batch(serialOut, rowFmt, rows);
+        for (unsigned threads = 0; threads <= 5; ++threads) {
+            std::ostringstream parallelOut;
+            tfm::format_batch_parallel(parallelOut, rowFmt, rows, threads);
+            CHECK_EQUAL(parallelOut.str() == serialOut.str(), true);
+        }
+        std::ostringstream smallOut;
+        tfm::format_batch_parallel(smallOut, tfm::CompiledFormat("%1$d;"),
+                                   rows.begin(), rows.begin() + 3, 4);
+        CHECK_EQUAL(smallOut.str(), "0;1;2;");
+        // Errors on worker threads are passed back to the caller
+        std::vector<tfm::FormatArgStore> badRows(5000, tfm::makeFormatArgStore(1));
+        badRows[3000].push_back(2);
+        std::ostringstream badOut;
+        EXPECT_ERROR( tfm::format_batch_parallel(badOut, "%d\n", badRows, 3) )
+    }
+#endif
+
+#ifdef TINYFORMAT_USE_ASYNC_SINK
+    //------------------------------------------------------------
+    // Formatting on a background thread
+    {
+        std::ostringstream asyncOut;
+        std::string expected;
+        {
+            tfm::AsyncSink sink(asyncOut, tfm::AsyncSink::Block, 4);
+            for (int n = 0; n < 200; ++n) {
+                std::string s(n % 30, 'x');
+                CHECK_EQUAL(sink.format("%d:%s,", n, s), true);
+                expected += tfm::format("%d:%s,", n, s);
+            }
+            sink.flush();
+            CHECK_EQUAL(asyncOut.str(), expected);
+            CHECK_EQUAL(sink.vformat("%s|%d\n", tfm::makeFormatArgStore("store", 1)), true);
+            CHECK_EQUAL(sink.droppedCount(), 0u);
+            // Temporaries are moved into the queue
+            const int copies = CopyCounter::copies;
+            CHECK_EQUAL(sink.format("%s %s\n", CopyCounter(7), std::string(50, 't')), true);
+            tfm::FormatArgStore args = tfm::makeFormatArgStore(CopyCounter(8));
+            CHECK_EQUAL(sink.vformat("%s\n", std::move(args)), true);
+            CHECK_EQUAL(CopyCounter::copies, copies);
+        }
+        CHECK_EQUAL(asyncOut.str(), expected + "store|1\n7 " + std::string(50, 't') + "\n8\n");
+    }
+    {
+        // Every message from concurrent producers is written or dropped
+        const tfm::AsyncSink::FullPolicy policies[] = {
+            tfm::AsyncSink::Block, tfm::AsyncSink::Drop, tfm::AsyncSink::Overwrite
+        };
+        for (int p = 0; p < 3; ++p) {
+            std::ostringstream asyncOut;
+            std::size_t dropped = 0;
+            {
+                tfm::AsyncSink sink(asyncOut, policies[p], 8);
+                std::thread producers[3];
+                for (int i = 0; i < 3; ++i) {
+                    producers[i] = std::thread([&sink, i] {
+                        for (int n = 0; n < 1000; ++n)
+                            sink.format("%d %d\n", i, n);
+                    });
+                }
+                for (int i = 0; i < 3; ++i)
+                    producers[i].join();
+                sink.flush();
+                dropped = sink.droppedCount();
+            }
+            const std::string str = asyncOut.str();
+            CHECK_EQUAL(std::count(str.begin(), str.end(), '\n') + dropped, 3000u);
+            if (policies[p] == tfm::AsyncSink::Block)
+                CHECK_EQUAL(dropped, 0u);
+        }
+    }
+    {
+        // A message whose arguments fail to copy isn't queued, and one which
+        // fails to format is left out of the output.  Neither stops the
+        // messages after it.
+        std::ostringstream asyncOut;
+        std::string expected;
+        {
+            tfm::AsyncSink sink(asyncOut, tfm::AsyncSink::Block, 4);
+            ThrowingCopy bomb(1);
+            tfm::FormatArgStore bombs = tfm::makeFormatArgStore(bomb);
+            ThrowingCopy::armed = true;
+            EXPECT_ERROR( sink.format("bomb %s\n", bomb) )
+            EXPECT_ERROR( sink.vformat("bomb %s\n", bombs) )
+            ThrowingCopy::armed = false;
+            CHECK_EQUAL(sink.format("%d %d\n", 1), true);
+            for (int n = 0; n < 10; ++n) {
+                CHECK_EQUAL(sink.format("%d\n", n), true);
+                expected += tfm::format("%d\n", n);
+            }
+            sink.flush();
+            CHECK_EQUAL(asyncOut.str(), expected);
+            CHECK_EQUAL(sink.failedCount(), 1u);
+            CHECK_EQUAL(sink.droppedCount(), 0u);
+            CHECK_EQUAL(sink.format("%s\n", "last"), true);
+        }
+        CHECK_EQUAL(asyncOut.str(), expected + "last\n");
+    }
+#endif
+
+    //------------------------------------------------------------
+    // Writing to C streams
+    {
+        std::FILE* file = std::tmpfile();
+        tfm::fprintf(file, "%s=%d;", "a", 1);
+        tfm::fprintf(file, "100%%");
+        tfm::fprintfln(file, "|%5.2f", 3.14159);
+        CHECK_EQUAL(fileContents(file), "a=1;100%| 3.14\n");
+        EXPECT_ERROR( tfm::fprintf(file, "%d %d", 1) )
+        std::fclose(file);
+    }
+    {
+        // Each call starts afresh after a failed call or stream error, and
+        // the output of a failed call is discarded.  Printing from within an
+        // operator<< works too.
+        std::FILE* file = std::tmpfile();
+        std::FILE* inner = std::tmpfile();
+        EXPECT_ERROR( tfm::fprintf(file, "%x %d", 255) )
+        tfm::fprintf(file, "%s|", FailingOutput());
+        tfm::fprintf(file, "%s|", StickyHex());
+        tfm::fprintf(file, "%d|", 255);
+        NestedPrint nested = { inner };
+        tfm::fprintfln(file, "[%s %d]", nested, 2);
+        CHECK_EQUAL(fileContents(file), "**FF|255|[outer 2]\n");
+        CHECK_EQUAL(fileContents(inner), "inner 1;");
+        std::fclose(inner);
+        std::fclose(file);
+    }
+
+#ifdef TINYFORMAT_USE_SHARDED_SINK
+    //------------------------------------------------------------
+    // Whole lines from many threads
+    {
+        // Every line is whole, and the lines of each thread are in order
+        auto linesInOrder = [](const std::string& text, char c) {
+            std::istringstream in(text);
+            std::string line;
+            int next[8] = {0};
+            while (std::getline(in, line)) {
+                int i = -1, n = -1;
+                if (std::sscanf(line.c_str(), "%d %d", &i, &n) != 2 || i < 0 || i >= 8 ||
+                    n != next[i]++ || line != tfm::format("%d %d %s", i, n, std::string(n % 40, c)))
+                    return false;
+            }
+            return std::count(next, next + 8, 500) == 8;
+        };
+        std::ostringstream shardedOut;
+        std::FILE* file = std::tmpfile();
+        {
+            tfm::ShardedSink sink(shardedOut, 3, 256);
+            std::thread threads[8];
+            for (int i = 0; i < 8; ++i) {
+                threads[i] = std::thread([&sink, file, i] {
+                    for (int n = 0; n < 500; ++n) {
+                        sink.format("%d %d %s\n", i, n, std::string(n % 40, 'x'));
+                        tfm::fprintfln(file, "%d %d %s", i, n, std::string(n % 40, 'y'));
+                    }
+                });
+            }
+            for (int i = 0; i < 8; ++i)
+                threads[i].join();
+            sink.flush();
+            CHECK_EQUAL(linesInOrder(shardedOut.str(), 'x'), true);
+            sink.format(tfm::CompiledFormat("%s\n"), "end");
+            sink.vformat("%s %d\n", tfm::makeFormatList("last", 1));
+            EXPECT_ERROR( sink.format("%d %d\n", 1) )
+        }
+        const std::string str = shardedOut.str();
+        CHECK_EQUAL(str.substr(str.size() - 11), "end\nlast 1\n");
+        CHECK_EQUAL(linesInOrder(fileContents(file), 'y'), true);
+        std::fclose(file);
+    }
+#endif
+
+#ifdef TINYFORMAT_USE_FD_SINK
+    //------------------------------------------------------------
+    // Writing to file descriptors
+    {
+        std::FILE* file = std::tmpfile();
+        std::string expected;
+        {
+            tfm::FdSink sink(fileno(file), tfm::FdSink::FullyBuffered, 4096);
+            for (int i = 0; i < 1000; ++i) {
+                CHECK_EQUAL(sink.format("%d:%s\n", i, "x"), true);
+                expected += tfm::format("%d:%s\n", i, "x");
+            }
+            // Output is written as the buffer fills
+            std::string written = fileContents(file);
+            CHECK_EQUAL(written.size() > 0 && written.size() < expected.size(), true);
+            CHECK_EQUAL(expected.compare(0, written.size(), written), 0);
+            // Output larger than the buffer goes straight to the descriptor
+            std::string longStr(10000, 'y');
+            CHECK_EQUAL(sink.format("[%s]", longStr), true);
+            expected += "[" + longStr + "]";
+            CHECK_EQUAL(sink.format(tfm::CompiledFormat("%04x"), 255), true);
+            expected += "00ff";
+            CHECK_EQUAL(sink.flush(), true);
+            CHECK_EQUAL(fileContents(file), expected);
+            EXPECT_ERROR( sink.format("%n", 1) )
+            CHECK_EQUAL(sink.format("end"), true);
+            expected += "end";
+        }
+        CHECK_EQUAL(fileContents(file), expected);
+        std::fclose(file);
+    }
+    {
+        std::FILE* file = std::tmpfile();
+        tfm::FdSink sink(fileno(file), tfm::FdSink::LineBuffered);
+        sink.format("partial %d", 1);
+        CHECK_EQUAL(fileContents(file), "");
+        sink.format(", line %d\n", 2);
+        CHECK_EQUAL(fileContents(file), "partial 1, line 2\n");
+        sink.flush();
+        std::fclose(file);
+    }
+    {
+        // Write errors are reported
+        tfm::FdSink sink(-1, tfm::FdSink::LineBuffered);
+        CHECK_EQUAL(sink.format("a\n"), false);
+        CHECK_EQUAL(sink.good(), false);
+    }
+#endif
+
+#ifdef TINYFORMAT_USE_MMAP_SINK
+    //------------------------------------------------------------
+    // Writing to memory mapped files
+    {
+        char path[] = "/tmp/tinyformat_test_XXXXXX";
+        int fd = mkstemp(path);
+        CHECK_EQUAL(fd >= 0, true);
+        close(fd);
+        std::string expected;
+        {
+            // Small windows to exercise remapping
+            tfm::MmapSink sink(path, 4096);
+            CHECK_EQUAL(sink.good(), true);
+            for (int i = 0; i < 2000; ++i) {
+                CHECK_EQUAL(sink.format("%d:%s\n", i, "x"), true);
+                expected += tfm::format("%d:%s\n", i, "x");
+            }
+            std::string longStr(10000, 'y');
+            CHECK_EQUAL(sink.format(tfm::CompiledFormat("[%s]"), longStr), true);
+            expected += "[" + longStr + "]";
+            CHECK_EQUAL(sink.reserve(100000), true);
+            std::vector<tfm::FormatArgStore> rows;
+            for (int i = 0; i < 100; ++i)
+                rows.push_back(tfm::makeFormatArgStore(i, i*0.5));
+            tfm::format_batch(sink.stream(), "%d,%.1f\n", rows);
+            for (int i = 0; i < 100; ++i)
+                expected += tfm::format("%d,%.1f\n", i, i*0.5);
+            CHECK_EQUAL(sink.size(), expected.size());
+            EXPECT_ERROR( sink.format("%n", 1) )
+        }
+        // The file is truncated to the output on destruction
+        std::FILE* file = std::fopen(path, "rb");
+        CHECK_EQUAL(fileContents(file), expected);
+        std::fclose(file);
+        {
+            tfm::MmapSink sink(path);
+            sink.format("%s", "short");
+            CHECK_EQUAL(sink.close(), true);
+            file = std::fopen(path, "rb");
+            CHECK_EQUAL(fileContents(file), "short");
+            std::fclose(file);
+        }
+        std::remove(path);
+        // Errors creating the file are reported
+        tfm::MmapSink badSink("/nonexistent/tinyformat_test");
+        CHECK_EQUAL(badSink.good(), false);
+        CHECK_EQUAL(badSink.format("%d", 1), false);
+    }
+#endif
+
+#ifdef TINYFORMAT_STATS
+    //------------------------------------------------------------
+    // Formatting statistics
+    {
+        static const char statsFmt[] = "stats %d:% d\n";
+        const tfm::FormatStats before = tfm::format_stats();
+        // Format on new threads, as the table for this thread may be full of
+        // the format strings from the tests above
+        std::thread statsThread([&]{
+            for (int i = 0; i < 3; ++i)
+                CHECK_EQUAL(tfm::format(statsFmt, 10, 5), "stats 10: 5\n");
+            std::ostringstream statsOut;
+            tfm::format(statsOut, statsFmt, 1, 2);
+            EXPECT_ERROR( tfm::format("%d %d", 1) )
+            tfm::CompiledFormat compiledStatsFmt("compiled stats %d");
+            tfm::format(compiledStatsFmt, 123);
+        });
+        statsThread.join();
+        std::thread statsThread2([]{ tfm::format(statsFmt, 1, 2); });
+        statsThread2.join();
+        const tfm::FormatStats after = tfm::format_stats();
+        int sitesFound = 0;
+        for (size_t i = 0; i < after.sites.size(); ++i) {
+            const tfm::FormatSiteStats& site = after.sites[i];
+            if (site.key == statsFmt) {
+                ++sitesFound;
+                CHECK_EQUAL(site.format, statsFmt);
+                CHECK_EQUAL(site.calls, 5u);
+                CHECK_EQUAL(site.bytes, 3*12u + 2*11u);
+            }
+            else if (site.format == "compiled stats %d") {
+                ++sitesFound;
+                CHECK_EQUAL(site.calls, 1u);
+                CHECK_EQUAL(site.bytes, 18u);
+            }
+        }
+        CHECK_EQUAL(sitesFound, 2);
+        CHECK_EQUAL(after.spacePadded - before.spacePadded, 5u);
+        CHECK_EQUAL(after.errors - before.errors, 1u);
+        std::ostringstream dump;
+        tfm::dump_format_stats(dump);
+        CHECK_EQUAL(dump.str().find("stats %d:% d\\n") != std::string::npos, true);
+    }
+#endif
+
+#ifdef TINYFORMAT_USE_CONSTEXPR_PARSER
+    //------------------------------------------------------------
+    // Format strings parsed at compile time
+    CHECK_EQUAL(tfm::format(TINYFORMAT_FMT("%s:%04d:%+.2f:%%:%x"), "a", 42, 3.14159, 255),
+                "a:0042:+3.14:%:ff");
+    CHECK_EQUAL(tfm::format(TINYFORMAT_FMT("%*.*f|%-4d|% d"), 8, 2, 1.5, 3, 4), "    1.50|3   | 4");
+    CHECK_EQUAL(tfm::format(TINYFORMAT_FMT("%2$s %1$*3$d"), 10, "x", 5), "x    10");
+    CHECK_EQUAL(tfm::format(TINYFORMAT_FMT("%1$d"), 10, 20), "10");
+    CHECK_EQUAL(tfm::format(TINYFORMAT_FMT("100%%")), "100%");
+    {
+        std::ostringstream staticOut;
+        EXPECT_ERROR( tfm::vformat(staticOut, TINYFORMAT_FMT("%d %d"), tfm::makeFormatList(1)) )
+    }
+#endif
+
+#ifdef TEST_STATIC_FORMAT_COMPILE
+    // Mismatched argument count - should fail to compile!
+    tfm::format(TINYFORMAT_FMT("%d %d"), 1);
+#endif
+
     //------------------------------------------------------------
     // Misc
     volatile int i = 1234;
     CHECK_EQUAL(tfm::format("%d", i), "1234");
 
-#ifdef TEST_WCHAR_T_COMPILE
-    // Test wchar_t handling - should fail to compile!
-    tfm::format("%ls", L"blah");
+    // Wide strings are written as UTF-8
+    CHECK_EQUAL(tfm::format("%ls|%s", L"abc", std::wstring(L"x\u00e9")), "abc|x\xc3\xa9");
+    CHECK_EQUAL(tfm::format("%ls", L"\u20ac\U0001F600"), "\xe2\x82\xac\xf0\x9f\x98\x80");
+    {
+        const wchar_t badSurrogate[] = { L'a', static_cast<wchar_t>(0xd800), L'b', 0 };
+        CHECK_EQUAL(tfm::format("%ls", badSurrogate), "a\xef\xbf\xbd" "b");
+        // Arrays needn't be null terminated
+        const wchar_t unterminated[2] = { L'x', L'y' };
+        CHECK_EQUAL(tfm::format("%ls!", unterminated), "xy!");
+        const wchar_t* wstr = L"z";
+        CHECK_EQUAL(tfm::format("%p", wstr), tfm::format("%p", static_cast<const void*>(wstr)));
+    }
+    // Width counts bytes as for printf, and truncation keeps whole code points
+    CHECK_EQUAL(tfm::format("%5ls|%-5ls|%.3ls|%.2ls", L"\u00e9", L"\u00e9", L"a\u00e9b", L"a\u00e9b"),
+                "   \xc3\xa9|\xc3\xa9   |a\xc3\xa9|a");
+    {
+        // Long runs of ASCII, which may be converted with SIMD
+        std::wstring longWide(100, L'x');
+        std::string longUtf8(100, 'x');
+        longWide += L"\u00e9";
+        longUtf8 += "\xc3\xa9";
+        longWide += std::wstring(300, L'y');
+        longUtf8 += std::string(300, 'y');
+        CHECK_EQUAL(tfm::format("%ls", longWide), longUtf8);
+        CHECK_EQUAL(tfm::format("%.101ls", longWide), longUtf8.substr(0, 100));
+    }
+#ifdef TINYFORMAT_HAS_UNICODE_CHARS
+    CHECK_EQUAL(tfm::format("%s|%s", u"\u00e9\U0001F600", std::u32string(U"\U0001F600")),
+                "\xc3\xa9\xf0\x9f\x98\x80|\xf0\x9f\x98\x80");
+    {
+        std::string utf8;
+        for (int i = 0; i < 40; ++i)
+            utf8 += "\xc3\xa9";
+        CHECK_EQUAL(tfm::format("%s", std::u16string(40, u'\u00e9') + std::u16string(40, u'a')),
+                    utf8 + std::string(40, 'a'));
+    }
+#endif
+#ifdef TINYFORMAT_HAS_STRING_VIEW
+    CHECK_EQUAL(tfm::format("%.1s|%s", std::wstring_view(L"\u00e9x"), std::u16string_view(u"ab", 1)), "|a");
+#endif
+    // Truncation of narrow strings
+#ifdef TINYFORMAT_UTF8_TRUNCATION
+    CHECK_EQUAL(tfm::format("%.2s|%.3s|%.2s", "a\xc3\xa9", "a\xc3\xa9", std::string("\xe2\x82\xac")),
+                "a|a\xc3\xa9|");
+#else
+    CHECK_EQUAL(tfm::format("%.2s|%.3s", "a\xc3\xa9", "a\xc3\xa9"), "a\xc3|a\xc3\xa9");
 #endif
 
     // Test that formatting is independent of underlying stream state.
@@ -303,6 +1316,24 @@ int unitTests()
     tfm::format(oss, "%f", 10.1234123412341234);
     CHECK_EQUAL(oss.str(), "10.123412");
 
+    std::ostringstream locOss;
+    locOss.imbue(std::locale(std::locale::classic(), new GroupedNumpunct));
+#ifdef TINYFORMAT_C_LOCALE
+    // Test that the stream locale is ignored, including for values which the
+    // float engine can't format
+    tfm::format(locOss, "%d|%u|%s|%.1f|%.20e|%r|%.3f", 1234567, 1000u, true,
+                1234.5, 1234.5, 0.1, 1234.5L);
+    CHECK_EQUAL(locOss.str(), "1234567|1000|true|1234.5|1.23450000000000000000e+03|0.1|1234.500");
+    locOss.str("");
+    tfm::format(locOss, "%f|%+E|%8p|%-4p|%s", std::numeric_limits<double>::infinity(),
+                -std::numeric_limits<double>::infinity(), (void*)0x1234, (void*)0, (void*)0x10);
+    CHECK_EQUAL(locOss.str(), "inf|-INF|  0x1234|0   |0x10");
+#else
+    // Test that the stream locale is respected
+    tfm::format(locOss, "%d|%u|%s|%.1f", 1234567, 1000u, true, 1234.5);
+    CHECK_EQUAL(locOss.str(), "1,234,567|1,000|yes|1,234.5");
+#endif
+
     // Test formatting a custom object
     MyInt myobj(42);
     CHECK_EQUAL(tfm::format("myobj: %s", myobj), "myobj: 42");
@@ -315,14 +1346,32 @@ int unitTests()
     TestExceptionDef ex("blah %d", 100);
     CHECK_EQUAL(ex.what(), std::string("blah 100"));
 
+    // Each argument in a format list is a value pointer and a table pointer
+    CHECK_EQUAL(sizeof(tfm::detail::FormatArg), 2*sizeof(void*));
+    CHECK_EQUAL(sizeof(tfm::detail::FormatListN<4>),
+                sizeof(tfm::FormatList) + 4*sizeof(tfm::detail::FormatArg));
+
     // Test tfm::printf by swapping the std::cout stream buffer to capture data
     // which would noramlly go to the stdout
     std::ostringstream coutCapture;
     std::streambuf* coutBuf = std::cout.rdbuf(coutCapture.rdbuf());
     tfm::printf("%s %s %d\n", "printf", "test", 1);
     tfm::printfln("%s %s %d", "printfln", "test", 1);
+    EXPECT_ERROR( tfm::printfln("%s %d", "discarded") )
+    tfm::printfln("no args");
+#ifdef TINYFORMAT_USE_CONSTEXPR_PARSER
+    tfm::printfln(TINYFORMAT_FMT("%s %d"), "static", 2);
+#else
+    tfm::printfln("%s %d", "static", 2);
+#endif
     std::cout.rdbuf(coutBuf); // restore buffer
-    CHECK_EQUAL(coutCapture.str(), "printf test 1\nprintfln test 1\n");
+#ifdef TINYFORMAT_ATOMIC_PRINTF
+    // The output of a failed call is discarded
+    const char* coutExpected = "printf test 1\nprintfln test 1\nno args\nstatic 2\n";
+#else
+    const char* coutExpected = "printf test 1\nprintfln test 1\ndiscarded no args\nstatic 2\n";
+#endif
+    CHECK_EQUAL(coutCapture.str(), coutExpected);
 
     return nfailed;
 }